@@ -40,7 +40,7 @@ typedef bool lto_bool_t;
  * @{
  */
 
-#define LTO_API_VERSION 11
+#define LTO_API_VERSION 12
 
 /**
  * \since prior to LTO_API_VERSION=3
@@ -475,6 +475,41 @@ lto_codegen_write_merged_modules(lto_code_gen_t cg, const char* path);
 extern const void*
 lto_codegen_compile(lto_code_gen_t cg, size_t* length);
 
+/**
+ * Sets the number of partitions the merged module is split into for code
+ * generation. Each partition is compiled on its own thread into its own
+ * native object file by lto_codegen_compile(). A value of 0 or 1 (the
+ * default) generates a single object file.
+ *
+ * When more than one partition is requested, the linker must retrieve every
+ * object file with lto_codegen_get_num_objects() and lto_codegen_get_object();
+ * lto_codegen_compile() only returns the first one.
+ *
+ * \since LTO_API_VERSION=12
+ */
+extern void
+lto_codegen_set_parallelism(lto_code_gen_t cg, unsigned parallelism);
+
+/**
+ * Returns the number of native object files produced by the last call to
+ * lto_codegen_compile().
+ *
+ * \since LTO_API_VERSION=12
+ */
+extern unsigned
+lto_codegen_get_num_objects(lto_code_gen_t cg);
+
+/**
+ * Returns a pointer to the native object file number \p index produced by the
+ * last call to lto_codegen_compile(), and sets length to its size. The buffer
+ * is owned by the lto_code_gen_t, with the same lifetime as the one returned
+ * by lto_codegen_compile(). Returns NULL if index is out of range.
+ *
+ * \since LTO_API_VERSION=12
+ */
+extern const void*
+lto_codegen_get_object(lto_code_gen_t cg, unsigned index, size_t* length);
+
 /**
  * Generates code for all added modules into one native object file.
  * The name of the file is written to name. Returns true on error.
@@ -15,6 +15,7 @@
 #ifndef LLVM_BITCODE_BITSTREAMWRITER_H
 #define LLVM_BITCODE_BITSTREAMWRITER_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Bitcode/BitCodes.h"
@@ -96,6 +97,14 @@ public:
   explicit BitstreamWriter(SmallVectorImpl<char> &O)
     : Out(O), CurBit(0), CurValue(0), CurCodeSize(2) {}
 
+  /// \brief Create a writer for blocks to be spliced into \p Parent with
+  /// EmitBlockFrom(). It uses the block info abbreviations of \p Parent, and
+  /// can be used on another thread than \p Parent, as long as \p Parent does
+  /// not define new block info abbreviations meanwhile.
+  BitstreamWriter(SmallVectorImpl<char> &O, const BitstreamWriter &Parent)
+    : Out(O), CurBit(0), CurValue(0), CurCodeSize(2),
+      BlockInfoRecords(Parent.BlockInfoRecords) {}
+
   ~BitstreamWriter() {
     assert(CurBit == 0 && "Unflushed data remaining");
     assert(BlockScope.empty() && CurAbbrevs.empty() && "Block imbalance");
@@ -104,6 +113,17 @@ public:
   /// \brief Retrieve the current position in the stream, in bits.
   uint64_t GetCurrentBitNo() const { return GetBufferOffset() * 8 + CurBit; }
 
+  /// \brief Backpatch a 32-bit field that was emitted as zero at bit \p
+  /// BitNo, which does not need to be aligned. The field must already have
+  /// been flushed to the output, which is the case once the enclosing block
+  /// or a later one has been exited.
+  void BackpatchWordAtBit(uint64_t BitNo, uint32_t NewWord) {
+    assert(BitNo + 32 <= GetBufferOffset() * 8 && "Field not flushed yet");
+    for (unsigned I = 0; I != 32; ++I, ++BitNo)
+      if (NewWord & (1U << I))
+        Out[BitNo / 8] |= 1 << (BitNo % 8);
+  }
+
   //===--------------------------------------------------------------------===//
   // Basic Primitives for emitting bits to the stream.
   //===--------------------------------------------------------------------===//
@@ -248,6 +268,47 @@ public:
     BlockScope.pop_back();
   }
 
+  /// \brief Append the block written to \p Block by a writer created for
+  /// this one, which wrote nothing else. The result is the same as if the
+  /// block had been written here: only its header depends on the abbreviation
+  /// width of the enclosing block, and the rest of the block is 32-bit aligned.
+  void EmitBlockFrom(ArrayRef<char> Block) {
+    // Read back the header of the block, written with the default width:
+    //    [ENTER_SUBBLOCK, blockid, newcodelen, <align4bytes>, blocklen]
+    uint64_t BitNo = 0;
+    auto Read = [&](unsigned NumBits) {
+      uint32_t Val = 0;
+      for (unsigned I = 0; I != NumBits; ++I, ++BitNo)
+        if (Block[BitNo / 8] & (1 << (BitNo % 8)))
+          Val |= 1U << I;
+      return Val;
+    };
+    auto ReadVBR = [&](unsigned NumBits) {
+      uint32_t Val = 0;
+      for (unsigned Shift = 0;; Shift += NumBits - 1) {
+        uint32_t Piece = Read(NumBits);
+        Val |= (Piece & ((1U << (NumBits - 1)) - 1)) << Shift;
+        if (!(Piece & (1U << (NumBits - 1))))
+          return Val;
+      }
+    };
+    unsigned Code = Read(2);
+    assert(Code == bitc::ENTER_SUBBLOCK && "Not a block");
+    (void)Code;
+    unsigned BlockID = ReadVBR(bitc::BlockIDWidth);
+    unsigned CodeLen = ReadVBR(bitc::CodeLenWidth);
+
+    EmitCode(bitc::ENTER_SUBBLOCK);
+    EmitVBR(BlockID, bitc::BlockIDWidth);
+    EmitVBR(CodeLen, bitc::CodeLenWidth);
+    FlushToWord();
+
+    size_t HeaderSize = (BitNo + 31) / 32 * 4;
+    assert((Block.size() & 3) == 0 && HeaderSize < Block.size() &&
+           "Incomplete block");
+    Out.append(Block.begin() + HeaderSize, Block.end());
+  }
+
   //===--------------------------------------------------------------------===//
   // Record Emission
   //===--------------------------------------------------------------------===//
@@ -0,0 +1,57 @@
+//===-- llvm/CodeGen/ParallelCG.h - Parallel code generation ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This header declares functions that can be used for parallel code generation.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_CODEGEN_PARALLELCG_H
+#define LLVM_CODEGEN_PARALLELCG_H
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/Support/CodeGen.h"
+#include "llvm/Target/TargetMachine.h"
+#include <functional>
+#include <memory>
+
+namespace llvm {
+
+class Module;
+class TargetLibraryInfo;
+class raw_ostream;
+
+/// Split M into OSs.size() partitions, and generate code for each partition on
+/// its own thread, writing the results to the output streams in OSs. The
+/// partitions are created with SplitModule, and each one is moved to its own
+/// LLVMContext before code generation, so that the threads share no IR.
+///
+/// TMFactory is called on the calling thread to create the target machine of
+/// each partition, so that the caller decides the target, triple and options
+/// exactly as for a single module.
+///
+/// When OSs has a single element, code is generated for M in place on the
+/// calling thread. Otherwise M is only read (see SplitModule), and this
+/// returns once every partition has been written out.
+///
+/// If TLI is not null, it is used as the library info of every partition,
+/// otherwise the default one for the target triple is used. DisableVerify is
+/// passed on to TargetMachine::addPassesToEmitFile.
+///
+/// Returns false and sets ErrMsg if code could not be generated for one of
+/// the partitions. The errors of the worker threads are collected and the
+/// one of the first failing partition is reported.
+bool splitCodeGen(
+    Module &M, ArrayRef<raw_ostream *> OSs,
+    const std::function<std::unique_ptr<TargetMachine>()> &TMFactory,
+    TargetMachine::CodeGenFileType FT, std::string &ErrMsg,
+    const TargetLibraryInfo *TLI = nullptr, bool DisableVerify = false);
+
+} // namespace llvm
+
+#endif
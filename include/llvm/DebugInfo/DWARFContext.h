@@ -200,6 +200,13 @@ public:
   static bool isSupportedVersion(unsigned version) {
     return version == 2 || version == 3 || version == 4;
   }
+protected:
+  /// Return the offset of the compile unit which contains instruction with
+  /// provided address, or -1U if there is none. By default the address ranges
+  /// of getDebugAranges() are used, which may require parsing the DIEs of
+  /// every compile unit; subclasses can answer from a precomputed index.
+  virtual uint32_t getCompileUnitOffsetForAddress(uint64_t Address);
+
 private:
   /// Return the compile unit that includes an offset (relative to .debug_info).
   DWARFCompileUnit *getCompileUnitForOffset(uint32_t Offset);
@@ -11,6 +11,7 @@
 #define LLVM_LIB_DEBUGINFO_DWARFDEBUGARANGES_H
 
 #include "llvm/ADT/DenseSet.h"
+#include "llvm/ADT/iterator_range.h"
 #include "llvm/Support/DataExtractor.h"
 #include <vector>
 
@@ -23,14 +24,6 @@ public:
   void generate(DWARFContext *CTX);
   uint32_t findAddress(uint64_t Address) const;
 
-private:
-  void clear();
-  void extract(DataExtractor DebugArangesData);
-
-  // Call appendRange multiple times and then call construct.
-  void appendRange(uint32_t CUOffset, uint64_t LowPC, uint64_t HighPC);
-  void construct();
-
   struct Range {
     explicit Range(uint64_t LowPC = -1ULL, uint64_t HighPC = -1ULL,
                    uint32_t CUOffset = -1U)
@@ -60,6 +53,24 @@ private:
     uint32_t CUOffset; // Offset of the compile unit or die.
   };
 
+  typedef std::vector<Range>              RangeColl;
+  typedef RangeColl::const_iterator       RangeCollIterator;
+  typedef iterator_range<RangeCollIterator> range_iterator_range;
+
+  /// Get the generated address ranges, sorted by start address and not
+  /// overlapping each other.
+  range_iterator_range ranges() const {
+    return range_iterator_range(Aranges.begin(), Aranges.end());
+  }
+
+private:
+  void clear();
+  void extract(DataExtractor DebugArangesData);
+
+  // Call appendRange multiple times and then call construct.
+  void appendRange(uint32_t CUOffset, uint64_t LowPC, uint64_t HighPC);
+  void construct();
+
   struct RangeEndpoint {
     uint64_t Address;
     uint32_t CUOffset;
@@ -74,9 +85,6 @@ private:
   };
 
 
-  typedef std::vector<Range>              RangeColl;
-  typedef RangeColl::const_iterator       RangeCollIterator;
-
   std::vector<RangeEndpoint> Endpoints;
   RangeColl Aranges;
   DenseSet<uint32_t> ParsedCUOffsets;
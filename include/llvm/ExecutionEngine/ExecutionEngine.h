@@ -402,6 +402,16 @@ public:
     llvm_unreachable("No support for ProcessAllSections option");
   }
 
+  /// setTieredCompilation (MCJIT Only): With lazy compilation, compile each
+  /// function without optimization on its first call, and recompile it with
+  /// the optimization level of the engine on a background thread once it has
+  /// been called \p Threshold times. Calls then go to the optimized code. It
+  /// applies to the modules compiled after the call. A threshold of zero turns
+  /// this off, after waiting for the recompilations already requested.
+  virtual void setTieredCompilation(unsigned Threshold) {
+    llvm_unreachable("No support for tiered compilation");
+  }
+
   /// Return the target machine (if available).
   virtual TargetMachine *getTargetMachine() { return nullptr; }
 
@@ -0,0 +1,86 @@
+//===- FileObjectCache.h - On-disk object cache for MCJIT -------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file contains the declaration of an ObjectCache keeping the objects in
+// a directory, which can be shared by the engines of several processes.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_EXECUTIONENGINE_FILEOBJECTCACHE_H
+#define LLVM_EXECUTIONENGINE_FILEOBJECTCACHE_H
+
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/Support/LockFileManager.h"
+#include "llvm/Support/Mutex.h"
+#include <memory>
+#include <string>
+
+namespace llvm {
+
+class TargetMachine;
+
+/// An ObjectCache storing the objects in a directory, named after a hash of
+/// everything the object depends on: the LLVM version, the bitcode of the
+/// module, the target triple, CPU and features, and the code generation
+/// options of the target machine. A module whose IR has not changed is thus
+/// never compiled twice, whatever its identifier, and a change in any of
+/// these invalidates it.
+///
+/// The first engine missing an object holds a lock file on it until it is
+/// compiled, and the engines of other processes wait for it rather than
+/// compiling the same module concurrently. Objects are written to a temporary
+/// file and renamed, so that they are never seen partially written.
+///
+/// The total size of the objects can be bounded, in which case the least
+/// recently used objects are removed after each new object is stored. Using
+/// an object refreshes its modification time, which is used to rank them.
+class FileObjectCache : public ObjectCache {
+  FileObjectCache(const FileObjectCache &) LLVM_DELETED_FUNCTION;
+  void operator=(const FileObjectCache &) LLVM_DELETED_FUNCTION;
+
+public:
+  /// Create a cache in \p Directory for the objects compiled by \p TM, which
+  /// must outlive it. A \p MaxSize of zero, in bytes, does not bound the
+  /// size of the cache.
+  FileObjectCache(StringRef Directory, const TargetMachine &TM,
+                  uint64_t MaxSize = 0);
+  ~FileObjectCache() override;
+
+  std::unique_ptr<MemoryBuffer> getObject(const Module *M) override;
+  void notifyObjectCompiled(const Module *M, MemoryBufferRef Obj) override;
+
+private:
+  /// A module looked up without success, and that is being compiled.
+  struct PendingObject {
+    std::string Path;
+    /// The lock on Path, if this process owns it.
+    std::unique_ptr<LockFileManager> Lock;
+  };
+
+  /// Get the path of the object compiled from \p M.
+  std::string getObjectPath(const Module &M) const;
+
+  /// Remove the least recently used objects until the cache fits in MaxSize,
+  /// keeping \p Keep.
+  void prune(StringRef Keep);
+
+  std::string Directory;
+  const TargetMachine &TM;
+  uint64_t MaxSize;
+
+  sys::Mutex Lock;
+  /// The codegen passes modify the module, so its key is computed once when
+  /// it is looked up.
+  DenseMap<const Module *, PendingObject> Pending;
+};
+
+} // End llvm namespace
+
+#endif
@@ -69,6 +69,26 @@ public:
     unsigned BeginIdx, EndIdx;
   };
 
+  /// \brief The work done to link the loaded objects, accumulated since the
+  /// first one was loaded.
+  struct Statistics {
+    /// Number of symbol names looked up, either in the symbols of the loaded
+    /// objects or through the memory manager. Each distinct symbol is looked
+    /// up once per object referencing it, and once more if it is external.
+    unsigned NumSymbolLookups;
+    /// Number of relocations applied.
+    unsigned NumRelocations;
+    /// Wall clock time spent looking symbols up, in seconds. The time spent in
+    /// RTDyldMemoryManager::getSymbolAddress is not included.
+    double SymbolLookupTime;
+    /// Wall clock time spent applying relocations, in seconds.
+    double RelocationTime;
+
+    Statistics()
+        : NumSymbolLookups(0), NumRelocations(0), SymbolLookupTime(0),
+          RelocationTime(0) {}
+  };
+
   RuntimeDyld(RTDyldMemoryManager *);
   ~RuntimeDyld();
 
@@ -92,6 +112,9 @@ public:
   /// Resolve the relocations for all symbols we currently know about.
   void resolveRelocations();
 
+  /// Get the work done so far by loadObject and resolveRelocations.
+  Statistics getStatistics() const;
+
   /// Map a section to its target address space value.
   /// Map the address of a JIT section as returned from the memory manager
   /// to the address in the target process as the running code will see it.
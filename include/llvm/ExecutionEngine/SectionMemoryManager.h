@@ -34,12 +34,32 @@ namespace llvm {
 /// in the JITed object.  Permissions can be applied either by calling
 /// MCJIT::finalizeObject or by calling SectionMemoryManager::finalizeMemory
 /// directly.  Clients of MCJIT should call MCJIT::finalizeObject.
+///
+/// Sections are carved out of slabs, which are allocated next to the previous
+/// slab of the same kind so that the code stays close together. Only the pages
+/// of the sections allocated since the last finalization change permissions,
+/// the rest of a slab is used by the following objects.
+///
+/// Memory is reused across engines: the slabs of destroyed memory managers are
+/// kept for the next ones, rather than returned to the system, up to a limit.
+/// The sections of a module removed from a live engine are not reused, since
+/// RuntimeDyld cannot unload an object.
 class SectionMemoryManager : public RTDyldMemoryManager {
   SectionMemoryManager(const SectionMemoryManager&) LLVM_DELETED_FUNCTION;
   void operator=(const SectionMemoryManager&) LLVM_DELETED_FUNCTION;
 
 public:
-  SectionMemoryManager() { }
+  enum { DefaultSlabSize = 1024 * 1024 };
+
+  /// \brief Create a memory manager allocating slabs of \p SlabSize bytes,
+  /// except for the sections that do not fit in one.
+  ///
+  /// If \p UseHugePages is true, the code slabs are rounded to the huge page
+  /// size and backed by huge pages where the system supports it, which
+  /// reduces the instruction TLB misses of large amounts of JIT code.
+  explicit SectionMemoryManager(uintptr_t SlabSize = DefaultSlabSize,
+                                bool UseHugePages = false)
+      : SlabSize(SlabSize), UseHugePages(UseHugePages) {}
   virtual ~SectionMemoryManager();
 
   /// \brief Allocates a memory block of (at least) the given size suitable for
@@ -84,7 +104,12 @@ public:
 
 private:
   struct MemoryGroup {
+      /// The slabs.
       SmallVector<sys::MemoryBlock, 16> AllocatedMem;
+      /// The blocks of the sections too large for a slab.
+      SmallVector<sys::MemoryBlock, 4> LargeMem;
+      /// The sections allocated since the last finalizeMemory.
+      SmallVector<sys::MemoryBlock, 16> PendingMem;
       SmallVector<sys::MemoryBlock, 16> FreeMem;
       sys::MemoryBlock Near;
   };
@@ -92,9 +117,16 @@ private:
   uint8_t *allocateSection(MemoryGroup &MemGroup, uintptr_t Size,
                            unsigned Alignment);
 
+  /// Allocate a block of at least \p Size bytes for \p MemGroup, a slab
+  /// unless \p Size is larger than one.
+  sys::MemoryBlock allocateSlab(MemoryGroup &MemGroup, uintptr_t Size,
+                                std::error_code &EC);
+
   std::error_code applyMemoryGroupPermissions(MemoryGroup &MemGroup,
                                               unsigned Permissions);
 
+  uintptr_t SlabSize;
+  bool UseHugePages;
   MemoryGroup CodeMem;
   MemoryGroup RWDataMem;
   MemoryGroup RODataMem;
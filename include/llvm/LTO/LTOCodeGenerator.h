@@ -40,6 +40,7 @@
 #include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/StringMap.h"
 #include "llvm/Linker/Linker.h"
+#include "llvm/Support/CodeGen.h"
 #include "llvm/Target/TargetOptions.h"
 #include <string>
 #include <vector>
@@ -74,6 +75,11 @@ struct LTOCodeGenerator {
   void setCpu(const char *mCpu) { MCpu = mCpu; }
   void setAttr(const char *mAttr) { MAttr = mAttr; }
 
+  // Split the merged module into the given number of partitions and generate
+  // code for each of them on its own thread. Only compile() honors this; the
+  // resulting objects are retrieved with getNumObjects() and getObject().
+  void setCodeGenParallelism(unsigned N) { CodeGenParallelism = N ? N : 1; }
+
   void addMustPreserveSymbol(const char *sym) { MustPreserveSymbols[sym] = 1; }
 
   // To pass options to the driver and optimization passes. These options are
@@ -117,6 +123,14 @@ struct LTOCodeGenerator {
                       bool disableVectorization,
                       std::string &errMsg);
 
+  // Return the number of object files produced by the last call to compile().
+  // This is the code generation parallelism level, or 1.
+  unsigned getNumObjects() const { return NativeObjectFiles.size(); }
+
+  // Return the object file number Index produced by the last call to
+  // compile(), and set length to its size.
+  const void *getObject(unsigned Index, size_t *length);
+
   void setDiagnosticHandler(lto_diagnostic_handler_t, void *);
 
   LLVMContext &getContext() { return Context; }
@@ -124,9 +138,14 @@ struct LTOCodeGenerator {
 private:
   void initializeLTOPasses();
 
+  bool optimize(bool disableOpt, bool disableInline, bool disableGVNLoadPRE,
+                bool disableVectorization, std::string &errMsg);
   bool generateObjectFile(raw_ostream &out, bool disableOpt, bool disableInline,
                           bool disableGVNLoadPRE, bool disableVectorization,
                           std::string &errMsg);
+  bool generateObjectFiles(ArrayRef<raw_ostream *> Outs, bool disableOpt,
+                           bool disableInline, bool disableGVNLoadPRE,
+                           bool disableVectorization, std::string &errMsg);
   void applyScopeRestrictions();
   void applyRestriction(GlobalValue &GV, ArrayRef<StringRef> Libcalls,
                         std::vector<const char *> &MustPreserveList,
@@ -150,12 +169,15 @@ private:
   lto_codegen_model CodeModel;
   StringSet MustPreserveSymbols;
   StringSet AsmUndefinedRefs;
-  std::unique_ptr<MemoryBuffer> NativeObjectFile;
+  std::vector<std::unique_ptr<MemoryBuffer>> NativeObjectFiles;
   std::vector<char *> CodegenOptions;
   std::string MCpu;
   std::string MAttr;
+  std::string FeatureStr;
   std::string NativeObjectPath;
   TargetOptions Options;
+  Reloc::Model RelocModel;
+  unsigned CodeGenParallelism;
   lto_diagnostic_handler_t DiagHandler;
   void *DiagContext;
 };
@@ -16,6 +16,7 @@
 #include "llvm/IR/DiagnosticInfo.h"
 
 namespace llvm {
+class GlobalValue;
 class Module;
 class StructType;
 class Type;
@@ -26,6 +27,15 @@ class Type;
 /// something with it after the linking.
 class Linker {
 public:
+  enum Flags {
+    None = 0,
+    /// Only link the definitions of the source module that the composite
+    /// references, the roots given to linkInModule, and the definitions they
+    /// reference in turn. Function bodies are only materialized when linked,
+    /// so that a lazily loaded source does not read the dead ones.
+    LinkOnlyNeeded = 1 << 0
+  };
+
   struct StructTypeKeyInfo {
     struct KeyTy {
       ArrayRef<Type *> ETypes;
@@ -67,8 +77,10 @@ public:
   void deleteModule();
 
   /// \brief Link \p Src into the composite. The source is destroyed.
-  /// Returns true on error.
-  bool linkInModule(Module *Src);
+  /// \p Roots are globals of \p Src that are always linked, with
+  /// LinkOnlyNeeded in \p Flags. Returns true on error.
+  bool linkInModule(Module *Src, unsigned Flags = None,
+                    ArrayRef<const GlobalValue *> Roots = llvm::None);
 
   static bool LinkModules(Module *Dest, Module *Src,
                           DiagnosticHandlerFunction DiagnosticHandler);
@@ -10,6 +10,7 @@
 #ifndef LLVM_MC_MCASSEMBLER_H
 #define LLVM_MC_MCASSEMBLER_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/PointerIntPair.h"
@@ -25,6 +26,7 @@
 #include "llvm/Support/Casting.h"
 #include "llvm/Support/DataTypes.h"
 #include <algorithm>
+#include <mutex>
 #include <vector> // FIXME: Shouldn't be needed.
 
 namespace llvm {
@@ -913,6 +915,10 @@ private:
   // refactoring too.
   mutable SmallPtrSet<const MCSymbol*, 64> ThumbFuncs;
 
+  /// Serializes the encoding of relaxed instructions, which may allocate
+  /// expressions in the MCContext, when sections are relaxed concurrently.
+  std::mutex RelaxationEncoderMutex;
+
   /// \brief The bundle alignment size currently set in the assembler.
   ///
   /// By default it's 0, which means bundling is disabled.
@@ -960,13 +966,26 @@ private:
   bool fragmentNeedsRelaxation(const MCRelaxableFragment *IF,
                                const MCAsmLayout &Layout) const;
 
-  /// \brief Perform one layout iteration and return true if any offsets
-  /// were adjusted.
-  bool layoutOnce(MCAsmLayout &Layout);
-
-  /// \brief Perform one layout iteration of the given section and return true
-  /// if any offsets were adjusted.
-  bool layoutSectionOnce(MCAsmLayout &Layout, MCSectionData &SD);
+  /// \brief Perform one layout iteration of the given sections and return
+  /// true if any offsets were adjusted.
+  bool layoutOnce(MCAsmLayout &Layout, ArrayRef<MCSectionData *> Sections);
+
+  /// \brief Relax each of the given sections until it reaches a fixed point,
+  /// on \p NumThreads threads. The relaxation of the sections must not depend
+  /// on the layout of any other section.
+  void relaxSectionsConcurrently(MCAsmLayout &Layout,
+                                 ArrayRef<MCSectionData *> Sections,
+                                 unsigned NumThreads);
+
+  /// \brief Relax the given section until it reaches a fixed point, given
+  /// the current layout of the other sections, and return true if any
+  /// offsets were adjusted. Only the fragments which may be affected by the
+  /// size changes of a pass are revisited by the next one.
+  bool relaxSection(MCAsmLayout &Layout, MCSectionData &SD);
+
+  /// \brief Recompute the size of \p F if it is a relaxable fragment, and
+  /// return true if it changed.
+  bool relaxFragment(MCAsmLayout &Layout, MCFragment &F);
 
   bool relaxInstruction(MCAsmLayout &Layout, MCRelaxableFragment &IF);
 
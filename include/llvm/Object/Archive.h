@@ -14,6 +14,7 @@
 #ifndef LLVM_OBJECT_ARCHIVE_H
 #define LLVM_OBJECT_ARCHIVE_H
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/iterator_range.h"
 #include "llvm/Object/Binary.h"
@@ -158,6 +159,7 @@ public:
     const Symbol *operator->() const {
       return &symbol;
     }
+    const Symbol &operator*() const { return symbol; }
 
     bool operator==(const symbol_iterator &other) const {
       return symbol == other.symbol;
@@ -199,18 +201,33 @@ public:
     return v->isArchive();
   }
 
-  // check if a symbol is in the archive
+  /// \brief Find the member defining the symbol \p name, or return
+  /// child_end() if the symbol table has no such symbol.
+  ///
+  /// This is a hash table query in an index of the symbol table built with
+  /// the archive, so lookups can be made from several threads.
   child_iterator findSym(StringRef name) const;
 
+  /// \brief Get the member whose header starts \p Offset bytes into the
+  /// archive, without walking the members before it. Offsets are for
+  /// instance taken from getChildOffset() or from the symbol table.
+  ErrorOr<child_iterator> getChildAtOffset(uint64_t Offset) const;
+
   bool hasSymbolTable() const;
   child_iterator getSymbolTableChild() const { return SymbolTable; }
 
 private:
+  void parseSpecialMembers(std::error_code &ec);
+  void buildSymbolIndex();
+
   child_iterator SymbolTable;
   child_iterator StringTable;
   child_iterator FirstRegular;
   unsigned Format : 2;
   unsigned IsThin : 1;
+
+  /// The first symbol of each name in the symbol table.
+  StringMap<Symbol> SymbolsByName;
 };
 
 }
@@ -59,6 +59,15 @@ static inline uint64_t SPMagic() {
 
 static inline uint64_t SPVersion() { return 100; }
 
+static inline uint64_t SPIndexedMagic() {
+  return uint64_t('S') << (64 - 8) | uint64_t('P') << (64 - 16) |
+         uint64_t('R') << (64 - 24) | uint64_t('O') << (64 - 32) |
+         uint64_t('F') << (64 - 40) | uint64_t('I') << (64 - 48) |
+         uint64_t('D') << (64 - 56) | uint64_t('X');
+}
+
+static inline uint64_t SPIndexedVersion() { return 1; }
+
 /// \brief Represents the relative location of an instruction.
 ///
 /// Instruction locations are specified by the line offset from the
@@ -24,8 +24,11 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/Endian.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/OnDiskHashTable.h"
 #include "llvm/Support/raw_ostream.h"
+#include <memory>
 
 namespace llvm {
 
@@ -55,9 +58,11 @@ namespace sampleprof {
 ///      protection against source code shuffling, line numbers should
 ///      be relative to the start of the function.
 ///
-/// The reader supports two file formats: text and binary. The text format
-/// is useful for debugging and testing, while the binary format is more
-/// compact. They can both be used interchangeably.
+/// The reader supports three file formats: text, binary and indexed. The
+/// text format is useful for debugging and testing, while the binary format
+/// is more compact. The indexed format lets the reader decode the profile
+/// of a function only when it is requested. They can all be used
+/// interchangeably.
 class SampleProfileReader {
 public:
   SampleProfileReader(std::unique_ptr<MemoryBuffer> B, LLVMContext &C)
@@ -71,6 +76,11 @@ public:
   /// \brief Read sample profiles from the associated file.
   virtual std::error_code read() = 0;
 
+  /// \brief Read what is needed to answer getSamplesFor queries. Readers
+  /// that can decode the profile of each function on demand do not read
+  /// the profiles here, the others read all of them.
+  virtual std::error_code readForLookups() { return read(); }
+
   /// \brief Print the profile for \p FName on stream \p OS.
   void dumpFunctionProfile(StringRef FName, raw_ostream &OS = dbgs());
 
@@ -78,7 +88,7 @@ public:
   void dump(raw_ostream &OS = dbgs());
 
   /// \brief Return the samples collected for function \p F.
-  FunctionSamples *getSamplesFor(const Function &F) {
+  virtual FunctionSamples *getSamplesFor(const Function &F) {
     return &Profiles[F.getName()];
   }
 
@@ -137,6 +147,10 @@ public:
   static bool hasFormat(const MemoryBuffer &Buffer);
 
 protected:
+  /// \brief Read the profile of a function, past its name, into \p
+  /// FProfile.
+  std::error_code readProfile(FunctionSamples &FProfile);
+
   /// \brief Read a numeric value of type T from the profile.
   ///
   /// If an error occurs during decoding, a diagnostic message is emitted and
@@ -163,6 +177,78 @@ protected:
   const uint8_t *End;
 };
 
+/// \brief Trait for looking up the profile of a function, by name, in the
+/// hash table of an indexed sample profile. The profiles are returned
+/// undecoded.
+class SampleProfLookupTrait {
+public:
+  typedef StringRef data_type;
+  typedef StringRef internal_key_type;
+  typedef StringRef external_key_type;
+  typedef uint64_t hash_value_type;
+  typedef uint64_t offset_type;
+
+  static bool EqualKey(StringRef A, StringRef B) { return A == B; }
+  static StringRef GetInternalKey(StringRef K) { return K; }
+  static StringRef GetExternalKey(StringRef K) { return K; }
+
+  static hash_value_type ComputeHash(StringRef K);
+
+  static std::pair<offset_type, offset_type>
+  ReadKeyDataLength(const unsigned char *&D) {
+    using namespace support;
+    offset_type KeyLen = endian::readNext<offset_type, little, unaligned>(D);
+    offset_type DataLen = endian::readNext<offset_type, little, unaligned>(D);
+    return std::make_pair(KeyLen, DataLen);
+  }
+
+  StringRef ReadKey(const unsigned char *D, offset_type N) {
+    return StringRef((const char *)D, N);
+  }
+
+  StringRef ReadData(StringRef K, const unsigned char *D, offset_type N) {
+    return StringRef((const char *)D, N);
+  }
+};
+typedef OnDiskIterableChainedHashTable<SampleProfLookupTrait>
+    SampleProfReaderIndex;
+
+/// \brief Reader for the indexed binary sample profile format.
+///
+/// The profiles are found through an on-disk hash table keyed by function
+/// name, and are only decoded by getSamplesFor, so that the cost of loading
+/// a large profile does not depend on its size.
+class SampleProfileReaderIndexed : public SampleProfileReaderBinary {
+public:
+  SampleProfileReaderIndexed(std::unique_ptr<MemoryBuffer> B, LLVMContext &C)
+      : SampleProfileReaderBinary(std::move(B), C) {}
+
+  /// \brief Read and validate the file header, and set up the index.
+  std::error_code readHeader() override;
+
+  /// \brief Read all the sample profiles from the associated file.
+  std::error_code read() override;
+
+  /// \brief The index was set up by readHeader, nothing else to read.
+  std::error_code readForLookups() override {
+    return sampleprof_error::success;
+  }
+
+  /// \brief Return the samples collected for function \p F, decoding them
+  /// on first use.
+  FunctionSamples *getSamplesFor(const Function &F) override;
+
+  /// \brief Return true if \p Buffer is in the format supported by this class.
+  static bool hasFormat(const MemoryBuffer &Buffer);
+
+private:
+  /// \brief Decode the profile \p Data of function \p FName into Profiles.
+  std::error_code readFunction(StringRef FName, StringRef Data);
+
+  /// \brief The index into the profile data.
+  std::unique_ptr<SampleProfReaderIndex> Index;
+};
+
 } // End namespace sampleprof
 
 } // End namespace llvm
@@ -13,6 +13,7 @@
 #ifndef LLVM_PROFILEDATA_SAMPLEPROFWRITER_H
 #define LLVM_PROFILEDATA_SAMPLEPROFWRITER_H
 
+#include "llvm/ADT/StringMap.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/Module.h"
@@ -25,7 +26,13 @@ namespace llvm {
 
 namespace sampleprof {
 
-enum SampleProfileFormat { SPF_None = 0, SPF_Text, SPF_Binary, SPF_GCC };
+enum SampleProfileFormat {
+  SPF_None = 0,
+  SPF_Text,
+  SPF_Binary,
+  SPF_GCC,
+  SPF_Indexed
+};
 
 /// \brief Sample-based profile writer. Base class.
 class SampleProfileWriter {
@@ -70,6 +77,12 @@ public:
     return true;
   }
 
+  /// \brief Write out any profile data buffered by the writer and flush the
+  /// output. Must be called after the last profile has been written.
+  ///
+  /// \returns an error code if the output could not be written.
+  virtual std::error_code write();
+
   /// \brief Profile writer factory. Create a new writer based on the value of
   /// \p Format.
   static ErrorOr<std::unique_ptr<SampleProfileWriter>>
@@ -103,6 +116,26 @@ public:
   }
 };
 
+/// \brief Sample-based profile writer (indexed format).
+///
+/// The profiles are buffered, and the file is written by write(), once the
+/// hash table of all the functions can be built.
+class SampleProfileWriterIndexed : public SampleProfileWriter {
+public:
+  SampleProfileWriterIndexed(StringRef F, std::error_code &EC)
+      : SampleProfileWriter(F, EC, sys::fs::F_None) {}
+
+  bool write(StringRef F, const FunctionSamples &S) override;
+  std::error_code write() override;
+  bool write(const Module &M, StringMap<FunctionSamples> &P) {
+    return SampleProfileWriter::write(M, P);
+  }
+
+private:
+  /// \brief The encoded profile of every function written so far.
+  StringMap<std::string> Profiles;
+};
+
 } // End namespace sampleprof
 
 } // End namespace llvm
@@ -18,6 +18,8 @@
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/DataTypes.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/raw_ostream.h"
+#include <memory>
 
 namespace llvm {
 /// FileOutputBuffer - This interface provides simple way to create an in-memory
@@ -84,6 +86,34 @@ private:
   SmallString<128>    FinalPath;
   SmallString<128>    TempPath;
 };
+
+/// raw_output_buffer_ostream - A raw_ostream writing to a file through a
+/// FileOutputBuffer. Writers that know the size of their output up front
+/// announce it with reserveExtraSpace(), after which the data is copied
+/// straight to its final location in the mapped file. Anything written without
+/// a reservation, or past its end, is kept in memory until commit().
+class raw_output_buffer_ostream : public raw_ostream {
+  SmallString<128> Path;
+  unsigned Flags;
+  std::unique_ptr<FileOutputBuffer> Buffer;
+  /// The data that did not fit in Buffer, which holds everything before it.
+  SmallVector<char, 0> Overflow;
+  uint64_t Pos;
+
+  void write_impl(const char *Ptr, size_t Size) override;
+  uint64_t current_pos() const override { return Pos; }
+
+public:
+  /// \p Flags are passed on to FileOutputBuffer::create().
+  explicit raw_output_buffer_ostream(StringRef Path, unsigned Flags = 0);
+  ~raw_output_buffer_ostream();
+
+  void reserveExtraSpace(uint64_t ExtraSize) override;
+
+  /// Write the data to the file. If this is not called before the stream is
+  /// destroyed, the file is not written.
+  std::error_code commit();
+};
 } // end namespace llvm
 
 #endif
@@ -68,6 +68,14 @@ namespace sys {
   ///
   /// \return - True on success.
   bool getHostCPUFeatures(StringMap<bool> &Features);
+
+  /// getHostNumPhysicalCores - Get the number of physical cores (as opposed
+  /// to logical cores returned from std::thread::hardware_concurrency(),
+  /// which includes hyperthreads).
+  ///
+  /// \return - The number of physical cores, or -1 if it could not be
+  /// determined on this host.
+  int getHostNumPhysicalCores();
 }
 }
 
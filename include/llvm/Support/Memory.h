@@ -47,7 +47,11 @@ namespace sys {
     enum ProtectionFlags {
       MF_READ  = 0x1000000,
       MF_WRITE = 0x2000000,
-      MF_EXEC  = 0x4000000
+      MF_EXEC  = 0x4000000,
+      /// Only meaningful to allocateMappedMemory: back the block with huge
+      /// pages if the system supports it. The block is then rounded to, and
+      /// aligned on, the huge page size.
+      MF_HUGE_HINT = 0x0000001
     };
 
     /// This method allocates a block of memory that is suitable for loading
@@ -0,0 +1,159 @@
+//===-- llvm/Support/ThreadPool.h - A ThreadPool implementation -*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines a crude C++11 based thread pool, and a task group that
+// can be used to wait on a batch of tasks submitted to a shared pool.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_SUPPORT_THREADPOOL_H
+#define LLVM_SUPPORT_THREADPOOL_H
+
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Compiler.h"
+
+#include <functional>
+#include <future>
+#include <memory>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#if LLVM_ENABLE_THREADS
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#endif
+
+namespace llvm {
+
+/// A ThreadPool for asynchronous parallel execution on a defined number of
+/// threads.
+///
+/// The pool keeps a vector of threads alive, waiting on a condition variable
+/// for some work to become available. Tasks are dispatched in FIFO order.
+///
+/// When LLVM is built without thread support, tasks are run synchronously on
+/// the calling thread as they are submitted.
+class ThreadPool {
+public:
+  typedef std::function<void()> TaskTy;
+
+  /// Construct a pool with one worker per physical core, as reported by
+  /// heavyweight_hardware_concurrency().
+  ThreadPool();
+
+  /// Construct a pool of \p ThreadCount threads. A count of zero is treated
+  /// as one.
+  explicit ThreadPool(unsigned ThreadCount);
+
+  /// Blocking destructor: the pool will wait for all the threads to complete.
+  ~ThreadPool();
+
+  /// Asynchronous submission of a task to the pool. The returned future can
+  /// be used to wait for the task to finish and to retrieve its result. The
+  /// callable and its arguments are copied into the task.
+  template <typename Function, typename... Args>
+  auto async(Function &&F, Args &&... ArgList)
+      -> std::shared_future<decltype(F(ArgList...))> {
+    typedef decltype(F(ArgList...)) ResultTy;
+    auto Task = std::make_shared<std::packaged_task<ResultTy()>>(
+        std::bind(std::forward<Function>(F), std::forward<Args>(ArgList)...));
+    std::shared_future<ResultTy> Future = Task->get_future().share();
+    enqueue([Task]() { (*Task)(); });
+    return Future;
+  }
+
+  /// Blocking wait for all the tasks submitted so far to execute. It is an
+  /// error to try to add new tasks while blocking on this call, and it must
+  /// not be called from one of the pool's own threads.
+  void wait();
+
+  /// Return the number of worker threads owned by this pool.
+  unsigned getThreadCount() const { return ThreadCount; }
+
+private:
+  friend class TaskGroup;
+
+  /// Push \p Task on the queue and wake up a worker to run it.
+  void enqueue(TaskTy Task);
+
+#if LLVM_ENABLE_THREADS
+  /// Main loop of the worker threads: pop tasks until the pool is destroyed.
+  void workerLoop();
+
+  /// Threads in flight.
+  std::vector<std::thread> Threads;
+
+  /// Tasks waiting for execution in the pool.
+  std::queue<TaskTy> Tasks;
+
+  /// Locking and signaling for accessing the Tasks queue.
+  std::mutex QueueLock;
+  std::condition_variable QueueCondition;
+
+  /// Locking and signaling for job completion.
+  std::condition_variable CompletionCondition;
+
+  /// Keep track of the number of threads actually busy.
+  unsigned ActiveThreads;
+
+  /// Signal for the destruction of the pool, asking threads to exit.
+  bool EnableFlag;
+#endif
+
+  unsigned ThreadCount;
+
+  ThreadPool(const ThreadPool &) LLVM_DELETED_FUNCTION;
+  void operator=(const ThreadPool &) LLVM_DELETED_FUNCTION;
+};
+
+/// A batch of tasks submitted to a shared ThreadPool that can be waited on
+/// independently of any other work in flight on the pool. This lets several
+/// clients (or several phases of one client) share a single set of workers.
+///
+/// The destructor waits for every task spawned through the group. As with
+/// ThreadPool::wait(), waiting on a group from a task running on the same
+/// pool may deadlock.
+class TaskGroup {
+public:
+  explicit TaskGroup(ThreadPool &Pool);
+  ~TaskGroup();
+
+  /// Submit a task to the underlying pool as part of this group.
+  template <typename Function, typename... Args>
+  void spawn(Function &&F, Args &&... ArgList) {
+    spawnImpl(
+        std::bind(std::forward<Function>(F), std::forward<Args>(ArgList)...));
+  }
+
+  /// Block until every task spawned so far through this group has finished.
+  void wait();
+
+  ThreadPool &getPool() const { return Pool; }
+
+private:
+  void spawnImpl(ThreadPool::TaskTy Task);
+
+  ThreadPool &Pool;
+
+#if LLVM_ENABLE_THREADS
+  /// Number of tasks spawned through this group and not yet finished.
+  unsigned Pending;
+  std::mutex Lock;
+  std::condition_variable Done;
+#endif
+
+  TaskGroup(const TaskGroup &) LLVM_DELETED_FUNCTION;
+  void operator=(const TaskGroup &) LLVM_DELETED_FUNCTION;
+};
+
+} // end namespace llvm
+
+#endif // LLVM_SUPPORT_THREADPOOL_H
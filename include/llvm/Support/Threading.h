@@ -34,6 +34,12 @@ namespace llvm {
   /// the thread stack.
   void llvm_execute_on_thread(void (*UserFn)(void*), void *UserData,
                               unsigned RequestedStackSize = 0);
+
+  /// Get the amount of concurrency to use for tasks requiring significant
+  /// memory or other resources. Currently based on physical cores, if
+  /// available for the host system, otherwise falls back to
+  /// std::thread::hardware_concurrency(). Always returns at least 1.
+  unsigned heavyweight_hardware_concurrency();
 }
 
 #endif
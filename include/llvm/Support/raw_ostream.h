@@ -254,6 +254,11 @@ public:
   /// This function determines if this stream is displayed and supports colors.
   virtual bool has_colors() const { return is_displayed(); }
 
+  /// Tells the stream that \p ExtraSize more bytes are about to be written.
+  /// Streams writing to storage that cannot grow cheaply use it to allocate
+  /// all of it at once; the default does nothing.
+  virtual void reserveExtraSpace(uint64_t ExtraSize) { (void)ExtraSize; }
+
   //===--------------------------------------------------------------------===//
   // Subclass Interface
   //===--------------------------------------------------------------------===//
@@ -0,0 +1,54 @@
+//===- SplitModule.h - Split a module into partitions -----------*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the function llvm::SplitModule, which splits a module
+// into multiple linkable partitions. It can be used to implement parallel code
+// generation for link-time optimization.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef LLVM_TRANSFORMS_UTILS_SPLITMODULE_H
+#define LLVM_TRANSFORMS_UTILS_SPLITMODULE_H
+
+#include <functional>
+#include <memory>
+
+namespace llvm {
+
+class Module;
+
+/// Splits the module M into N linkable partitions. The function ModuleCallback
+/// is called N times passing each individual partition as the MPart argument.
+/// M itself is left in place, apart from naming its unnamed global values.
+///
+/// Global values are grouped into clusters that must stay in the same
+/// partition:
+///
+/// - every member of a comdat group;
+/// - an alias and the object it aliases;
+/// - a local (internal or private) global value and every global value that
+///   references it, so that locals never need to be externalized and
+///   functions stay close to the local helpers they call;
+/// - a function and the functions that take the address of its blocks;
+/// - the functions of a strongly connected component of the call graph.
+///
+/// Clusters are then distributed over the partitions, largest first, to the
+/// partition with the least amount of code so far. The assignment only depends
+/// on the module contents, so the same module always produces the same
+/// partitions. Module-level inline asm is only kept in the first partition.
+///
+/// FIXME: Internal symbols defined in module-level inline asm are not visible
+/// from the other partitions.
+void SplitModule(
+    Module &M, unsigned N,
+    std::function<void(std::unique_ptr<Module> MPart)> ModuleCallback);
+
+} // End llvm namespace
+
+#endif
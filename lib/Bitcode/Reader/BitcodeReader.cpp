@@ -78,7 +78,7 @@ BitcodeReader::BitcodeReader(MemoryBuffer *buffer, LLVMContext &C,
                              DiagnosticHandlerFunction DiagnosticHandler)
     : Context(C), DiagnosticHandler(getDiagHandler(DiagnosticHandler, C)),
       TheModule(nullptr), Buffer(buffer), LazyStreamer(nullptr),
-      NextUnreadBit(0), SeenValueSymbolTable(false), ValueList(C),
+      NextUnreadBit(0), SeenValueSymbolTable(false), VSTOffset(0), ValueList(C),
       MDValueList(C), SeenFirstFunctionBody(false), UseRelativeIDs(false),
       WillMaterializeAllForwardRefs(false) {}
 
@@ -86,7 +86,7 @@ BitcodeReader::BitcodeReader(DataStreamer *streamer, LLVMContext &C,
                              DiagnosticHandlerFunction DiagnosticHandler)
     : Context(C), DiagnosticHandler(getDiagHandler(DiagnosticHandler, C)),
       TheModule(nullptr), Buffer(nullptr), LazyStreamer(streamer),
-      NextUnreadBit(0), SeenValueSymbolTable(false), ValueList(C),
+      NextUnreadBit(0), SeenValueSymbolTable(false), VSTOffset(0), ValueList(C),
       MDValueList(C), SeenFirstFunctionBody(false), UseRelativeIDs(false),
       WillMaterializeAllForwardRefs(false) {}
 
@@ -1101,7 +1101,25 @@ std::error_code BitcodeReader::ParseTypeTableBody() {
   }
 }
 
-std::error_code BitcodeReader::ParseValueSymbolTable() {
+/// ParseValueSymbolTable - Parse a value symbol table block. If \p Offset is
+/// not zero, it is the word offset of the module-level table, which is parsed
+/// out of order before the stream position is restored.
+std::error_code BitcodeReader::ParseValueSymbolTable(uint64_t Offset) {
+  uint64_t CurrentBit = 0;
+  // The function offsets are those of the ENTER_SUBBLOCK abbreviation of
+  // their block, while the deferred function info is the position past the
+  // block ID, as seen by RememberAndSkipFunctionBody.
+  uint64_t FuncBitcodeOffsetDelta = 0;
+  if (Offset > 0) {
+    CurrentBit = Stream.GetCurrentBitNo();
+    FuncBitcodeOffsetDelta = Stream.getAbbrevIDWidth() + bitc::BlockIDWidth;
+    Stream.JumpToBit(Offset * 32);
+    BitstreamEntry Entry = Stream.advance();
+    if (Entry.Kind != BitstreamEntry::SubBlock ||
+        Entry.ID != bitc::VALUE_SYMTAB_BLOCK_ID)
+      return Error("Invalid value symbol table offset");
+  }
+
   if (Stream.EnterSubBlock(bitc::VALUE_SYMTAB_BLOCK_ID))
     return Error("Invalid record");
 
@@ -1109,6 +1127,24 @@ std::error_code BitcodeReader::ParseValueSymbolTable() {
 
   Triple TT(TheModule->getTargetTriple());
 
+  // Name the value at ValueID, and return it.
+  auto SetValueName = [&](unsigned ValueID, StringRef Name) -> Value * {
+    if (ValueID >= ValueList.size() || !ValueList[ValueID])
+      return nullptr;
+    Value *V = ValueList[ValueID];
+
+    V->setName(Name);
+    if (auto *GO = dyn_cast<GlobalObject>(V)) {
+      if (GO->getComdat() == reinterpret_cast<Comdat *>(1)) {
+        if (TT.isOSBinFormatMachO())
+          GO->setComdat(nullptr);
+        else
+          GO->setComdat(TheModule->getOrInsertComdat(V->getName()));
+      }
+    }
+    return V;
+  };
+
   // Read all the records for this value table.
   SmallString<128> ValueName;
   while (1) {
@@ -1119,6 +1155,8 @@ std::error_code BitcodeReader::ParseValueSymbolTable() {
     case BitstreamEntry::Error:
       return Error("Malformed block");
     case BitstreamEntry::EndBlock:
+      if (Offset > 0)
+        Stream.JumpToBit(CurrentBit);
       return std::error_code();
     case BitstreamEntry::Record:
       // The interesting case.
@@ -1133,20 +1171,19 @@ std::error_code BitcodeReader::ParseValueSymbolTable() {
     case bitc::VST_CODE_ENTRY: {  // VST_ENTRY: [valueid, namechar x N]
       if (ConvertToString(Record, 1, ValueName))
         return Error("Invalid record");
-      unsigned ValueID = Record[0];
-      if (ValueID >= ValueList.size() || !ValueList[ValueID])
+      if (!SetValueName(Record[0], ValueName))
         return Error("Invalid record");
-      Value *V = ValueList[ValueID];
-
-      V->setName(StringRef(ValueName.data(), ValueName.size()));
-      if (auto *GO = dyn_cast<GlobalObject>(V)) {
-        if (GO->getComdat() == reinterpret_cast<Comdat *>(1)) {
-          if (TT.isOSBinFormatMachO())
-            GO->setComdat(nullptr);
-          else
-            GO->setComdat(TheModule->getOrInsertComdat(V->getName()));
-        }
-      }
+      ValueName.clear();
+      break;
+    }
+    case bitc::VST_CODE_FNENTRY: {
+      // VST_FNENTRY: [valueid, offset, namechar x N]
+      if (ConvertToString(Record, 2, ValueName))
+        return Error("Invalid record");
+      auto *F = dyn_cast_or_null<Function>(SetValueName(Record[0], ValueName));
+      if (!F || !FuncBitcodeOffsetDelta)
+        return Error("Invalid record");
+      DeferredFunctionInfo[F] = Record[1] + FuncBitcodeOffsetDelta;
       ValueName.clear();
       break;
     }
@@ -1947,6 +1984,8 @@ std::error_code BitcodeReader::RememberAndSkipFunctionBody() {
 
   // Save the current stream state.
   uint64_t CurBit = Stream.GetCurrentBitNo();
+  assert((DeferredFunctionInfo[Fn] == 0 || DeferredFunctionInfo[Fn] == CurBit) &&
+         "Mismatch between the function offsets of the VST and of the stream");
   DeferredFunctionInfo[Fn] = CurBit;
 
   // Skip over the function block for now.
@@ -2027,6 +2066,13 @@ std::error_code BitcodeReader::ParseModule(bool Resume) {
           return EC;
         break;
       case bitc::VALUE_SYMTAB_BLOCK_ID:
+        // The table was already parsed out of order if it follows the
+        // function blocks.
+        if (VSTOffset > 0 && SeenValueSymbolTable) {
+          if (Stream.SkipBlock())
+            return Error("Invalid record");
+          break;
+        }
         if (std::error_code EC = ParseValueSymbolTable())
           return EC;
         SeenValueSymbolTable = true;
@@ -2045,6 +2091,18 @@ std::error_code BitcodeReader::ParseModule(bool Resume) {
         // If this is the first function body we've seen, reverse the
         // FunctionsWithBodies list.
         if (!SeenFirstFunctionBody) {
+          // If the value symbol table follows the function blocks, parse it
+          // now: the names are needed by GlobalCleanup, and it records where
+          // every function body starts.
+          if (VSTOffset > 0 && !SeenValueSymbolTable) {
+            if (std::error_code EC = ParseValueSymbolTable(VSTOffset))
+              return EC;
+            SeenValueSymbolTable = true;
+            // Anonymous functions have no entry, they will be found by
+            // resuming the scan.
+            for (Function *F : FunctionsWithBodies)
+              DeferredFunctionInfo.insert(std::make_pair(F, 0));
+          }
           std::reverse(FunctionsWithBodies.begin(), FunctionsWithBodies.end());
           if (std::error_code EC = GlobalCleanup())
             return EC;
@@ -2059,7 +2117,11 @@ std::error_code BitcodeReader::ParseModule(bool Resume) {
         // the bitcode. If the bitcode file is old, the symbol table will be
         // at the end instead and will not have been seen yet. In this case,
         // just finish the parse now.
-        if (LazyStreamer && SeenValueSymbolTable) {
+        // If the symbol table recorded the function offsets, there is no
+        // need to scan the other function blocks either: materialize jumps
+        // straight to them, and only anonymous functions, which have no
+        // entry in the table, resume the scan.
+        if ((LazyStreamer || VSTOffset > 0) && SeenValueSymbolTable) {
           NextUnreadBit = Stream.GetCurrentBitNo();
           return std::error_code();
         }
@@ -2097,6 +2159,12 @@ std::error_code BitcodeReader::ParseModule(bool Resume) {
       }
       break;
     }
+    case bitc::MODULE_CODE_VSTOFFSET: { // VSTOFFSET: [offset]
+      if (Record.size() < 1)
+        return Error("Invalid record");
+      VSTOffset = Record[0];
+      break;
+    }
     case bitc::MODULE_CODE_TRIPLE: {  // TRIPLE: [strchr x N]
       std::string S;
       if (ConvertToString(Record, 0, S))
@@ -2389,7 +2457,7 @@ std::error_code BitcodeReader::ParseBitcodeInto(Module *M) {
         TheModule = M;
         if (std::error_code EC = ParseModule(false))
           return EC;
-        if (LazyStreamer)
+        if (LazyStreamer || NextUnreadBit)
           return std::error_code();
         break;
       default:
@@ -3517,7 +3585,7 @@ std::error_code BitcodeReader::materialize(GlobalValue *GV) {
   assert(DFII != DeferredFunctionInfo.end() && "Deferred function not found!");
   // If its position is recorded as 0, its body is somewhere in the stream
   // but we haven't seen it yet.
-  if (DFII->second == 0 && LazyStreamer)
+  if (DFII->second == 0)
     if (std::error_code EC = FindFunctionInStream(F, DFII))
       return EC;
 
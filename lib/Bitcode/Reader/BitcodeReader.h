@@ -140,6 +140,10 @@ class BitcodeReader : public GVMaterializer {
   DataStreamer *LazyStreamer;
   uint64_t NextUnreadBit;
   bool SeenValueSymbolTable;
+  /// VSTOffset - The 32-bit word offset of the module-level value symbol
+  /// table, when it follows the function blocks and records their offsets.
+  /// Zero for older bitcode, whose function blocks have to be scanned.
+  uint64_t VSTOffset;
 
   std::vector<Type*> TypeList;
   BitcodeReaderValueList ValueList;
@@ -340,7 +344,7 @@ private:
   std::error_code ParseTypeTable();
   std::error_code ParseTypeTableBody();
 
-  std::error_code ParseValueSymbolTable();
+  std::error_code ParseValueSymbolTable(uint64_t Offset = 0);
   std::error_code ParseConstants();
   std::error_code RememberAndSkipFunctionBody();
   std::error_code ParseFunctionBody(Function *F);
@@ -13,6 +13,7 @@
 
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "ValueEnumerator.h"
+#include "llvm/ADT/DenseMap.h"
 #include "llvm/ADT/Triple.h"
 #include "llvm/Bitcode/BitstreamWriter.h"
 #include "llvm/Bitcode/LLVMBitCodes.h"
@@ -28,11 +29,19 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/Program.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
 #include <cctype>
 #include <map>
 using namespace llvm;
 
+static cl::opt<unsigned> BitcodeWriteThreads(
+    "bitcode-write-threads", cl::init(1), cl::Hidden,
+    cl::desc("Number of threads encoding function blocks when writing "
+             "bitcode (0 = number of cores)"));
+
 /// These are manifest constants used by the bitcode writer. They do not need to
 /// be kept in sync with the reader, but need to be consistent within this file.
 enum {
@@ -1014,10 +1023,9 @@ static void WriteConstants(unsigned FirstVal, unsigned LastVal,
 
   SmallVector<uint64_t, 64> Record;
 
-  const ValueEnumerator::ValueList &Vals = VE.getValues();
   Type *LastTy = nullptr;
   for (unsigned i = FirstVal; i != LastVal; ++i) {
-    const Value *V = Vals[i].first;
+    const Value *V = VE.getValue(i);
     // If we need to switch types, do so now.
     if (V->getType() != LastTy) {
       LastTy = V->getType();
@@ -1610,16 +1618,43 @@ static void WriteInstruction(const Instruction &I, unsigned InstID,
   Vals.clear();
 }
 
-// Emit names for globals/functions etc.
-static void WriteValueSymbolTable(const ValueSymbolTable &VST,
-                                  const ValueEnumerator &VE,
-                                  BitstreamWriter &Stream) {
+/// \brief The bit offset of each function block, relative to the start of the
+/// bitcode, as recorded in the module-level value symbol table.
+typedef DenseMap<const Function *, uint64_t> FunctionBitcodeIndex;
+
+/// \brief Emit the value symbol table \p VST. If \p FunctionIndex is not null,
+/// the functions it contains get a VST_FNENTRY record holding the offset of
+/// their body.
+static void WriteValueSymbolTable(
+    const ValueSymbolTable &VST, const ValueEnumerator &VE,
+    BitstreamWriter &Stream,
+    const FunctionBitcodeIndex *FunctionIndex = nullptr) {
   if (VST.empty()) return;
   Stream.EnterSubblock(bitc::VALUE_SYMTAB_BLOCK_ID, 4);
 
+  unsigned FnEntry8BitAbbrev = 0, FnEntry7BitAbbrev = 0, FnEntry6BitAbbrev = 0;
+  if (FunctionIndex) {
+    // VST_FNENTRY: [valueid, offset, namechar x N], for each name encoding.
+    auto EmitFnEntryAbbrev = [&](BitCodeAbbrevOp CharOp) {
+      BitCodeAbbrev *Abbv = new BitCodeAbbrev();
+      Abbv->Add(BitCodeAbbrevOp(bitc::VST_CODE_FNENTRY));
+      Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::VBR, 8));
+      Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::VBR, 8));
+      Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::Array));
+      Abbv->Add(CharOp);
+      return Stream.EmitAbbrev(Abbv);
+    };
+    FnEntry8BitAbbrev =
+        EmitFnEntryAbbrev(BitCodeAbbrevOp(BitCodeAbbrevOp::Fixed, 8));
+    FnEntry7BitAbbrev =
+        EmitFnEntryAbbrev(BitCodeAbbrevOp(BitCodeAbbrevOp::Fixed, 7));
+    FnEntry6BitAbbrev =
+        EmitFnEntryAbbrev(BitCodeAbbrevOp(BitCodeAbbrevOp::Char6));
+  }
+
   // FIXME: Set up the abbrev, we know how many values there are!
   // FIXME: We know if the type names can use 7-bit ascii.
-  SmallVector<unsigned, 64> NameVals;
+  SmallVector<uint64_t, 64> NameVals;
 
   for (ValueSymbolTable::const_iterator SI = VST.begin(), SE = VST.end();
        SI != SE; ++SI) {
@@ -1640,14 +1675,27 @@ static void WriteValueSymbolTable(const ValueSymbolTable &VST,
     }
 
     unsigned AbbrevToUse = VST_ENTRY_8_ABBREV;
+    NameVals.push_back(VE.getValueID(SI->getValue()));
 
     // VST_ENTRY:   [valueid, namechar x N]
     // VST_BBENTRY: [bbid, namechar x N]
+    // VST_FNENTRY: [valueid, offset, namechar x N]
     unsigned Code;
+    const Function *F = dyn_cast<Function>(SI->getValue());
+    FunctionBitcodeIndex::const_iterator Offset;
     if (isa<BasicBlock>(SI->getValue())) {
       Code = bitc::VST_CODE_BBENTRY;
       if (isChar6)
         AbbrevToUse = VST_BBENTRY_6_ABBREV;
+    } else if (F && FunctionIndex &&
+               (Offset = FunctionIndex->find(F)) != FunctionIndex->end()) {
+      Code = bitc::VST_CODE_FNENTRY;
+      NameVals.push_back(Offset->second);
+      AbbrevToUse = FnEntry8BitAbbrev;
+      if (isChar6)
+        AbbrevToUse = FnEntry6BitAbbrev;
+      else if (is7Bit)
+        AbbrevToUse = FnEntry7BitAbbrev;
     } else {
       Code = bitc::VST_CODE_ENTRY;
       if (isChar6)
@@ -1656,7 +1704,6 @@ static void WriteValueSymbolTable(const ValueSymbolTable &VST,
         AbbrevToUse = VST_ENTRY_7_ABBREV;
     }
 
-    NameVals.push_back(VE.getValueID(SI->getValue()));
     for (const char *P = Name.getKeyData(),
          *E = Name.getKeyData()+Name.getKeyLength(); P != E; ++P)
       NameVals.push_back((unsigned char)*P);
@@ -1668,6 +1715,27 @@ static void WriteValueSymbolTable(const ValueSymbolTable &VST,
   Stream.ExitBlock();
 }
 
+/// \brief Emit a placeholder for the offset of the module-level value symbol
+/// table, which is written after the function blocks so that it can record
+/// where each of them starts.
+///
+/// \returns the bit position of the placeholder, to be backpatched.
+static uint64_t WriteValueSymbolTableForwardDecl(BitstreamWriter &Stream) {
+  // The table starts right after the last function block, so it is 32-bit
+  // aligned and its offset fits a fixed 32-bit word offset, which is what
+  // makes it possible to backpatch it.
+  BitCodeAbbrev *Abbv = new BitCodeAbbrev();
+  Abbv->Add(BitCodeAbbrevOp(bitc::MODULE_CODE_VSTOFFSET));
+  Abbv->Add(BitCodeAbbrevOp(BitCodeAbbrevOp::Fixed, 32));
+  unsigned VSTOffsetAbbrev = Stream.EmitAbbrev(Abbv);
+
+  SmallVector<unsigned, 1> Vals;
+  Vals.push_back(0);
+  Stream.EmitRecord(bitc::MODULE_CODE_VSTOFFSET, Vals, VSTOffsetAbbrev);
+  // The field is the last thing emitted.
+  return Stream.GetCurrentBitNo() - 32;
+}
+
 static void WriteUseList(ValueEnumerator &VE, UseListOrder &&Order,
                          BitstreamWriter &Stream) {
   assert(Order.Shuffle.size() >= 2 && "Shuffle too small");
@@ -1728,7 +1796,9 @@ static void WriteFunction(const Function &F, ValueEnumerator &VE,
 
   bool NeedsMetadataAttachment = false;
 
-  DebugLoc LastDL;
+  // Refer to the debug locations rather than copying them, which would track
+  // them, so that the functions of a module can be written concurrently.
+  const DebugLoc *LastDL = nullptr;
 
   // Finally, emit all the instructions, in order.
   for (Function::const_iterator BB = F.begin(), E = F.end(); BB != E; ++BB)
@@ -1743,10 +1813,10 @@ static void WriteFunction(const Function &F, ValueEnumerator &VE,
       NeedsMetadataAttachment |= I->hasMetadataOtherThanDebugLoc();
 
       // If the instruction has a debug location, emit it.
-      DebugLoc DL = I->getDebugLoc();
+      const DebugLoc &DL = I->getDebugLoc();
       if (DL.isUnknown()) {
         // nothing todo.
-      } else if (DL == LastDL) {
+      } else if (LastDL && DL == *LastDL) {
         // Just repeat the same debug loc as last time.
         Stream.EmitRecord(bitc::FUNC_CODE_DEBUG_LOC_AGAIN, Vals);
       } else {
@@ -1761,7 +1831,7 @@ static void WriteFunction(const Function &F, ValueEnumerator &VE,
         Stream.EmitRecord(bitc::FUNC_CODE_DEBUG_LOC, Vals);
         Vals.clear();
 
-        LastDL = DL;
+        LastDL = &DL;
       }
     }
 
@@ -1776,6 +1846,59 @@ static void WriteFunction(const Function &F, ValueEnumerator &VE,
   Stream.ExitBlock();
 }
 
+/// WriteFunctionsConcurrently - Emit the function bodies of the module, which
+/// are encoded on \p NumThreads threads and then spliced into the module
+/// stream in order. The output is the same as when writing them one by one.
+static void WriteFunctionsConcurrently(const Module *M, ValueEnumerator &VE,
+                                       BitstreamWriter &Stream,
+                                       uint64_t BitcodeStartBit,
+                                       FunctionBitcodeIndex &FunctionIndex,
+                                       unsigned NumThreads) {
+  std::vector<const Function *> Functions;
+  for (const Function &F : *M)
+    if (!F.isDeclaration())
+      Functions.push_back(&F);
+
+  // The use-list orders of all the functions are on one stack, in the order
+  // the functions are written. Give each function its own stack.
+  std::vector<UseListOrderStack> UseListOrders(Functions.size());
+  for (unsigned I = 0, E = Functions.size(); I != E; ++I) {
+    UseListOrderStack &Orders = UseListOrders[I];
+    while (!VE.UseListOrders.empty() &&
+           VE.UseListOrders.back().F == Functions[I]) {
+      Orders.push_back(std::move(VE.UseListOrders.back()));
+      VE.UseListOrders.pop_back();
+    }
+    std::reverse(Orders.begin(), Orders.end());
+  }
+
+  // Each thread writes the blocks of the functions it picks with its own
+  // function-local enumerator. The module enumerator is only read meanwhile.
+  std::vector<SmallVector<char, 0>> Blocks(Functions.size());
+  {
+    ThreadPool Pool(NumThreads);
+    TaskGroup Group(Pool);
+    std::atomic<unsigned> NextFunction(0);
+    unsigned NumWorkers = std::min<size_t>(Pool.getThreadCount(),
+                                           Functions.size());
+    for (unsigned T = 0; T != NumWorkers; ++T)
+      Group.spawn([&] {
+        ValueEnumerator FunctionVE(&VE);
+        for (unsigned I; (I = NextFunction++) < Functions.size();) {
+          BitstreamWriter Writer(Blocks[I], Stream);
+          FunctionVE.UseListOrders = std::move(UseListOrders[I]);
+          WriteFunction(*Functions[I], FunctionVE, Writer);
+        }
+      });
+  }
+
+  for (unsigned I = 0, E = Functions.size(); I != E; ++I) {
+    FunctionIndex[Functions[I]] = Stream.GetCurrentBitNo() - BitcodeStartBit;
+    Stream.EmitBlockFrom(Blocks[I]);
+    SmallVector<char, 0>().swap(Blocks[I]);
+  }
+}
+
 // Emit blockinfo, which defines the standard abbreviations etc.
 static void WriteBlockInfo(const ValueEnumerator &VE, BitstreamWriter &Stream) {
   // We only want to emit block info records for blocks that have multiple
@@ -1937,8 +2060,11 @@ static void WriteBlockInfo(const ValueEnumerator &VE, BitstreamWriter &Stream) {
   Stream.ExitBlock();
 }
 
-/// WriteModule - Emit the specified module to the bitstream.
-static void WriteModule(const Module *M, BitstreamWriter &Stream) {
+/// \brief Emit \p M to \p Stream. \p BitcodeStartBit is the position of the
+/// bitcode magic number, which the offsets stored in the module are relative
+/// to.
+static void WriteModule(const Module *M, BitstreamWriter &Stream,
+                        uint64_t BitcodeStartBit) {
   Stream.EnterSubblock(bitc::MODULE_BLOCK_ID, 3);
 
   SmallVector<unsigned, 1> Vals;
@@ -1967,6 +2093,16 @@ static void WriteModule(const Module *M, BitstreamWriter &Stream) {
   // descriptors for global variables, and function prototype info.
   WriteModuleInfo(M, VE, Stream);
 
+  // If there are function bodies, the value symbol table is emitted after
+  // them, with their offsets, so that a lazy reader can jump straight to the
+  // body of any function.
+  bool HasFunctionBodies = false;
+  for (const Function &F : *M)
+    HasFunctionBodies |= !F.isDeclaration();
+  uint64_t VSTOffsetPlaceholder = 0;
+  if (HasFunctionBodies && !M->getValueSymbolTable().empty())
+    VSTOffsetPlaceholder = WriteValueSymbolTableForwardDecl(Stream);
+
   // Emit constants.
   WriteModuleConstants(VE, Stream);
 
@@ -1977,16 +2113,38 @@ static void WriteModule(const Module *M, BitstreamWriter &Stream) {
   WriteModuleMetadataStore(M, Stream);
 
   // Emit names for globals/functions etc.
-  WriteValueSymbolTable(M->getValueSymbolTable(), VE, Stream);
+  if (!VSTOffsetPlaceholder)
+    WriteValueSymbolTable(M->getValueSymbolTable(), VE, Stream);
 
   // Emit module-level use-lists.
   if (shouldPreserveBitcodeUseListOrder())
     WriteUseListBlock(nullptr, VE, Stream);
 
   // Emit function bodies.
-  for (Module::const_iterator F = M->begin(), E = M->end(); F != E; ++F)
-    if (!F->isDeclaration())
-      WriteFunction(*F, VE, Stream);
+  FunctionBitcodeIndex FunctionIndex;
+  if (BitcodeWriteThreads != 1) {
+    WriteFunctionsConcurrently(M, VE, Stream, BitcodeStartBit, FunctionIndex,
+                               BitcodeWriteThreads
+                                   ? BitcodeWriteThreads
+                                   : heavyweight_hardware_concurrency());
+  } else {
+    for (Module::const_iterator F = M->begin(), E = M->end(); F != E; ++F)
+      if (!F->isDeclaration()) {
+        FunctionIndex[F] = Stream.GetCurrentBitNo() - BitcodeStartBit;
+        WriteFunction(*F, VE, Stream);
+      }
+  }
+
+  // Emit names for globals/functions etc., now that the function offsets are
+  // known.
+  if (VSTOffsetPlaceholder) {
+    uint64_t VSTOffset = Stream.GetCurrentBitNo() - BitcodeStartBit;
+    assert((VSTOffset & 31) == 0 && "VST block not 32-bit aligned");
+    assert(VSTOffset / 32 <= UINT32_MAX && "VST offset too large");
+    Stream.BackpatchWordAtBit(VSTOffsetPlaceholder, VSTOffset / 32);
+    WriteValueSymbolTable(M->getValueSymbolTable(), VE, Stream,
+                          &FunctionIndex);
+  }
 
   Stream.ExitBlock();
 }
@@ -2079,6 +2237,7 @@ void llvm::WriteBitcodeToFile(const Module *M, raw_ostream &Out) {
   // Emit the module into the buffer.
   {
     BitstreamWriter Stream(Buffer);
+    uint64_t BitcodeStartBit = Stream.GetCurrentBitNo();
 
     // Emit the file header.
     Stream.Emit((unsigned)'B', 8);
@@ -2089,7 +2248,7 @@ void llvm::WriteBitcodeToFile(const Module *M, raw_ostream &Out) {
     Stream.Emit(0xD, 4);
 
     // Emit the module.
-    WriteModule(M, Stream);
+    WriteModule(M, Stream, BitcodeStartBit);
   }
 
   if (TT.isOSDarwin())
@@ -283,7 +283,8 @@ static bool isIntOrIntVectorValue(const std::pair<const Value*, unsigned> &V) {
 }
 
 ValueEnumerator::ValueEnumerator(const Module &M)
-    : HasMDString(false), HasMDLocation(false) {
+    : HasMDString(false), HasMDLocation(false), ModuleVE(nullptr),
+      ValueIDBase(0), MDIDBase(0) {
   if (shouldPreserveBitcodeUseListOrder())
     UseListOrders = predictUseListOrder(M);
 
@@ -385,6 +386,14 @@ ValueEnumerator::ValueEnumerator(const Module &M)
   OptimizeConstants(FirstConstant, Values.size());
 }
 
+ValueEnumerator::ValueEnumerator(const ValueEnumerator *ModuleVE)
+    : HasMDString(false), HasMDLocation(false), ModuleVE(ModuleVE),
+      ValueIDBase(ModuleVE->Values.size()), MDIDBase(ModuleVE->MDs.size()) {
+  assert(!ModuleVE->ModuleVE && "Not a module enumerator");
+  assert(ModuleVE->BasicBlocks.empty() &&
+         "Module enumerator has a function incorporated");
+}
+
 unsigned ValueEnumerator::getInstructionID(const Instruction *Inst) const {
   InstructionMapType::const_iterator I = InstructionMap.find(Inst);
   assert(I != InstructionMap.end() && "Instruction is not mapped!");
@@ -406,6 +415,8 @@ unsigned ValueEnumerator::getValueID(const Value *V) const {
     return getMetadataID(MD->getMetadata());
 
   ValueMapType::const_iterator I = ValueMap.find(V);
+  if (ModuleVE && I == ValueMap.end())
+    return ModuleVE->getValueID(V);
   assert(I != ValueMap.end() && "Value not in slotcalculator!");
   return I->second-1;
 }
@@ -467,7 +478,8 @@ void ValueEnumerator::OptimizeConstants(unsigned CstStart, unsigned CstEnd) {
     // Disable it for now when trying to preserve the order.
     return;
 
-  std::stable_sort(Values.begin() + CstStart, Values.begin() + CstEnd,
+  std::stable_sort(Values.begin() + (CstStart - ValueIDBase),
+                   Values.begin() + (CstEnd - ValueIDBase),
                    [this](const std::pair<const Value *, unsigned> &LHS,
                           const std::pair<const Value *, unsigned> &RHS) {
     // Sort by plane.
@@ -480,12 +492,13 @@ void ValueEnumerator::OptimizeConstants(unsigned CstStart, unsigned CstEnd) {
   // Ensure that integer and vector of integer constants are at the start of the
   // constant pool.  This is important so that GEP structure indices come before
   // gep constant exprs.
-  std::partition(Values.begin()+CstStart, Values.begin()+CstEnd,
+  std::partition(Values.begin() + (CstStart - ValueIDBase),
+                 Values.begin() + (CstEnd - ValueIDBase),
                  isIntOrIntVectorValue);
 
   // Rebuild the modified portion of ValueMap.
   for (; CstStart != CstEnd; ++CstStart)
-    ValueMap[Values[CstStart].first] = CstStart+1;
+    ValueMap[Values[CstStart - ValueIDBase].first] = CstStart+1;
 }
 
 
@@ -560,7 +573,7 @@ void ValueEnumerator::EnumerateFunctionLocalMetadata(
     return;
 
   MDs.push_back(Local);
-  MDValueID = MDs.size();
+  MDValueID = MDIDBase + MDs.size();
 
   EnumerateValue(Local->getValue());
 
@@ -572,11 +585,16 @@ void ValueEnumerator::EnumerateValue(const Value *V) {
   assert(!V->getType()->isVoidTy() && "Can't insert void values!");
   assert(!isa<MetadataAsValue>(V) && "EnumerateValue doesn't handle Metadata!");
 
+  // Module-level values are already in the module enumerator. Their use
+  // counts only matter to order the module constants, which is done by now.
+  if (ModuleVE && ModuleVE->ValueMap.count(V))
+    return;
+
   // Check to see if it's already in!
   unsigned &ValueID = ValueMap[V];
   if (ValueID) {
     // Increment use count.
-    Values[ValueID-1].second++;
+    Values[ValueID - 1 - ValueIDBase].second++;
     return;
   }
 
@@ -607,18 +625,24 @@ void ValueEnumerator::EnumerateValue(const Value *V) {
       // Finally, add the value.  Doing this could make the ValueID reference be
       // dangling, don't reuse it.
       Values.push_back(std::make_pair(V, 1U));
-      ValueMap[V] = Values.size();
+      ValueMap[V] = ValueIDBase + Values.size();
       return;
     }
   }
 
   // Add the value.
   Values.push_back(std::make_pair(V, 1U));
-  ValueID = Values.size();
+  ValueID = ValueIDBase + Values.size();
 }
 
 
 void ValueEnumerator::EnumerateType(Type *Ty) {
+  // All the types of a module are enumerated with the module.
+  if (ModuleVE) {
+    assert(ModuleVE->TypeMap.count(Ty) && "Type not in module enumerator!");
+    return;
+  }
+
   unsigned *TypeID = &TypeMap[Ty];
 
   // We've already seen this type.
@@ -693,6 +717,13 @@ void ValueEnumerator::EnumerateOperandType(const Value *V) {
 void ValueEnumerator::EnumerateAttributes(AttributeSet PAL) {
   if (PAL.isEmpty()) return;  // null is always 0.
 
+  // All the attributes of a module are enumerated with the module.
+  if (ModuleVE) {
+    assert(ModuleVE->AttributeMap.count(PAL) &&
+           "Attribute not in module enumerator!");
+    return;
+  }
+
   // Do a lookup.
   unsigned &Entry = AttributeMap[PAL];
   if (Entry == 0) {
@@ -714,15 +745,15 @@ void ValueEnumerator::EnumerateAttributes(AttributeSet PAL) {
 
 void ValueEnumerator::incorporateFunction(const Function &F) {
   InstructionCount = 0;
-  NumModuleValues = Values.size();
-  NumModuleMDs = MDs.size();
+  NumModuleValues = ValueIDBase + Values.size();
+  NumModuleMDs = MDIDBase + MDs.size();
 
   // Adding function arguments to the value table.
   for (Function::const_arg_iterator I = F.arg_begin(), E = F.arg_end();
        I != E; ++I)
     EnumerateValue(I);
 
-  FirstFuncConstantID = Values.size();
+  FirstFuncConstantID = ValueIDBase + Values.size();
 
   // Add all function-level constants to the value table.
   for (Function::const_iterator BB = F.begin(), E = F.end(); BB != E; ++BB) {
@@ -738,13 +769,13 @@ void ValueEnumerator::incorporateFunction(const Function &F) {
   }
 
   // Optimize the constant layout.
-  OptimizeConstants(FirstFuncConstantID, Values.size());
+  OptimizeConstants(FirstFuncConstantID, ValueIDBase + Values.size());
 
   // Add the function's parameter attributes so they are available for use in
   // the function's instruction.
   EnumerateAttributes(F.getAttributes());
 
-  FirstInstID = Values.size();
+  FirstInstID = ValueIDBase + Values.size();
 
   SmallVector<LocalAsMetadata *, 8> FnLocalMDVector;
   // Add all of the instructions.
@@ -770,15 +801,16 @@ void ValueEnumerator::incorporateFunction(const Function &F) {
 
 void ValueEnumerator::purgeFunction() {
   /// Remove purged values from the ValueMap.
-  for (unsigned i = NumModuleValues, e = Values.size(); i != e; ++i)
+  for (unsigned i = NumModuleValues - ValueIDBase, e = Values.size(); i != e;
+       ++i)
     ValueMap.erase(Values[i].first);
-  for (unsigned i = NumModuleMDs, e = MDs.size(); i != e; ++i)
+  for (unsigned i = NumModuleMDs - MDIDBase, e = MDs.size(); i != e; ++i)
     MDValueMap.erase(MDs[i]);
   for (unsigned i = 0, e = BasicBlocks.size(); i != e; ++i)
     ValueMap.erase(BasicBlocks[i]);
 
-  Values.resize(NumModuleValues);
-  MDs.resize(NumModuleMDs);
+  Values.resize(NumModuleValues - ValueIDBase);
+  MDs.resize(NumModuleMDs - MDIDBase);
   BasicBlocks.clear();
   FunctionLocalMDs.clear();
 }
@@ -98,11 +98,28 @@ private:
   unsigned FirstFuncConstantID;
   unsigned FirstInstID;
 
+  /// ModuleVE - For a function-local enumerator, the enumerator of the module,
+  /// which holds the module-level values, types, metadata and attributes.
+  const ValueEnumerator *ModuleVE;
+
+  /// ValueIDBase/MDIDBase - The ID of the first entry of Values/MDs. This is
+  /// the number of module-level values/metadata for a function-local
+  /// enumerator, and zero otherwise.
+  unsigned ValueIDBase;
+  unsigned MDIDBase;
+
   ValueEnumerator(const ValueEnumerator &) LLVM_DELETED_FUNCTION;
   void operator=(const ValueEnumerator &) LLVM_DELETED_FUNCTION;
 public:
   ValueEnumerator(const Module &M);
 
+  /// Create a function-local enumerator, which only holds the values of the
+  /// function being incorporated and looks the others up in \p ModuleVE
+  /// without changing it. Several of them can thus write the functions of a
+  /// module concurrently. They only support the queries made by the writer
+  /// of a function block.
+  explicit ValueEnumerator(const ValueEnumerator *ModuleVE);
+
   void dump() const;
   void print(raw_ostream &OS, const ValueMapType &Map, const char *Name) const;
   void print(raw_ostream &OS, const MetadataMapType &Map,
@@ -115,13 +132,17 @@ public:
     return ID - 1;
   }
   unsigned getMetadataOrNullID(const Metadata *MD) const {
-    return MDValueMap.lookup(MD);
+    if (unsigned ID = MDValueMap.lookup(MD))
+      return ID;
+    return ModuleVE ? ModuleVE->getMetadataOrNullID(MD) : 0;
   }
 
   bool hasMDString() const { return HasMDString; }
   bool hasMDLocation() const { return HasMDLocation; }
 
   unsigned getTypeID(Type *T) const {
+    if (ModuleVE)
+      return ModuleVE->getTypeID(T);
     TypeMapType::const_iterator I = TypeMap.find(T);
     assert(I != TypeMap.end() && "Type not in ValueEnumerator!");
     return I->second-1;
@@ -132,6 +153,8 @@ public:
 
   unsigned getAttributeID(AttributeSet PAL) const {
     if (PAL.isEmpty()) return 0;  // Null maps to zero.
+    if (ModuleVE)
+      return ModuleVE->getAttributeID(PAL);
     AttributeMapType::const_iterator I = AttributeMap.find(PAL);
     assert(I != AttributeMap.end() && "Attribute not in ValueEnumerator!");
     return I->second;
@@ -139,6 +162,8 @@ public:
 
   unsigned getAttributeGroupID(AttributeSet PAL) const {
     if (PAL.isEmpty()) return 0;  // Null maps to zero.
+    if (ModuleVE)
+      return ModuleVE->getAttributeGroupID(PAL);
     AttributeGroupMapType::const_iterator I = AttributeGroupMap.find(PAL);
     assert(I != AttributeGroupMap.end() && "Attribute not in ValueEnumerator!");
     return I->second;
@@ -152,6 +177,12 @@ public:
   }
 
   const ValueList &getValues() const { return Values; }
+  /// getValue - Return the value with the specified ID, which must be local to
+  /// the incorporated function for a function-local enumerator.
+  const Value *getValue(unsigned ID) const {
+    assert(ID >= ValueIDBase && "Value not in this enumerator!");
+    return Values[ID - ValueIDBase].first;
+  }
   const std::vector<const Metadata *> &getMDs() const { return MDs; }
   const SmallVectorImpl<const LocalAsMetadata *> &getFunctionLocalMDs() const {
     return FunctionLocalMDs;
@@ -0,0 +1,118 @@
+//===-- ParallelCG.cpp ----------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines functions that can be used for parallel code generation.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/Triple.h"
+#include "llvm/Analysis/TargetLibraryInfo.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/IR/DataLayout.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/FormattedStream.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetSubtargetInfo.h"
+#include "llvm/Transforms/Utils/SplitModule.h"
+
+using namespace llvm;
+
+static bool codegen(Module *M, raw_ostream &OS, TargetMachine &TM,
+                    TargetMachine::CodeGenFileType FT,
+                    const TargetLibraryInfo *TLI, bool DisableVerify,
+                    std::string &ErrMsg) {
+  legacy::PassManager CodeGenPasses;
+  if (TLI)
+    CodeGenPasses.add(new TargetLibraryInfoWrapperPass(*TLI));
+  else
+    CodeGenPasses.add(
+        new TargetLibraryInfoWrapperPass(Triple(TM.getTargetTriple())));
+  if (const DataLayout *DL = TM.getSubtargetImpl()->getDataLayout())
+    M->setDataLayout(DL);
+  CodeGenPasses.add(new DataLayoutPass());
+
+  formatted_raw_ostream FOS(OS);
+  if (TM.addPassesToEmitFile(CodeGenPasses, FOS, FT, DisableVerify)) {
+    ErrMsg = "target file type not supported";
+    return false;
+  }
+  CodeGenPasses.run(*M);
+  return true;
+}
+
+bool llvm::splitCodeGen(
+    Module &M, ArrayRef<raw_ostream *> OSs,
+    const std::function<std::unique_ptr<TargetMachine>()> &TMFactory,
+    TargetMachine::CodeGenFileType FT, std::string &ErrMsg,
+    const TargetLibraryInfo *TLI, bool DisableVerify) {
+  if (OSs.size() == 1) {
+    std::unique_ptr<TargetMachine> TM = TMFactory();
+    if (!TM) {
+      ErrMsg = "could not create the target machine";
+      return false;
+    }
+    return codegen(&M, *OSs[0], *TM, FT, TLI, DisableVerify, ErrMsg);
+  }
+
+  // The partitions only share the read-only target description; everything
+  // else (context, target machine, pass manager) is private to each task.
+  ThreadPool Pool(OSs.size());
+  TaskGroup Group(Pool);
+  unsigned Partition = 0;
+  // Each task records its error in its own slot; they are reported here, on
+  // the calling thread, in partition order.
+  std::vector<std::string> Errors(OSs.size());
+  SplitModule(M, OSs.size(), [&](std::unique_ptr<Module> MPart) {
+    // We want to clone the module in a new context to multi-thread the
+    // codegen. We do it by serializing partition modules to bitcode (while
+    // still on the main thread, in order to avoid data races) and handing
+    // the buffer to a task which deserializes it into a separate context.
+    auto BC = std::make_shared<SmallString<0>>();
+    raw_svector_ostream BCOS(*BC);
+    WriteBitcodeToFile(MPart.get(), BCOS);
+    BCOS.flush();
+
+    std::shared_ptr<TargetMachine> TM = TMFactory();
+    raw_ostream *ThreadOS = OSs[Partition];
+    std::string *ThreadErr = &Errors[Partition];
+    ++Partition;
+    if (!TM) {
+      *ThreadErr = "could not create the target machine";
+      return;
+    }
+    Group.spawn([=]() {
+      LLVMContext Ctx;
+      ErrorOr<Module *> MOrErr =
+          parseBitcodeFile(MemoryBufferRef(*BC, "<split-module>"), Ctx);
+      if (std::error_code EC = MOrErr.getError()) {
+        *ThreadErr = "failed to read bitcode: " + EC.message();
+        return;
+      }
+      std::unique_ptr<Module> MPartInCtx(MOrErr.get());
+
+      codegen(MPartInCtx.get(), *ThreadOS, *TM, FT, TLI, DisableVerify,
+              *ThreadErr);
+    });
+  });
+  Group.wait();
+
+  for (unsigned I = 0, E = Errors.size(); I != E; ++I) {
+    if (!Errors[I].empty()) {
+      ErrMsg = "partition " + utostr(I) + ": " + Errors[I];
+      return false;
+    }
+  }
+  return true;
+}
@@ -372,9 +372,13 @@ DWARFCompileUnit *DWARFContext::getCompileUnitForOffset(uint32_t Offset) {
   return CUs.getUnitForOffset(Offset);
 }
 
+uint32_t DWARFContext::getCompileUnitOffsetForAddress(uint64_t Address) {
+  return getDebugAranges()->findAddress(Address);
+}
+
 DWARFCompileUnit *DWARFContext::getCompileUnitForAddress(uint64_t Address) {
   // First, get the offset of the compile unit.
-  uint32_t CUOffset = getDebugAranges()->findAddress(Address);
+  uint32_t CUOffset = getCompileUnitOffsetForAddress(Address);
   // Retrieve the compile unit.
   return getCompileUnitForOffset(CUOffset);
 }
@@ -0,0 +1,271 @@
+//===-- FileObjectCache.cpp - On-disk object cache for MCJIT ----*- C++ -*-===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements an ObjectCache keeping the objects in a directory.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/FileObjectCache.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/Config/config.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Target/TargetMachine.h"
+#include <algorithm>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "object-cache"
+
+STATISTIC(NumHits, "Number of objects loaded from the cache");
+STATISTIC(NumMisses, "Number of modules missing from the cache");
+STATISTIC(NumStored, "Number of objects stored in the cache");
+STATISTIC(NumEvicted, "Number of objects evicted from the cache");
+
+/// Bump when the layout of the key changes.
+static const uint32_t KeyVersion = 2;
+
+FileObjectCache::FileObjectCache(StringRef Directory, const TargetMachine &TM,
+                                 uint64_t MaxSize)
+    : Directory(Directory), TM(TM), MaxSize(MaxSize) {}
+
+FileObjectCache::~FileObjectCache() {}
+
+static void hashInteger(MD5 &Hash, uint64_t Value) {
+  uint8_t Bytes[8];
+  support::endian::write<uint64_t, support::little, support::unaligned>(Bytes,
+                                                                        Value);
+  Hash.update(Bytes);
+}
+
+static void hashString(MD5 &Hash, StringRef Str) {
+  hashInteger(Hash, Str.size());
+  Hash.update(Str);
+}
+
+std::string FileObjectCache::getObjectPath(const Module &M) const {
+  MD5 Hash;
+  hashInteger(Hash, KeyVersion);
+
+  // The same IR does not give the same object with another code generator,
+  // even one of the same release when it is built from another revision.
+  hashString(Hash, PACKAGE_VERSION);
+#ifdef LLVM_VERSION_INFO
+  hashString(Hash, LLVM_VERSION_INFO);
+#endif
+
+  SmallVector<char, 4096> Bitcode;
+  raw_svector_ostream BitcodeOS(Bitcode);
+  WriteBitcodeToFile(&M, BitcodeOS);
+  BitcodeOS.flush();
+  hashString(Hash, StringRef(Bitcode.data(), Bitcode.size()));
+
+  hashString(Hash, TM.getTargetTriple());
+  hashString(Hash, TM.getTargetCPU());
+  hashString(Hash, TM.getTargetFeatureString());
+  hashInteger(Hash, TM.getOptLevel());
+  hashInteger(Hash, TM.getRelocationModel());
+  hashInteger(Hash, TM.getCodeModel());
+
+  // The options compared by operator==(TargetOptions, TargetOptions), and the
+  // ones of the integrated assembler.
+  const TargetOptions &Options = TM.Options;
+#define HASH_OPTION(X) hashInteger(Hash, static_cast<uint64_t>(Options.X))
+  HASH_OPTION(UnsafeFPMath);
+  HASH_OPTION(NoInfsFPMath);
+  HASH_OPTION(NoNaNsFPMath);
+  HASH_OPTION(HonorSignDependentRoundingFPMathOption);
+  HASH_OPTION(UseSoftFloat);
+  HASH_OPTION(NoZerosInBSS);
+  HASH_OPTION(JITEmitDebugInfo);
+  HASH_OPTION(JITEmitDebugInfoToDisk);
+  HASH_OPTION(GuaranteedTailCallOpt);
+  HASH_OPTION(DisableTailCalls);
+  HASH_OPTION(StackAlignmentOverride);
+  HASH_OPTION(EnableFastISel);
+  HASH_OPTION(PositionIndependentExecutable);
+  HASH_OPTION(UseInitArray);
+  HASH_OPTION(TrapUnreachable);
+  HASH_OPTION(FloatABIType);
+  HASH_OPTION(AllowFPOpFusion);
+  HASH_OPTION(JTType);
+  HASH_OPTION(FCFI);
+  HASH_OPTION(ThreadModel);
+  HASH_OPTION(CFIType);
+  HASH_OPTION(CFIEnforcing);
+  HASH_OPTION(MCOptions.SanitizeAddress);
+  HASH_OPTION(MCOptions.MCRelaxAll);
+  HASH_OPTION(MCOptions.MCNoExecStack);
+  HASH_OPTION(MCOptions.MCUseDwarfDirectory);
+#undef HASH_OPTION
+  hashString(Hash, Options.TrapFuncName);
+  hashString(Hash, Options.CFIFuncName);
+
+  MD5::MD5Result Result;
+  Hash.final(Result);
+  SmallString<32> Hex;
+  MD5::stringifyResult(Result, Hex);
+  SmallString<128> Path(Directory);
+  sys::path::append(Path, Hex.str() + ".o");
+  return Path.str();
+}
+
+/// Read the object at \p Path, and mark it as the most recently used one.
+static std::unique_ptr<MemoryBuffer> loadObject(StringRef Path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr =
+      MemoryBuffer::getFile(Path, -1, /*RequiresNullTerminator=*/false);
+  if (!BufOrErr)
+    return nullptr;
+  int FD;
+  if (!sys::fs::openFileForRead(Path, FD)) {
+    sys::fs::setLastModificationAndAccessTime(FD, sys::TimeValue::now());
+    sys::Process::SafelyCloseFileDescriptor(FD);
+  }
+  // Like the object compiled by the engine, the object it loads must be
+  // writable, while the file is probably mapped read-only.
+  return MemoryBuffer::getMemBufferCopy(BufOrErr.get()->getBuffer(), Path);
+}
+
+std::unique_ptr<MemoryBuffer> FileObjectCache::getObject(const Module *M) {
+  std::string Path = getObjectPath(*M);
+  if (std::unique_ptr<MemoryBuffer> Obj = loadObject(Path)) {
+    ++NumHits;
+    return Obj;
+  }
+
+  // Nobody else compiled it yet. Compile it, unless another process is doing
+  // so, in which case wait for it.
+  PendingObject Object;
+  Object.Path = Path;
+  if (!sys::fs::create_directories(Directory)) {
+    std::unique_ptr<LockFileManager> FileLock(new LockFileManager(Path));
+    switch (FileLock->getState()) {
+    case LockFileManager::LFS_Owned:
+      Object.Lock = std::move(FileLock);
+      break;
+    case LockFileManager::LFS_Shared:
+      if (FileLock->waitForUnlock() == LockFileManager::Res_Success)
+        if (std::unique_ptr<MemoryBuffer> Obj = loadObject(Path)) {
+          ++NumHits;
+          return Obj;
+        }
+      // The owner failed, compile it without a lock, the rename below keeps
+      // the cache consistent anyway.
+      break;
+    case LockFileManager::LFS_Error:
+      break;
+    }
+  }
+
+  ++NumMisses;
+  DEBUG(dbgs() << "FileObjectCache: compiling " << M->getModuleIdentifier()
+               << " into " << Path << "\n");
+  MutexGuard Locked(Lock);
+  Pending[M] = std::move(Object);
+  return nullptr;
+}
+
+void FileObjectCache::notifyObjectCompiled(const Module *M,
+                                           MemoryBufferRef Obj) {
+  PendingObject Object;
+  {
+    MutexGuard Locked(Lock);
+    auto It = Pending.find(M);
+    if (It == Pending.end())
+      return;
+    Object = std::move(It->second);
+    Pending.erase(It);
+  }
+
+  // Errors are ignored, the cache is only an optimization.
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(Object.Path + "-%%%%%%.tmp", FD, TempPath))
+    return;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << Obj.getBuffer();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath.str());
+      return;
+    }
+  }
+  if (sys::fs::rename(TempPath.str(), Object.Path)) {
+    sys::fs::remove(TempPath.str());
+    return;
+  }
+  ++NumStored;
+  // Let the processes waiting for the object in.
+  Object.Lock.reset();
+
+  if (MaxSize)
+    prune(Object.Path);
+}
+
+namespace {
+struct CachedObject {
+  std::string Path;
+  sys::TimeValue LastUse;
+  uint64_t Size;
+
+  bool operator<(const CachedObject &RHS) const {
+    return LastUse < RHS.LastUse;
+  }
+};
+}
+
+void FileObjectCache::prune(StringRef Keep) {
+  // A single process prunes the cache at a time, the others skip it.
+  SmallString<128> PruneLockPath(Directory);
+  sys::path::append(PruneLockPath, "prune");
+  LockFileManager PruneLock(PruneLockPath);
+  if (PruneLock.getState() != LockFileManager::LFS_Owned)
+    return;
+
+  std::vector<CachedObject> Objects;
+  uint64_t TotalSize = 0;
+  std::error_code EC;
+  for (sys::fs::directory_iterator I(Directory, EC), E; I != E && !EC;
+       I.increment(EC)) {
+    if (sys::path::extension(I->path()) != ".o")
+      continue;
+    sys::fs::file_status Status;
+    if (I->status(Status))
+      continue;
+    CachedObject Object;
+    Object.Path = I->path();
+    Object.LastUse = Status.getLastModificationTime();
+    Object.Size = Status.getSize();
+    TotalSize += Object.Size;
+    Objects.push_back(std::move(Object));
+  }
+  if (TotalSize <= MaxSize)
+    return;
+
+  std::sort(Objects.begin(), Objects.end());
+  for (const CachedObject &Object : Objects) {
+    if (TotalSize <= MaxSize)
+      break;
+    if (Object.Path == Keep || sys::fs::remove(Object.Path))
+      continue;
+    DEBUG(dbgs() << "FileObjectCache: evicting " << Object.Path << "\n");
+    TotalSize -= Object.Size;
+    ++NumEvicted;
+  }
+}
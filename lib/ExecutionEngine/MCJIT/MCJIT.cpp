@@ -8,6 +8,8 @@
 //===----------------------------------------------------------------------===//
 
 #include "MCJIT.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
 #include "llvm/ExecutionEngine/MCJIT.h"
@@ -15,21 +17,33 @@
 #include "llvm/IR/DataLayout.h"
 #include "llvm/IR/DerivedTypes.h"
 #include "llvm/IR/Function.h"
+#include "llvm/IR/IRBuilder.h"
 #include "llvm/IR/Mangler.h"
 #include "llvm/IR/Module.h"
 #include "llvm/MC/MCAsmInfo.h"
 #include "llvm/Object/Archive.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/PassManager.h"
+#include "llvm/Support/Debug.h"
 #include "llvm/Support/DynamicLibrary.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/TargetRegistry.h"
 #include "llvm/Target/TargetLowering.h"
 #include "llvm/Target/TargetSubtargetInfo.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#include <atomic>
 
 using namespace llvm;
 
+#define DEBUG_TYPE "mcjit"
+
+STATISTIC(NumLazyStubs, "Number of lazy compilation stubs");
+STATISTIC(NumLazyFunctions, "Number of functions compiled by their stub");
+STATISTIC(NumTieredUp, "Number of functions recompiled with optimization");
+
 void ObjectCache::anchor() {}
 
 namespace {
@@ -62,7 +76,8 @@ ExecutionEngine *MCJIT::createJIT(std::unique_ptr<Module> M,
 MCJIT::MCJIT(std::unique_ptr<Module> M, std::unique_ptr<TargetMachine> tm,
              std::unique_ptr<RTDyldMemoryManager> MM)
     : ExecutionEngine(std::move(M)), TM(std::move(tm)), Ctx(nullptr),
-      MemMgr(this, std::move(MM)), Dyld(&MemMgr), ObjCache(nullptr) {
+      MemMgr(this, std::move(MM)), Dyld(&MemMgr), ObjCache(nullptr),
+      TierUpThreshold(0) {
   // FIXME: We are managing our modules, so we do not want the base class
   // ExecutionEngine to manage them as well. To avoid double destruction
   // of the first (and only) module added in ExecutionEngine constructor
@@ -82,6 +97,9 @@ MCJIT::MCJIT(std::unique_ptr<Module> M, std::unique_ptr<TargetMachine> tm,
 }
 
 MCJIT::~MCJIT() {
+  // Let the background compilations finish, they need the lock.
+  TierUpPool.reset();
+
   MutexGuard locked(lock);
 
   Dyld.deregisterEHFrames();
@@ -161,7 +179,8 @@ std::unique_ptr<MemoryBuffer> MCJIT::emitObject(Module *M) {
 
   // If we have an object cache, tell it about the new object.
   // Note that we're using the compiled image, not the loaded image (as below).
-  if (ObjCache) {
+  // Lazy stubs hold the address of this engine, they cannot be reused.
+  if (ObjCache && !isCompilingLazily()) {
     // MemoryBuffer is a thin wrapper around the actual memory, so it's OK
     // to create a temporary object here and delete it after the call.
     MemoryBufferRef MB = CompiledObjBuffer->getMemBufferRef();
@@ -185,11 +204,13 @@ void MCJIT::generateCodeForModule(Module *M) {
 
   std::unique_ptr<MemoryBuffer> ObjectToLoad;
   // Try to load the pre-compiled object from cache if possible
-  if (ObjCache)
+  if (ObjCache && !isCompilingLazily())
     ObjectToLoad = ObjCache->getObject(M);
 
   // If the cache did not contain a suitable object, compile the object
   if (!ObjectToLoad) {
+    if (isCompilingLazily() && !LazyBodyModules.count(M))
+      installLazyStubs(*M);
     ObjectToLoad = emitObject(M);
     assert(ObjectToLoad && "Compilation did not produce an object.");
   }
@@ -212,6 +233,390 @@ void MCJIT::generateCodeForModule(Module *M) {
   OwnedModules.markModuleAsLoaded(M);
 }
 
+/// Returns true if \p F can be replaced by a stub compiling it on its first
+/// call.
+static bool canCompileLazily(const Function &F) {
+  if (F.isDeclaration() || F.hasAvailableExternallyLinkage() || F.isVarArg() ||
+      F.hasPrefixData() || F.hasPrologueData() ||
+      F.hasFnAttribute(Attribute::Naked))
+    return false;
+  // The stub forwards its arguments with a plain call.
+  for (const Argument &A : F.args())
+    if (A.hasByValOrInAllocaAttr())
+      return false;
+  // Block addresses must refer to the blocks of the original body.
+  for (const BasicBlock &BB : F)
+    if (BB.hasAddressTaken())
+      return false;
+  return true;
+}
+
+/// The symbol of the body compiled for lazy function \p Index. The index is
+/// unique within the engine, and names starting with "__" are reserved to the
+/// implementation, so the symbol cannot clash with one of the program.
+static std::string getLazyBodyName(unsigned Index) {
+  return ("\01__mcjit_lazy_body" + Twine(Index)).str();
+}
+
+/// Make the stub calling through \p Target forward to the code at \p Addr.
+/// The stub reads \p Target with an acquire load, which this release store
+/// pairs with, so that the code is visible to the thread that runs it.
+static void publishLazyBody(void **Target, uint64_t Addr) {
+  static_assert(sizeof(std::atomic<void *>) == sizeof(void *),
+                "stub targets are plain pointers");
+  reinterpret_cast<std::atomic<void *> *>(Target)->store(
+      reinterpret_cast<void *>(Addr), std::memory_order_release);
+}
+
+namespace {
+/// Declares the globals used by a function extracted from its module in the
+/// module it is extracted to. They are resolved by name when it is loaded.
+class LazyBodyMaterializer : public ValueMaterializer {
+  Module &Dst;
+
+public:
+  explicit LazyBodyMaterializer(Module &Dst) : Dst(Dst) {}
+
+  Value *materializeValueFor(Value *V) override {
+    auto *GV = dyn_cast<GlobalValue>(V);
+    if (!GV)
+      return nullptr;
+    if (auto *F = dyn_cast<Function>(GV)) {
+      Function *Decl = Function::Create(F->getFunctionType(),
+                                        GlobalValue::ExternalLinkage,
+                                        F->getName(), &Dst);
+      Decl->setCallingConv(F->getCallingConv());
+      Decl->setAttributes(F->getAttributes());
+      return Decl;
+    }
+    Type *Ty = GV->getType()->getElementType();
+    if (auto *FTy = dyn_cast<FunctionType>(Ty))
+      return Function::Create(FTy, GlobalValue::ExternalLinkage, GV->getName(),
+                              &Dst);
+    auto *Var = dyn_cast<GlobalVariable>(GV);
+    return new GlobalVariable(Dst, Ty, Var && Var->isConstant(),
+                              GlobalValue::ExternalLinkage, nullptr,
+                              GV->getName(), nullptr,
+                              GV->getThreadLocalMode(),
+                              GV->getType()->getAddressSpace());
+  }
+};
+}
+
+/// Copy \p Src into a new module as \p Name, declaring everything else it
+/// refers to.
+static std::unique_ptr<Module> extractLazyFunction(const Function &Src,
+                                                   StringRef Name) {
+  std::unique_ptr<Module> M(new Module(Src.getName(), Src.getContext()));
+  M->setTargetTriple(Src.getParent()->getTargetTriple());
+
+  Function *F = Function::Create(Src.getFunctionType(),
+                                 GlobalValue::ExternalLinkage, Name, M.get());
+  F->copyAttributesFrom(&Src);
+
+  // Recursive calls do not need to go through the stub.
+  ValueToValueMapTy VMap;
+  VMap[&Src] = F;
+  Function::arg_iterator DestArg = F->arg_begin();
+  for (const Argument &A : Src.args()) {
+    DestArg->setName(A.getName());
+    VMap[&A] = DestArg++;
+  }
+
+  SmallVector<ReturnInst *, 8> Returns;
+  LazyBodyMaterializer Materializer(*M);
+  CloneFunctionInto(F, &Src, VMap, /*ModuleLevelChanges=*/true, Returns, "",
+                    nullptr, nullptr, &Materializer);
+  return M;
+}
+
+void MCJIT::installLazyStubs(Module &M) {
+  SmallVector<Function *, 16> Lazy;
+  for (Function &F : M)
+    if (canCompileLazily(F))
+      Lazy.push_back(&F);
+  if (Lazy.empty())
+    return;
+
+  // The bodies are compiled in modules of their own, which refer to
+  // everything else by name. Make the local symbols of M visible to them,
+  // with names that are unique among the modules of this engine.
+  unsigned SourceID = LazySources.size();
+  auto Promote = [SourceID](GlobalValue &GV) {
+    if (!GV.hasLocalLinkage())
+      return;
+    StringRef Name = GV.hasName() ? GV.getName() : "anon";
+    GV.setName(Name + ".lazy" + Twine(SourceID));
+    GV.setLinkage(GlobalValue::ExternalLinkage);
+    GV.setVisibility(GlobalValue::HiddenVisibility);
+  };
+  for (GlobalVariable &GV : M.globals())
+    Promote(GV);
+  for (Function &F : M)
+    Promote(F);
+  for (GlobalAlias &GA : M.aliases())
+    Promote(GA);
+
+  // Keep the original bodies around until their stub is first called.
+  SmallPtrSet<const GlobalValue *, 16> Bodies(Lazy.begin(), Lazy.end());
+  ValueToValueMapTy VMap;
+  std::unique_ptr<Module> Source(CloneModule(
+      &M, VMap, [&](const GlobalValue *GV) { return Bodies.count(GV) != 0; }));
+
+  LLVMContext &Context = M.getContext();
+  Type *Int8PtrTy = Type::getInt8PtrTy(Context);
+  Type *Int32Ty = Type::getInt32Ty(Context);
+  Type *IntPtrTy = getDataLayout()->getIntPtrType(Context);
+  auto getAddress = [&](void *P, Type *Ty) {
+    return ConstantExpr::getIntToPtr(
+        ConstantInt::get(IntPtrTy, reinterpret_cast<uintptr_t>(P)), Ty);
+  };
+  Type *CompileParams[] = {Int8PtrTy, Int32Ty, Int8PtrTy->getPointerTo()};
+  Constant *CompileCallback = getAddress(
+      reinterpret_cast<void *>(&compileLazyFunctionFromStub),
+      FunctionType::get(Int8PtrTy, CompileParams, false)->getPointerTo());
+  Type *TierUpParams[] = {Int8PtrTy, Int32Ty};
+  Constant *TierUpCallback = getAddress(
+      reinterpret_cast<void *>(&requestTierUpFromStub),
+      FunctionType::get(Type::getVoidTy(Context), TierUpParams, false)
+          ->getPointerTo());
+  Constant *Engine = getAddress(this, Int8PtrTy);
+
+  for (Function *F : Lazy) {
+    unsigned Index = LazyFunctions.size();
+    LazyFunctions.push_back(LazyFunction(cast<Function>(VMap[F])));
+    ++NumLazyStubs;
+
+    // The stub calls the compiled body through this pointer. It is null until
+    // the first call, and written by the engine.
+    PointerType *FTy = F->getType();
+    unsigned TargetAlign = getDataLayout()->getABITypeAlignment(FTy);
+    GlobalVariable *Target = new GlobalVariable(
+        M, FTy, /*isConstant=*/false, GlobalValue::PrivateLinkage,
+        ConstantPointerNull::get(FTy), F->getName() + ".target");
+    Target->setAlignment(TargetAlign);
+
+    GlobalValue::LinkageTypes Linkage = F->getLinkage();
+    F->deleteBody();
+    F->setLinkage(Linkage);
+    F->removeFnAttr(Attribute::ReadNone);
+    F->removeFnAttr(Attribute::ReadOnly);
+
+    IRBuilder<> Builder(BasicBlock::Create(Context, "entry", F));
+    if (TierUpThreshold) {
+      // Count the calls, and ask for an optimized body once it is hot.
+      GlobalVariable *Calls = new GlobalVariable(
+          M, Int32Ty, /*isConstant=*/false, GlobalValue::PrivateLinkage,
+          ConstantInt::get(Int32Ty, 0), F->getName() + ".calls");
+      // The count is shared by all the threads calling the stub, and exactly
+      // one of them sees it go past the threshold.
+      Value *Old = Builder.CreateAtomicRMW(AtomicRMWInst::Add, Calls,
+                                           Builder.getInt32(1), Monotonic);
+      BasicBlock *Hot = BasicBlock::Create(Context, "hot", F);
+      BasicBlock *Lookup = BasicBlock::Create(Context, "lookup", F);
+      Builder.CreateCondBr(
+          Builder.CreateICmpEQ(Old, Builder.getInt32(TierUpThreshold - 1)),
+          Hot, Lookup);
+      Builder.SetInsertPoint(Hot);
+      Builder.CreateCall2(TierUpCallback, Engine, Builder.getInt32(Index));
+      Builder.CreateBr(Lookup);
+      Builder.SetInsertPoint(Lookup);
+    }
+    BasicBlock *Lookup = Builder.GetInsertBlock();
+    BasicBlock *Compile = BasicBlock::Create(Context, "compile", F);
+    BasicBlock *Call = BasicBlock::Create(Context, "call", F);
+    // Pairs with the release store in publishLazyBody.
+    LoadInst *Known = Builder.CreateLoad(Target);
+    Known->setAtomic(Acquire);
+    Known->setAlignment(TargetAlign);
+    Builder.CreateCondBr(Builder.CreateIsNull(Known), Compile, Call);
+
+    Builder.SetInsertPoint(Compile);
+    Value *Compiled = Builder.CreateBitCast(
+        Builder.CreateCall3(
+            CompileCallback, Engine, Builder.getInt32(Index),
+            Builder.CreateBitCast(Target, Int8PtrTy->getPointerTo())),
+        FTy);
+    Builder.CreateBr(Call);
+
+    Builder.SetInsertPoint(Call);
+    PHINode *Callee = Builder.CreatePHI(FTy, 2);
+    Callee->addIncoming(Known, Lookup);
+    Callee->addIncoming(Compiled, Compile);
+    SmallVector<Value *, 8> Args;
+    for (Argument &A : F->args())
+      Args.push_back(&A);
+    CallInst *Forward = Builder.CreateCall(Callee, Args);
+    Forward->setTailCall();
+    Forward->setCallingConv(F->getCallingConv());
+    Forward->setAttributes(F->getAttributes());
+    if (Forward->getType()->isVoidTy())
+      Builder.CreateRetVoid();
+    else
+      Builder.CreateRet(Forward);
+  }
+
+  LazySources.push_back(std::move(Source));
+}
+
+void *MCJIT::compileLazyFunctionFromStub(void *Engine, unsigned Index,
+                                         void **Target) {
+  return reinterpret_cast<void *>(
+      static_cast<MCJIT *>(Engine)->compileLazyFunction(Index, Target));
+}
+
+void MCJIT::requestTierUpFromStub(void *Engine, unsigned Index) {
+  static_cast<MCJIT *>(Engine)->requestTierUp(Index);
+}
+
+uint64_t MCJIT::compileLazyBody(unsigned Index, StringRef Name,
+                                CodeGenOpt::Level OptLevel) {
+  MutexGuard locked(lock);
+
+  std::unique_ptr<Module> M =
+      extractLazyFunction(*LazyFunctions[Index].Body, Name);
+  Module *BodyModule = M.get();
+  LazyBodyModules.insert(BodyModule);
+  OwnedModules.addModule(std::move(M));
+
+  // Code generation picks fast instruction selection for CodeGenOpt::None and
+  // leaves it enabled in the target machine.
+  CodeGenOpt::Level SavedOptLevel = TM->getOptLevel();
+  bool SavedFastISel = TM->Options.EnableFastISel;
+  TM->setOptLevel(OptLevel);
+  generateCodeForModule(BodyModule);
+  TM->setOptLevel(SavedOptLevel);
+  TM->setFastISel(SavedFastISel);
+  finalizeLoadedModules();
+
+  uint64_t Addr = getExistingSymbolAddress(Name);
+  if (!Addr)
+    report_fatal_error("Lazily compiled function '" + Name +
+                       "' has no address");
+  return Addr;
+}
+
+uint64_t MCJIT::compileLazyFunction(unsigned Index, void **Target) {
+  MutexGuard locked(lock);
+
+  LazyFunctions[Index].Target = Target;
+  // Another thread may have compiled it since the stub checked.
+  if (uint64_t Addr = LazyFunctions[Index].Address) {
+    publishLazyBody(Target, Addr);
+    return Addr;
+  }
+  if (!isCompilingLazily())
+    report_fatal_error("Lazy compilation stub called after lazy compilation "
+                       "was disabled");
+
+  DEBUG(dbgs() << "MCJIT: compiling '" << LazyFunctions[Index].Body->getName()
+               << "' on its first call\n");
+  // Tiered compilation starts with code that is quick to generate.
+  uint64_t Addr = compileLazyBody(
+      Index, getLazyBodyName(Index),
+      TierUpThreshold ? CodeGenOpt::None : TM->getOptLevel());
+  ++NumLazyFunctions;
+
+  LazyFunctions[Index].Address = Addr;
+  publishLazyBody(Target, Addr);
+  return Addr;
+}
+
+void MCJIT::requestTierUp(unsigned Index) {
+  MutexGuard locked(lock);
+
+  if (!TierUpThreshold || LazyFunctions[Index].TierUpRequested)
+    return;
+  LazyFunctions[Index].TierUpRequested = true;
+  if (!TierUpPool)
+    TierUpPool.reset(new ThreadPool(1));
+  TierUpPool->async([this, Index] { tierUp(Index); });
+}
+
+void MCJIT::tierUp(unsigned Index) {
+  std::string Name = getLazyBodyName(Index) + ".opt";
+
+  // Extract the body and move it to a context of its own, so that it can be
+  // compiled without the lock while the engine is used by other threads.
+  SmallString<0> Bitcode;
+  {
+    MutexGuard locked(lock);
+    DEBUG(dbgs() << "MCJIT: recompiling '"
+                 << LazyFunctions[Index].Body->getName()
+                 << "' with optimization\n");
+    std::unique_ptr<Module> M =
+        extractLazyFunction(*LazyFunctions[Index].Body, Name);
+    raw_svector_ostream OS(Bitcode);
+    WriteBitcodeToFile(M.get(), OS);
+    OS.flush();
+
+    // The target machine of the engine is reconfigured by lazy compilations,
+    // tier-up uses one of its own, only ever used on TierUpPool.
+    if (!TierUpTM)
+      TierUpTM.reset(TM->getTarget().createTargetMachine(
+          TM->getTargetTriple(), TM->getTargetCPU(),
+          TM->getTargetFeatureString(), TM->Options,
+          TM->getRelocationModel(), TM->getCodeModel(), TM->getOptLevel()));
+  }
+
+  LLVMContext Context;
+  ErrorOr<Module *> MOrErr =
+      parseBitcodeFile(MemoryBufferRef(Bitcode, Name), Context);
+  if (std::error_code EC = MOrErr.getError())
+    report_fatal_error("Cannot read back function '" + Name +
+                       "' for tier-up: " + EC.message());
+  std::unique_ptr<Module> M(MOrErr.get());
+
+  PassManager PM;
+  M->setDataLayout(TierUpTM->getSubtargetImpl()->getDataLayout());
+  PM.add(new DataLayoutPass());
+  SmallVector<char, 4096> ObjBufferSV;
+  raw_svector_ostream ObjStream(ObjBufferSV);
+  MCContext *ObjCtx;
+  if (TierUpTM->addPassesToEmitMC(PM, ObjCtx, ObjStream, !getVerifyModules()))
+    report_fatal_error("Target does not support MC emission!");
+  PM.run(*M);
+  ObjStream.flush();
+  std::unique_ptr<MemoryBuffer> Object(
+      new ObjectMemoryBuffer(std::move(ObjBufferSV)));
+
+  // Only loading and installing the new code needs the lock.
+  MutexGuard locked(lock);
+  ErrorOr<std::unique_ptr<object::ObjectFile>> LoadedObject =
+      object::ObjectFile::createObjectFile(Object->getMemBufferRef());
+  std::unique_ptr<RuntimeDyld::LoadedObjectInfo> L =
+      Dyld.loadObject(*LoadedObject.get());
+  if (Dyld.hasError())
+    report_fatal_error(Dyld.getErrorString());
+  NotifyObjectEmitted(*LoadedObject.get(), *L);
+  Buffers.push_back(std::move(Object));
+  LoadedObjects.push_back(std::move(*LoadedObject));
+  finalizeLoadedModules();
+
+  uint64_t Addr = getExistingSymbolAddress(Name);
+  if (!Addr)
+    report_fatal_error("Lazily compiled function '" + Name +
+                       "' has no address");
+  ++NumTieredUp;
+
+  // The code compiled first is never freed, some thread may still be running
+  // it.
+  LazyFunctions[Index].Address = Addr;
+  if (void **Target = LazyFunctions[Index].Target)
+    publishLazyBody(Target, Addr);
+}
+
+void MCJIT::setTieredCompilation(unsigned Threshold) {
+  {
+    MutexGuard locked(lock);
+    TierUpThreshold = Threshold;
+  }
+  // The pool is only created while tiering is on, and its tasks need the
+  // lock.
+  if (!Threshold)
+    TierUpPool.reset();
+}
+
 void MCJIT::finalizeLoadedModules() {
   MutexGuard locked(lock);
 
@@ -18,6 +18,9 @@
 #include "llvm/ExecutionEngine/ObjectCache.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/ThreadPool.h"
+#include <memory>
+#include <vector>
 
 namespace llvm {
 class MCJIT;
@@ -229,6 +232,47 @@ class MCJIT : public ExecutionEngine {
   // perform lookup of pre-compiled code to avoid re-compilation.
   ObjectCache *ObjCache;
 
+  // Lazy compilation (see ExecutionEngine::DisableLazyCompilation). When it is
+  // enabled, the functions of a module are replaced by stubs as the module is
+  // compiled. The first call to a stub extracts the original function into a
+  // module of its own, compiles it, and makes the stub forward to it.
+  //
+  // With tiered compilation, the stubs also count their calls. The first
+  // compilation is done without optimization, and hot functions are
+  // recompiled with optimization on TierUpPool. The stubs then forward to the
+  // new code.
+  struct LazyFunction {
+    // The original function, in one of LazySources.
+    Function *Body;
+    // The address of the best compiled body so far, once there is one.
+    uint64_t Address;
+    // The pointer the stub forwards through, known once it is first called.
+    void **Target;
+    bool TierUpRequested;
+
+    explicit LazyFunction(Function *Body)
+        : Body(Body), Address(0), Target(nullptr), TierUpRequested(false) {}
+  };
+  std::vector<LazyFunction> LazyFunctions;
+  std::vector<std::unique_ptr<Module>> LazySources;
+  // The modules extracted from LazySources, which are compiled as they are.
+  ModulePtrSet LazyBodyModules;
+  unsigned TierUpThreshold;
+  // The target machine of the optimized compilations, which TierUpPool runs
+  // without holding the lock.
+  std::unique_ptr<TargetMachine> TierUpTM;
+  std::unique_ptr<ThreadPool> TierUpPool;
+
+  void installLazyStubs(Module &M);
+  uint64_t compileLazyBody(unsigned Index, StringRef Name,
+                           CodeGenOpt::Level OptLevel);
+  uint64_t compileLazyFunction(unsigned Index, void **Target);
+  void requestTierUp(unsigned Index);
+  void tierUp(unsigned Index);
+  static void *compileLazyFunctionFromStub(void *Engine, unsigned Index,
+                                           void **Target);
+  static void requestTierUpFromStub(void *Engine, unsigned Index);
+
   Function *FindFunctionNamedInModulePtrSet(const char *FnName,
                                             ModulePtrSet::iterator I,
                                             ModulePtrSet::iterator E);
@@ -260,6 +304,8 @@ public:
     Dyld.setProcessAllSections(ProcessAllSections);
   }
 
+  void setTieredCompilation(unsigned Threshold) override;
+
   void generateCodeForModule(Module *M) override;
 
   /// finalizeObject - ensure the module is fully processed and is usable.
@@ -14,7 +14,11 @@
 
 #include "llvm/Config/config.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/MathExtras.h"
+#include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/Process.h"
+#include <vector>
 
 namespace llvm {
 
@@ -35,6 +39,103 @@ uint8_t *SectionMemoryManager::allocateCodeSection(uintptr_t Size,
   return allocateSection(CodeMem, Size, Alignment);
 }
 
+namespace {
+/// The slabs of the destroyed memory managers, reused by the next ones.
+class SlabCache {
+  struct Slab {
+    sys::MemoryBlock Block;
+    /// The slab size of the memory manager, which may be smaller than the
+    /// block.
+    uintptr_t SlabSize;
+    bool Huge;
+  };
+
+  sys::Mutex Lock;
+  std::vector<Slab> Slabs;
+  uintptr_t CachedSize;
+
+public:
+  /// Past this, released slabs are returned to the system.
+  enum { MaxCachedSize = 64 * 1024 * 1024 };
+
+  SlabCache() : CachedSize(0) {}
+
+  ~SlabCache() {
+    for (Slab &S : Slabs)
+      sys::Memory::releaseMappedMemory(S.Block);
+  }
+
+  /// Take a cached slab allocated for the same \p SlabSize and \p Huge, the
+  /// closest one to \p Near. Returns a null block if there is none.
+  sys::MemoryBlock take(uintptr_t SlabSize, bool Huge,
+                        const sys::MemoryBlock &Near) {
+    MutexGuard Locked(Lock);
+    uintptr_t NearAddr = (uintptr_t)Near.base() + Near.size();
+    auto Best = Slabs.end();
+    uintptr_t BestDistance = 0;
+    for (auto I = Slabs.begin(), E = Slabs.end(); I != E; ++I) {
+      if (I->SlabSize != SlabSize || I->Huge != Huge)
+        continue;
+      uintptr_t Addr = (uintptr_t)I->Block.base();
+      uintptr_t Distance = Addr > NearAddr ? Addr - NearAddr : NearAddr - Addr;
+      if (Best == E || Distance < BestDistance) {
+        Best = I;
+        BestDistance = Distance;
+      }
+    }
+    if (Best == Slabs.end())
+      return sys::MemoryBlock();
+    sys::MemoryBlock Result = Best->Block;
+    CachedSize -= Result.size();
+    Slabs.erase(Best);
+    return Result;
+  }
+
+  /// Keep \p Block, which must be readable and writable, for a later take.
+  void give(sys::MemoryBlock Block, uintptr_t SlabSize, bool Huge) {
+    {
+      MutexGuard Locked(Lock);
+      if (CachedSize + Block.size() <= MaxCachedSize) {
+        Slab S = { Block, SlabSize, Huge };
+        Slabs.push_back(S);
+        CachedSize += Block.size();
+        return;
+      }
+    }
+    sys::Memory::releaseMappedMemory(Block);
+  }
+};
+}
+
+static ManagedStatic<SlabCache> Slabs;
+
+sys::MemoryBlock SectionMemoryManager::allocateSlab(MemoryGroup &MemGroup,
+                                                    uintptr_t Size,
+                                                    std::error_code &EC) {
+  EC = std::error_code();
+  // Note that all sections get allocated as read-write.  The permissions will
+  // be updated later based on memory group.
+  bool Huge = UseHugePages && &MemGroup == &CodeMem;
+  unsigned Flags = sys::Memory::MF_READ | sys::Memory::MF_WRITE;
+  if (Huge)
+    Flags |= sys::Memory::MF_HUGE_HINT;
+
+  if (Size > SlabSize) {
+    sys::MemoryBlock MB =
+        sys::Memory::allocateMappedMemory(Size, &MemGroup.Near, Flags, EC);
+    if (!EC)
+      MemGroup.LargeMem.push_back(MB);
+    return MB;
+  }
+
+  sys::MemoryBlock MB = Slabs->take(SlabSize, Huge, MemGroup.Near);
+  if (!MB.base())
+    MB = sys::Memory::allocateMappedMemory(SlabSize, &MemGroup.Near, Flags, EC);
+  if (!EC)
+    MemGroup.AllocatedMem.push_back(MB);
+  return MB;
+}
+
 uint8_t *SectionMemoryManager::allocateSection(MemoryGroup &MemGroup,
                                                uintptr_t Size,
                                                unsigned Alignment) {
@@ -46,69 +147,75 @@ uint8_t *SectionMemoryManager::allocateSection(MemoryGroup &MemGroup,
   uintptr_t RequiredSize = Alignment * ((Size + Alignment - 1)/Alignment + 1);
   uintptr_t Addr = 0;
 
-  // Look in the list of free memory regions and use a block there if one
-  // is available.
+  // Look in the list of free memory regions for the smallest block the
+  // section fits in, so that the large blocks are kept for large sections.
+  int BestFit = -1;
   for (int i = 0, e = MemGroup.FreeMem.size(); i != e; ++i) {
     sys::MemoryBlock &MB = MemGroup.FreeMem[i];
-    if (MB.size() >= RequiredSize) {
-      Addr = (uintptr_t)MB.base();
-      uintptr_t EndOfBlock = Addr + MB.size();
-      // Align the address.
-      Addr = (Addr + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
-      // Store cutted free memory block.
-      MemGroup.FreeMem[i] = sys::MemoryBlock((void*)(Addr + Size),
-                                             EndOfBlock - Addr - Size);
-      return (uint8_t*)Addr;
-    }
+    if (MB.size() >= RequiredSize &&
+        (BestFit == -1 || MB.size() < MemGroup.FreeMem[BestFit].size()))
+      BestFit = i;
   }
 
-  // No pre-allocated free block was large enough. Allocate a new memory region.
-  // Note that all sections get allocated as read-write.  The permissions will
-  // be updated later based on memory group.
-  //
-  // FIXME: It would be useful to define a default allocation size (or add
-  // it as a constructor parameter) to minimize the number of allocations.
-  //
-  // FIXME: Initialize the Near member for each memory group to avoid
-  // interleaving.
-  std::error_code ec;
-  sys::MemoryBlock MB = sys::Memory::allocateMappedMemory(RequiredSize,
-                                                          &MemGroup.Near,
-                                                          sys::Memory::MF_READ |
-                                                            sys::Memory::MF_WRITE,
-                                                          ec);
-  if (ec) {
-    // FIXME: Add error propagation to the interface.
-    return nullptr;
-  }
+  if (BestFit == -1) {
+    // No free block was large enough. Allocate a new slab, next to the
+    // previous one.
+    std::error_code ec;
+    sys::MemoryBlock MB = allocateSlab(MemGroup, RequiredSize, ec);
+    if (ec) {
+      // FIXME: Add error propagation to the interface.
+      return nullptr;
+    }
+
+    // Save this address as the basis for our next request
+    MemGroup.Near = MB;
 
-  // Save this address as the basis for our next request
-  MemGroup.Near = MB;
+    BestFit = MemGroup.FreeMem.size();
+    MemGroup.FreeMem.push_back(MB);
+  }
 
-  MemGroup.AllocatedMem.push_back(MB);
+  sys::MemoryBlock &MB = MemGroup.FreeMem[BestFit];
   Addr = (uintptr_t)MB.base();
   uintptr_t EndOfBlock = Addr + MB.size();
-
   // Align the address.
   Addr = (Addr + Alignment - 1) & ~(uintptr_t)(Alignment - 1);
-
-  // The allocateMappedMemory may allocate much more memory than we need. In
-  // this case, we store the unused memory as a free memory block.
-  unsigned FreeSize = EndOfBlock-Addr-Size;
+  // Store cutted free memory block.
+  uintptr_t FreeSize = EndOfBlock - Addr - Size;
   if (FreeSize > 16)
-    MemGroup.FreeMem.push_back(sys::MemoryBlock((void*)(Addr + Size), FreeSize));
+    MB = sys::MemoryBlock((void*)(Addr + Size), FreeSize);
+  else
+    MemGroup.FreeMem.erase(MemGroup.FreeMem.begin() + BestFit);
+
+  MemGroup.PendingMem.push_back(sys::MemoryBlock((void*)Addr, Size));
 
   // Return aligned address
   return (uint8_t*)Addr;
 }
 
+/// Drop the parts of the free blocks of \p MemGroup sharing a page with the
+/// sections about to change permissions.
+static void trimFreeMemory(SmallVectorImpl<sys::MemoryBlock> &FreeMem) {
+  uintptr_t PageSize = sys::Process::getPageSize();
+  unsigned NumKept = 0;
+  for (const sys::MemoryBlock &MB : FreeMem) {
+    // Free blocks are the ends of the blocks they were cut from, only their
+    // start can be in the middle of a page.
+    uintptr_t Start = RoundUpToAlignment((uintptr_t)MB.base(), PageSize);
+    uintptr_t End = (uintptr_t)MB.base() + MB.size();
+    if (Start < End)
+      FreeMem[NumKept++] = sys::MemoryBlock((void*)Start, End - Start);
+  }
+  FreeMem.resize(NumKept);
+}
+
 bool SectionMemoryManager::finalizeMemory(std::string *ErrMsg)
 {
   // FIXME: Should in-progress permissions be reverted if an error occurs?
   std::error_code ec;
 
-  // Don't allow free memory blocks to be used after setting protection flags.
-  CodeMem.FreeMem.clear();
+  // Don't allow free memory sharing a page with the sections to be used after
+  // setting protection flags.
+  trimFreeMemory(CodeMem.FreeMem);
 
   // Make code memory executable.
   ec = applyMemoryGroupPermissions(CodeMem,
@@ -120,8 +227,9 @@ bool SectionMemoryManager::finalizeMemory(std::string *ErrMsg)
     return true;
   }
 
-  // Don't allow free memory blocks to be used after setting protection flags.
-  RODataMem.FreeMem.clear();
+  // Don't allow free memory sharing a page with the sections to be used after
+  // setting protection flags.
+  trimFreeMemory(RODataMem.FreeMem);
 
   // Make read-only data memory read-only.
   ec = applyMemoryGroupPermissions(RODataMem,
@@ -140,17 +248,26 @@ bool SectionMemoryManager::finalizeMemory(std::string *ErrMsg)
   // relocations) will get to the data cache but not to the instruction cache.
   invalidateInstructionCache();
 
+  CodeMem.PendingMem.clear();
+  RODataMem.PendingMem.clear();
+  RWDataMem.PendingMem.clear();
+
   return false;
 }
 
 std::error_code
 SectionMemoryManager::applyMemoryGroupPermissions(MemoryGroup &MemGroup,
                                                   unsigned Permissions) {
-
-  for (int i = 0, e = MemGroup.AllocatedMem.size(); i != e; ++i) {
+  uintptr_t PageSize = sys::Process::getPageSize();
+  for (int i = 0, e = MemGroup.PendingMem.size(); i != e; ++i) {
+    // Extend the section to the pages it spans.
+    uintptr_t Start = (uintptr_t)MemGroup.PendingMem[i].base();
+    uintptr_t End = Start + MemGroup.PendingMem[i].size();
+    Start &= ~(PageSize - 1);
+    End = RoundUpToAlignment(End, PageSize);
     std::error_code ec;
-    ec =
-        sys::Memory::protectMappedMemory(MemGroup.AllocatedMem[i], Permissions);
+    ec = sys::Memory::protectMappedMemory(
+        sys::MemoryBlock((void*)Start, End - Start), Permissions);
     if (ec) {
       return ec;
     }
@@ -160,18 +277,24 @@ SectionMemoryManager::applyMemoryGroupPermissions(MemoryGroup &MemGroup,
 }
 
 void SectionMemoryManager::invalidateInstructionCache() {
-  for (int i = 0, e = CodeMem.AllocatedMem.size(); i != e; ++i)
-    sys::Memory::InvalidateInstructionCache(CodeMem.AllocatedMem[i].base(),
-                                            CodeMem.AllocatedMem[i].size());
+  for (int i = 0, e = CodeMem.PendingMem.size(); i != e; ++i)
+    sys::Memory::InvalidateInstructionCache(CodeMem.PendingMem[i].base(),
+                                            CodeMem.PendingMem[i].size());
 }
 
 SectionMemoryManager::~SectionMemoryManager() {
-  for (unsigned i = 0, e = CodeMem.AllocatedMem.size(); i != e; ++i)
-    sys::Memory::releaseMappedMemory(CodeMem.AllocatedMem[i]);
-  for (unsigned i = 0, e = RWDataMem.AllocatedMem.size(); i != e; ++i)
-    sys::Memory::releaseMappedMemory(RWDataMem.AllocatedMem[i]);
-  for (unsigned i = 0, e = RODataMem.AllocatedMem.size(); i != e; ++i)
-    sys::Memory::releaseMappedMemory(RODataMem.AllocatedMem[i]);
+  for (MemoryGroup *Group : {&CodeMem, &RWDataMem, &RODataMem}) {
+    bool Huge = UseHugePages && Group == &CodeMem;
+    // Slabs are cached writable, like newly allocated ones.
+    for (sys::MemoryBlock &MB : Group->AllocatedMem)
+      if (sys::Memory::protectMappedMemory(MB, sys::Memory::MF_READ |
+                                                   sys::Memory::MF_WRITE))
+        sys::Memory::releaseMappedMemory(MB);
+      else
+        Slabs->give(MB, SlabSize, Huge);
+    for (sys::MemoryBlock &MB : Group->LargeMem)
+      sys::Memory::releaseMappedMemory(MB);
+  }
 }
 
 } // namespace llvm
@@ -19,6 +19,8 @@
 #include "llvm/Object/ELFObjectFile.h"
 #include "llvm/Support/MathExtras.h"
 #include "llvm/Support/MutexGuard.h"
+#include "llvm/Support/TimeValue.h"
+#include <algorithm>
 
 using namespace llvm;
 using namespace llvm::object;
@@ -75,27 +77,35 @@ static void dumpSectionMemory(const SectionEntry &S, StringRef State) {
 }
 #endif
 
+static double elapsedSeconds(sys::TimeValue Start) {
+  sys::TimeValue Elapsed = sys::TimeValue::now() - Start;
+  return Elapsed.seconds() + Elapsed.nanoseconds() / 1e9;
+}
+
 // Resolve the relocations for all symbols we currently know about.
 void RuntimeDyldImpl::resolveRelocations() {
   MutexGuard locked(lock);
 
-  // First, resolve relocations associated with external symbols.
-  resolveExternalSymbols();
+  // First, look up the external symbols. This may load more objects, adding
+  // to Relocations.
+  std::vector<ResolvedRelocation> Resolved;
+  resolveExternalSymbols(Resolved);
 
-  // Just iterate over the sections we have and resolve all the relocations
-  // in them. Gross overkill, but it gets the job done.
+  // The Section here (Sections[i]) refers to the section in which the symbol
+  // for the relocation is located.  The SectionID in the relocation entry
+  // provides the section to which the relocation will be applied.
   for (int i = 0, e = Sections.size(); i != e; ++i) {
-    // The Section here (Sections[i]) refers to the section in which the
-    // symbol for the relocation is located.  The SectionID in the relocation
-    // entry provides the section to which the relocation will be applied.
+    auto Relocs = Relocations.find(i);
+    if (Relocs == Relocations.end())
+      continue;
     uint64_t Addr = Sections[i].LoadAddress;
     DEBUG(dbgs() << "Resolving relocations Section #" << i << "\t"
                  << format("0x%x", Addr) << "\n");
-    DEBUG(dumpSectionMemory(Sections[i], "before relocations"));
-    resolveRelocationList(Relocations[i], Addr);
-    DEBUG(dumpSectionMemory(Sections[i], "after relocations"));
-    Relocations.erase(i);
+    addResolvedRelocations(Relocs->second, Addr, Resolved);
+    Relocations.erase(Relocs);
   }
+
+  applyRelocations(Resolved);
 }
 
 void RuntimeDyldImpl::mapSectionAddress(const void *LocalAddress,
@@ -237,6 +247,10 @@ RuntimeDyldImpl::loadObjectImpl(const object::ObjectFile &Obj) {
   // Give the subclasses a chance to tie-up any loose ends.
   finalizeLoad(Obj, LocalSections);
 
+  // Look up the symbols referenced by the relocations, now that all the
+  // symbols of the object are known.
+  addObjectSymbolRelocations();
+
   unsigned SectionsAddedEndIdx = Sections.size();
 
   return std::make_pair(SectionsAddedBeginIdx, SectionsAddedEndIdx);
@@ -614,19 +628,54 @@ void RuntimeDyldImpl::addRelocationForSection(const RelocationEntry &RE,
 
 void RuntimeDyldImpl::addRelocationForSymbol(const RelocationEntry &RE,
                                              StringRef SymbolName) {
-  // Relocation by symbol.  If the symbol is found in the global symbol table,
-  // create an appropriate section relocation.  Otherwise, add it to
-  // ExternalSymbolRelocations.
-  RTDyldSymbolTable::const_iterator Loc = GlobalSymbolTable.find(SymbolName);
-  if (Loc == GlobalSymbolTable.end()) {
-    ExternalSymbolRelocations[SymbolName].push_back(RE);
-  } else {
+  // Relocation by symbol.  Symbol names point into the object being loaded,
+  // so group the relocations by the address of their name, and look each
+  // symbol up once the whole object has been processed.
+  auto Insert = ObjSymbolIndices.insert(std::make_pair(
+      SymbolNameKey(SymbolName.data(), SymbolName.size()), ObjSymbols.size()));
+  if (Insert.second)
+    ObjSymbols.push_back(SymbolName);
+  ObjSymbolRelocations.push_back(std::make_pair(Insert.first->second, RE));
+}
+
+void RuntimeDyldImpl::addObjectSymbolRelocations() {
+  sys::TimeValue Start = sys::TimeValue::now();
+
+  // If the symbol is found in the global symbol table, create an appropriate
+  // section relocation.  Otherwise, add it to ExternalSymbolRelocations.
+  struct SymbolTarget {
+    const SymbolInfo *Info;
+    RelocationList *External;
+  };
+  SmallVector<SymbolTarget, 16> Targets;
+  Targets.reserve(ObjSymbols.size());
+  for (StringRef Name : ObjSymbols) {
+    SymbolTarget Target = { nullptr, nullptr };
+    RTDyldSymbolTable::const_iterator Loc = GlobalSymbolTable.find(Name);
+    if (Loc == GlobalSymbolTable.end())
+      Target.External = &ExternalSymbolRelocations[Name];
+    else
+      Target.Info = &Loc->second;
+    Targets.push_back(Target);
+  }
+  Stats.NumSymbolLookups += ObjSymbols.size();
+
+  for (const auto &SymbolReloc : ObjSymbolRelocations) {
+    const SymbolTarget &Target = Targets[SymbolReloc.first];
+    if (Target.External) {
+      Target.External->push_back(SymbolReloc.second);
+      continue;
+    }
     // Copy the RE since we want to modify its addend.
-    RelocationEntry RECopy = RE;
-    const auto &SymInfo = Loc->second;
-    RECopy.Addend += SymInfo.getOffset();
-    Relocations[SymInfo.getSectionID()].push_back(RECopy);
+    RelocationEntry RECopy = SymbolReloc.second;
+    RECopy.Addend += Target.Info->getOffset();
+    Relocations[Target.Info->getSectionID()].push_back(RECopy);
   }
+
+  ObjSymbolIndices.clear();
+  ObjSymbols.clear();
+  ObjSymbolRelocations.clear();
+  Stats.SymbolLookupTime += elapsedSeconds(Start);
 }
 
 uint8_t *RuntimeDyldImpl::createStubFunction(uint8_t *Addr,
@@ -726,42 +775,81 @@ void RuntimeDyldImpl::reassignSectionAddress(unsigned SectionID,
   Sections[SectionID].LoadAddress = Addr;
 }
 
-void RuntimeDyldImpl::resolveRelocationList(const RelocationList &Relocs,
-                                            uint64_t Value) {
-  for (unsigned i = 0, e = Relocs.size(); i != e; ++i) {
-    const RelocationEntry &RE = Relocs[i];
+void RuntimeDyldImpl::addResolvedRelocations(
+    const RelocationList &Relocs, uint64_t Value,
+    std::vector<ResolvedRelocation> &Resolved) {
+  for (unsigned i = 0, e = Relocs.size(); i != e; ++i)
+    Resolved.push_back(ResolvedRelocation(Value, Relocs[i]));
+}
+
+void RuntimeDyldImpl::applyRelocations(
+    std::vector<ResolvedRelocation> &Resolved) {
+  sys::TimeValue Start = sys::TimeValue::now();
+
+  // Patch each section from its start to its end, rather than hopping across
+  // all the sections once per symbol. The sort is stable so that relocations
+  // patching the same location are applied in the order they were found.
+  std::stable_sort(Resolved.begin(), Resolved.end(),
+                   [](const ResolvedRelocation &LHS,
+                      const ResolvedRelocation &RHS) {
+                     return std::make_pair(LHS.RE.SectionID, LHS.RE.Offset) <
+                            std::make_pair(RHS.RE.SectionID, RHS.RE.Offset);
+                   });
+
+  for (auto I = Resolved.begin(), E = Resolved.end(); I != E;) {
+    unsigned SectionID = I->RE.SectionID;
+    auto SectionEnd = std::find_if(I, E, [=](const ResolvedRelocation &R) {
+      return R.RE.SectionID != SectionID;
+    });
     // Ignore relocations for sections that were not loaded
-    if (Sections[RE.SectionID].Address == nullptr)
+    if (Sections[SectionID].Address == nullptr) {
+      I = SectionEnd;
       continue;
-    resolveRelocation(RE, Value);
+    }
+    DEBUG(dumpSectionMemory(Sections[SectionID], "before relocations"));
+    for (; I != SectionEnd; ++I)
+      resolveRelocation(I->RE, I->Value);
+    DEBUG(dumpSectionMemory(Sections[SectionID], "after relocations"));
   }
+
+  Stats.NumRelocations += Resolved.size();
+  Stats.RelocationTime += elapsedSeconds(Start);
 }
 
-void RuntimeDyldImpl::resolveExternalSymbols() {
+void RuntimeDyldImpl::resolveExternalSymbols(
+    std::vector<ResolvedRelocation> &Resolved) {
+  sys::TimeValue Start = sys::TimeValue::now();
+
   while (!ExternalSymbolRelocations.empty()) {
-    StringMap<RelocationList>::iterator i = ExternalSymbolRelocations.begin();
-
-    StringRef Name = i->first();
-    if (Name.size() == 0) {
-      // This is an absolute symbol, use an address of zero.
-      DEBUG(dbgs() << "Resolving absolute relocations."
-                   << "\n");
-      RelocationList &Relocs = i->second;
-      resolveRelocationList(Relocs, 0);
-    } else {
+    // The call to getSymbolAddress may cause additional modules to be loaded,
+    // which may add new entries to ExternalSymbolRelocations, including for
+    // the symbols being looked up.  Take the current ones as a batch, and
+    // look each of them up once.
+    StringMap<RelocationList> Batch(std::move(ExternalSymbolRelocations));
+    // Absolute relocations are grouped under the empty name, which is not
+    // looked up.
+    Stats.NumSymbolLookups += Batch.size() - Batch.count("");
+
+    for (StringMap<RelocationList>::iterator i = Batch.begin(), e = Batch.end();
+         i != e; ++i) {
+      StringRef Name = i->first();
+      if (Name.size() == 0) {
+        // This is an absolute symbol, use an address of zero.
+        DEBUG(dbgs() << "Resolving absolute relocations."
+                     << "\n");
+        addResolvedRelocations(i->second, 0, Resolved);
+        continue;
+      }
+
       uint64_t Addr = 0;
       RTDyldSymbolTable::const_iterator Loc = GlobalSymbolTable.find(Name);
       if (Loc == GlobalSymbolTable.end()) {
         // This is an external symbol, try to get its address from
-        // MemoryManager.
+        // MemoryManager. It may compile and load more code, which is not
+        // counted as lookup time.
+        Stats.SymbolLookupTime += elapsedSeconds(Start);
         Addr = MemMgr->getSymbolAddress(Name.data());
-        // The call to getSymbolAddress may have caused additional modules to
-        // be loaded, which may have added new entries to the
-        // ExternalSymbolRelocations map.  Consquently, we need to update our
-        // iterator.  This is also why retrieval of the relocation list
-        // associated with this symbol is deferred until below this point.
-        // New entries may have been added to the relocation list.
-        i = ExternalSymbolRelocations.find(Name);
+        Start = sys::TimeValue::now();
       } else {
         // We found the symbol in our global table.  It was probably in a
         // Module that we loaded previously.
@@ -778,14 +866,11 @@ void RuntimeDyldImpl::resolveExternalSymbols() {
       updateGOTEntries(Name, Addr);
       DEBUG(dbgs() << "Resolving relocations Name: " << Name << "\t"
                    << format("0x%lx", Addr) << "\n");
-      // This list may have been updated when we called getSymbolAddress, so
-      // don't change this code to get the list earlier.
-      RelocationList &Relocs = i->second;
-      resolveRelocationList(Relocs, Addr);
+      addResolvedRelocations(i->second, Addr, Resolved);
     }
-
-    ExternalSymbolRelocations.erase(i);
   }
+
+  Stats.SymbolLookupTime += elapsedSeconds(Start);
 }
 
 //===----------------------------------------------------------------------===//
@@ -872,6 +957,12 @@ uint64_t RuntimeDyld::getExportedSymbolLoadAddress(StringRef Name) const {
 
 void RuntimeDyld::resolveRelocations() { Dyld->resolveRelocations(); }
 
+RuntimeDyld::Statistics RuntimeDyld::getStatistics() const {
+  if (!Dyld)
+    return Statistics();
+  return Dyld->getStatistics();
+}
+
 void RuntimeDyld::reassignSectionAddress(unsigned SectionID, uint64_t Addr) {
   Dyld->reassignSectionAddress(SectionID, Addr);
 }
@@ -30,6 +30,7 @@
 #include "llvm/Support/raw_ostream.h"
 #include <map>
 #include <system_error>
+#include <vector>
 
 using namespace llvm;
 using namespace llvm::object;
@@ -222,6 +223,19 @@ protected:
   // modules.  This map is indexed by symbol name.
   StringMap<RelocationList> ExternalSymbolRelocations;
 
+  // The symbols referenced by relocations of the object being loaded, and
+  // those relocations with the index of their symbol.  They are added to
+  // Relocations or ExternalSymbolRelocations once the whole object has been
+  // processed, looking each symbol up once.  The names point into the object,
+  // so they are identified by their address rather than by hashing them for
+  // every relocation.
+  typedef std::pair<const char *, size_t> SymbolNameKey;
+  DenseMap<SymbolNameKey, unsigned> ObjSymbolIndices;
+  SmallVector<StringRef, 16> ObjSymbols;
+  std::vector<std::pair<unsigned, RelocationEntry>> ObjSymbolRelocations;
+
+  RuntimeDyld::Statistics Stats;
+
 
   typedef std::map<RelocationValueRef, uintptr_t> StubMap;
 
@@ -332,8 +346,27 @@ protected:
   /// \return Pointer to the memory area for emitting target address.
   uint8_t *createStubFunction(uint8_t *Addr, unsigned AbiVariant = 0);
 
-  /// \brief Resolves relocations from Relocs list with address from Value.
-  void resolveRelocationList(const RelocationList &Relocs, uint64_t Value);
+  /// \brief Look up the symbols of the relocations added by
+  /// addRelocationForSymbol for the object being loaded.
+  void addObjectSymbolRelocations();
+
+  /// \brief A relocation and the address of its symbol.
+  struct ResolvedRelocation {
+    uint64_t Value;
+    RelocationEntry RE;
+
+    ResolvedRelocation(uint64_t Value, const RelocationEntry &RE)
+        : Value(Value), RE(RE) {}
+  };
+
+  /// \brief Append the relocations from Relocs list with address from Value
+  /// to Resolved.
+  void addResolvedRelocations(const RelocationList &Relocs, uint64_t Value,
+                              std::vector<ResolvedRelocation> &Resolved);
+
+  /// \brief Apply the Resolved relocations, sorted by the section and offset
+  /// they patch, so that each section is written in a single pass.
+  void applyRelocations(std::vector<ResolvedRelocation> &Resolved);
 
   /// \brief A object file specific relocation resolver
   /// \param RE The relocation to be resolved
@@ -349,8 +382,9 @@ protected:
                        const ObjectFile &Obj, ObjSectionToIDMap &ObjSectionToID,
                        StubMap &Stubs) = 0;
 
-  /// \brief Resolve relocations to external symbols.
-  void resolveExternalSymbols();
+  /// \brief Look up the external symbols, and append their relocations to
+  /// Resolved.
+  void resolveExternalSymbols(std::vector<ResolvedRelocation> &Resolved);
 
   /// \brief Update GOT entries for external symbols.
   // The base class does nothing.  ELF overrides this.
@@ -418,6 +452,8 @@ public:
 
   void resolveRelocations();
 
+  const RuntimeDyld::Statistics &getStatistics() const { return Stats; }
+
   void reassignSectionAddress(unsigned SectionID, uint64_t Addr);
 
   void mapSectionAddress(const void *LocalAddress, uint64_t TargetAddress);
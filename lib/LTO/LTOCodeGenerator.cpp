@@ -17,6 +17,7 @@
 #include "llvm/Analysis/Passes.h"
 #include "llvm/Analysis/TargetLibraryInfo.h"
 #include "llvm/Bitcode/ReaderWriter.h"
+#include "llvm/CodeGen/ParallelCG.h"
 #include "llvm/CodeGen/RuntimeLibcalls.h"
 #include "llvm/Config/config.h"
 #include "llvm/IR/Constants.h"
@@ -81,6 +82,8 @@ void LTOCodeGenerator::initialize() {
   CodeModel = LTO_CODEGEN_PIC_MODEL_DEFAULT;
   DiagHandler = nullptr;
   DiagContext = nullptr;
+  RelocModel = Reloc::Default;
+  CodeGenParallelism = 1;
 
   initializeLTOPasses();
 }
@@ -247,6 +250,31 @@ const void* LTOCodeGenerator::compile(size_t* length,
                                       bool disableGVNLoadPRE,
                                       bool disableVectorization,
                                       std::string& errMsg) {
+  // Drop the objects of the previous call, so that they cannot be mistaken
+  // for the result of this one if it fails.
+  NativeObjectFiles.clear();
+
+  if (CodeGenParallelism > 1) {
+    // Generate each partition straight into memory.
+    std::vector<SmallString<0>> Buffers(CodeGenParallelism);
+    std::vector<std::unique_ptr<raw_svector_ostream>> OSs;
+    std::vector<raw_ostream *> OSPtrs;
+    for (SmallString<0> &Buffer : Buffers) {
+      OSs.emplace_back(new raw_svector_ostream(Buffer));
+      OSPtrs.push_back(OSs.back().get());
+    }
+    if (!generateObjectFiles(OSPtrs, disableOpt, disableInline,
+                             disableGVNLoadPRE, disableVectorization, errMsg))
+      return nullptr;
+
+    for (unsigned I = 0; I != CodeGenParallelism; ++I) {
+      OSs[I]->flush();
+      NativeObjectFiles.push_back(MemoryBuffer::getMemBufferCopy(
+          Buffers[I], "lto-llvm-" + Twine(I) + ".o"));
+    }
+    return getObject(0, length);
+  }
+
   const char *name;
   if (!compile_to_file(&name, disableOpt, disableInline, disableGVNLoadPRE,
                        disableVectorization, errMsg))
@@ -260,16 +288,20 @@ const void* LTOCodeGenerator::compile(size_t* length,
     sys::fs::remove(NativeObjectPath);
     return nullptr;
   }
-  NativeObjectFile = std::move(*BufferOrErr);
+  NativeObjectFiles.push_back(std::move(*BufferOrErr));
 
   // remove temp files
   sys::fs::remove(NativeObjectPath);
 
   // return buffer, unless error
-  if (!NativeObjectFile)
+  return getObject(0, length);
+}
+
+const void *LTOCodeGenerator::getObject(unsigned Index, size_t *length) {
+  if (Index >= NativeObjectFiles.size() || !NativeObjectFiles[Index])
     return nullptr;
-  *length = NativeObjectFile->getBufferSize();
-  return NativeObjectFile->getBufferStart();
+  *length = NativeObjectFiles[Index]->getBufferSize();
+  return NativeObjectFiles[Index]->getBufferStart();
 }
 
 bool LTOCodeGenerator::determineTarget(std::string &errMsg) {
@@ -288,7 +320,7 @@ bool LTOCodeGenerator::determineTarget(std::string &errMsg) {
 
   // The relocation model is actually a static member of TargetMachine and
   // needs to be set before the TargetMachine is instantiated.
-  Reloc::Model RelocModel = Reloc::Default;
+  RelocModel = Reloc::Default;
   switch (CodeModel) {
   case LTO_CODEGEN_PIC_MODEL_STATIC:
     RelocModel = Reloc::Static;
@@ -308,7 +340,7 @@ bool LTOCodeGenerator::determineTarget(std::string &errMsg) {
   // the default set of features.
   SubtargetFeatures Features(MAttr);
   Features.getDefaultSubtargetFeatures(Triple);
-  std::string FeatureStr = Features.getString();
+  FeatureStr = Features.getString();
   // Set a default CPU for Darwin triples.
   if (MCpu.empty() && Triple.isOSDarwin()) {
     if (Triple.getArch() == llvm::Triple::x86_64)
@@ -457,12 +489,11 @@ void LTOCodeGenerator::applyScopeRestrictions() {
 }
 
 /// Optimize merged modules using various IPO passes
-bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
-                                          bool DisableOpt,
-                                          bool DisableInline,
-                                          bool DisableGVNLoadPRE,
-                                          bool DisableVectorization,
-                                          std::string &errMsg) {
+bool LTOCodeGenerator::optimize(bool DisableOpt,
+                                bool DisableInline,
+                                bool DisableGVNLoadPRE,
+                                bool DisableVectorization,
+                                std::string &errMsg) {
   if (!this->determineTarget(errMsg))
     return false;
 
@@ -492,6 +523,24 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
 
   PMB.populateLTOPassManager(passes, TargetMach);
 
+  // Run our queue of passes all at once now, efficiently.
+  passes.run(*mergedModule);
+
+  return true;
+}
+
+bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
+                                          bool DisableOpt,
+                                          bool DisableInline,
+                                          bool DisableGVNLoadPRE,
+                                          bool DisableVectorization,
+                                          std::string &errMsg) {
+  if (!optimize(DisableOpt, DisableInline, DisableGVNLoadPRE,
+                DisableVectorization, errMsg))
+    return false;
+
+  Module *mergedModule = IRLinker.getModule();
+
   PassManager codeGenPasses;
 
   codeGenPasses.add(new DataLayoutPass());
@@ -508,15 +557,43 @@ bool LTOCodeGenerator::generateObjectFile(raw_ostream &out,
     return false;
   }
 
-  // Run our queue of passes all at once now, efficiently.
-  passes.run(*mergedModule);
-
   // Run the code generator, and write assembly file
   codeGenPasses.run(*mergedModule);
 
   return true;
 }
 
+bool LTOCodeGenerator::generateObjectFiles(ArrayRef<raw_ostream *> Outs,
+                                           bool DisableOpt,
+                                           bool DisableInline,
+                                           bool DisableGVNLoadPRE,
+                                           bool DisableVectorization,
+                                           std::string &errMsg) {
+  if (!optimize(DisableOpt, DisableInline, DisableGVNLoadPRE,
+                DisableVectorization, errMsg))
+    return false;
+
+  Module *mergedModule = IRLinker.getModule();
+
+  // If the bitcode files contain ARC code and were compiled with optimization,
+  // the ObjCARCContractPass must be run. The partitions only go through the
+  // code generator, so run it on the merged module before splitting it.
+  PassManager preCodeGenPasses;
+  preCodeGenPasses.add(new DataLayoutPass());
+  preCodeGenPasses.add(createObjCARCContractPass());
+  preCodeGenPasses.run(*mergedModule);
+
+  // Every partition is compiled for the target determineTarget() picked.
+  const Target &TheTarget = TargetMach->getTarget();
+  auto TMFactory = [&]() {
+    return std::unique_ptr<TargetMachine>(TheTarget.createTargetMachine(
+        TargetMach->getTargetTriple(), MCpu, FeatureStr, Options, RelocModel,
+        CodeModel::Default, CodeGenOpt::Aggressive));
+  };
+  return splitCodeGen(*mergedModule, Outs, TMFactory,
+                      TargetMachine::CGFT_ObjectFile, errMsg);
+}
+
 /// setCodeGenDebugOptions - Set codegen debugging options to aid in debugging
 /// LTO problems.
 void LTOCodeGenerator::setCodeGenDebugOptions(const char *options) {
@@ -422,12 +422,21 @@ class ModuleLinker {
 
   DiagnosticHandlerFunction DiagnosticHandler;
 
+  /// Linker::Flags of this link.
+  unsigned Flags;
+
+  /// Source globals linked even if nothing references them, with
+  /// Linker::LinkOnlyNeeded.
+  SmallPtrSet<const GlobalValue *, 8> Roots;
+
 public:
   ModuleLinker(Module *dstM, Linker::IdentifiedStructTypeSet &Set, Module *srcM,
-               DiagnosticHandlerFunction DiagnosticHandler)
+               DiagnosticHandlerFunction DiagnosticHandler, unsigned Flags,
+               ArrayRef<const GlobalValue *> Roots)
       : DstM(dstM), SrcM(srcM), TypeMap(Set),
         ValMaterializer(TypeMap, DstM, LazilyLinkGlobalValues),
-        DiagnosticHandler(DiagnosticHandler) {}
+        DiagnosticHandler(DiagnosticHandler), Flags(Flags),
+        Roots(Roots.begin(), Roots.end()) {}
 
   bool run();
 
@@ -435,6 +444,15 @@ private:
   bool shouldLinkFromSource(bool &LinkFromSrc, const GlobalValue &Dest,
                             const GlobalValue &Src);
 
+  /// Whether \p SGV, which has no counterpart in the destination, can be left
+  /// for the ValueMaterializerTy to link if something turns out to use it.
+  bool shouldLinkLazily(const GlobalValue &SGV) const {
+    if (SGV.hasLocalLinkage() || SGV.hasLinkOnceLinkage() ||
+        SGV.hasAvailableExternallyLinkage())
+      return true;
+    return (Flags & Linker::LinkOnlyNeeded) && !Roots.count(&SGV);
+  }
+
   /// Helper method for setting a message and returning an error code.
   bool emitError(const Twine &Message) {
     DiagnosticHandler(LinkDiagnosticInfo(DS_Error, Message));
@@ -1076,8 +1094,7 @@ bool ModuleLinker::linkGlobalValueProto(GlobalValue *SGV) {
   } else {
     // If the GV is to be lazily linked, don't create it just yet.
     // The ValueMaterializerTy will deal with creating it if it's used.
-    if (!DGV && (SGV->hasLocalLinkage() || SGV->hasLinkOnceLinkage() ||
-                 SGV->hasAvailableExternallyLinkage())) {
+    if (!DGV && shouldLinkLazily(*SGV)) {
       DoNotLinkFromSource.insert(SGV);
       return false;
     }
@@ -1718,9 +1735,10 @@ void Linker::deleteModule() {
   Composite = nullptr;
 }
 
-bool Linker::linkInModule(Module *Src) {
+bool Linker::linkInModule(Module *Src, unsigned Flags,
+                          ArrayRef<const GlobalValue *> Roots) {
   ModuleLinker TheLinker(Composite, IdentifiedStructTypes, Src,
-                         DiagnosticHandler);
+                         DiagnosticHandler, Flags, Roots);
   bool RetCode = TheLinker.run();
   Composite->dropTriviallyDeadConstantArrays();
   return RetCode;
@@ -1796,6 +1796,11 @@ void ELFObjectWriter::WriteObject(MCAssembler &Asm,
     FileOff += GetSectionFileSize(Layout, SD);
   }
 
+  // The whole object is laid out, let streams backed by a fixed size buffer
+  // allocate it at once so that every section is written straight to its
+  // final location.
+  OS.reserveExtraSpace(FileOff);
+
   // Write out the ELF header ...
   WriteHeader(Asm, SectionHeaderOffset, NumSections + 1);
 
@@ -24,16 +24,25 @@
 #include "llvm/MC/MCSectionELF.h"
 #include "llvm/MC/MCSymbol.h"
 #include "llvm/MC/MCValue.h"
+#include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/LEB128.h"
 #include "llvm/Support/TargetRegistry.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
+#include <atomic>
 #include <tuple>
 using namespace llvm;
 
 #define DEBUG_TYPE "assembler"
 
+static cl::opt<unsigned> RelaxThreads(
+    "mc-relax-threads", cl::Hidden, cl::init(1),
+    cl::desc("Number of threads relaxing the sections that only refer to "
+             "themselves (0 = number of cores)"));
+
 namespace {
 namespace stats {
 STATISTIC(EmittedFragments, "Number of emitted assembler fragments - total");
@@ -53,6 +62,9 @@ STATISTIC(evaluateFixup, "Number of evaluated fixups");
 STATISTIC(FragmentLayouts, "Number of fragment layouts");
 STATISTIC(ObjectBytes, "Number of emitted object file bytes");
 STATISTIC(RelaxationSteps, "Number of assembler layout and relaxation steps");
+STATISTIC(RelaxationPasses,
+          "Number of relaxation passes over the fragments of a section");
+STATISTIC(RelaxationVisits, "Number of fragments visited during relaxation");
 STATISTIC(RelaxedInstructions, "Number of relaxed instructions");
 }
 }
@@ -74,6 +86,11 @@ MCAsmLayout::MCAsmLayout(MCAssembler &Asm)
   for (MCAssembler::iterator it = Asm.begin(), ie = Asm.end(); it != ie; ++it)
     if (it->getSection().isVirtualSection())
       SectionOrder.push_back(&*it);
+
+  // Give every section an entry up-front, so that sections can be laid out
+  // concurrently without inserting into the map.
+  for (MCSectionData *SD : SectionOrder)
+    LastValidFragment[SD] = nullptr;
 }
 
 bool MCAsmLayout::isFragmentValid(const MCFragment *F) const {
@@ -900,6 +917,70 @@ std::pair<uint64_t, bool> MCAssembler::handleFixup(const MCAsmLayout &Layout,
   return std::make_pair(FixedValue, IsPCRel);
 }
 
+/// Check whether \p Expr can be evaluated from the layout of \p Section
+/// alone. Variable symbols are rejected rather than followed.
+static bool isExprLocal(const MCExpr &Expr, const MCSection &Section) {
+  switch (Expr.getKind()) {
+  case MCExpr::Constant:
+    return true;
+  case MCExpr::SymbolRef: {
+    const MCSymbol &Sym = cast<MCSymbolRefExpr>(Expr).getSymbol();
+    if (Sym.isVariable())
+      return false;
+    return Sym.isUndefined() ||
+           (Sym.isInSection() && &Sym.getSection() == &Section);
+  }
+  case MCExpr::Unary:
+    return isExprLocal(*cast<MCUnaryExpr>(Expr).getSubExpr(), Section);
+  case MCExpr::Binary: {
+    const MCBinaryExpr &BE = cast<MCBinaryExpr>(Expr);
+    return isExprLocal(*BE.getLHS(), Section) &&
+           isExprLocal(*BE.getRHS(), Section);
+  }
+  case MCExpr::Target:
+    return false;
+  }
+  llvm_unreachable("Invalid assembly expression kind!");
+}
+
+/// Check whether relaxing the fragments of \p SD only depends on the layout
+/// of \p SD itself.
+static bool isRelaxationLocal(const MCSectionData &SD) {
+  const MCSection &Section = SD.getSection();
+  for (const MCFragment &F : SD) {
+    switch (F.getKind()) {
+    default:
+      break;
+    case MCFragment::FT_Relaxable: {
+      const MCRelaxableFragment &RF = cast<MCRelaxableFragment>(F);
+      for (const MCFixup &Fixup : RF.getFixups())
+        if (!isExprLocal(*Fixup.getValue(), Section))
+          return false;
+      break;
+    }
+    case MCFragment::FT_Dwarf:
+      if (!isExprLocal(cast<MCDwarfLineAddrFragment>(F).getAddrDelta(),
+                       Section))
+        return false;
+      break;
+    case MCFragment::FT_DwarfFrame:
+      if (!isExprLocal(cast<MCDwarfCallFrameFragment>(F).getAddrDelta(),
+                       Section))
+        return false;
+      break;
+    case MCFragment::FT_LEB:
+      if (!isExprLocal(cast<MCLEBFragment>(F).getValue(), Section))
+        return false;
+      break;
+    case MCFragment::FT_Org:
+      if (!isExprLocal(cast<MCOrgFragment>(F).getOffset(), Section))
+        return false;
+      break;
+    }
+  }
+  return true;
+}
+
 void MCAssembler::Finish() {
   DEBUG_WITH_TYPE("mc-dump", {
       llvm::errs() << "assembler backend - pre-layout\n--\n";
@@ -930,8 +1011,25 @@ void MCAssembler::Finish() {
       iFrag->setLayoutOrder(FragmentIndex++);
   }
 
-  // Layout until everything fits.
-  while (layoutOnce(Layout))
+  // Layout until everything fits. Sections which only refer to themselves
+  // reach their fixed point independently of the others, so they can be
+  // relaxed concurrently, and only once. The remaining sections are relaxed
+  // serially afterwards, as they may depend on any section's layout.
+  std::vector<MCSectionData *> LocalSections, SerialSections;
+  unsigned NumThreads =
+      RelaxThreads ? RelaxThreads : heavyweight_hardware_concurrency();
+  for (MCAssembler::iterator it = begin(), ie = end(); it != ie; ++it) {
+    if (NumThreads > 1 && isRelaxationLocal(*it))
+      LocalSections.push_back(&*it);
+    else
+      SerialSections.push_back(&*it);
+  }
+  if (LocalSections.size() > 1)
+    relaxSectionsConcurrently(Layout, LocalSections, NumThreads);
+  else
+    SerialSections.insert(SerialSections.begin(), LocalSections.begin(),
+                          LocalSections.end());
+  while (layoutOnce(Layout, SerialSections))
     continue;
 
   DEBUG_WITH_TYPE("mc-dump", {
@@ -1027,7 +1125,11 @@ bool MCAssembler::relaxInstruction(MCAsmLayout &Layout,
   SmallVector<MCFixup, 4> Fixups;
   SmallString<256> Code;
   raw_svector_ostream VecOS(Code);
-  getEmitter().EncodeInstruction(Relaxed, VecOS, Fixups, F.getSubtargetInfo());
+  {
+    std::lock_guard<std::mutex> Lock(RelaxationEncoderMutex);
+    getEmitter().EncodeInstruction(Relaxed, VecOS, Fixups,
+                                   F.getSubtargetInfo());
+  }
   VecOS.flush();
 
   // Update the fragment.
@@ -1080,61 +1182,235 @@ bool MCAssembler::relaxDwarfCallFrameFragment(MCAsmLayout &Layout,
   return OldSize != Data.size();
 }
 
-bool MCAssembler::layoutSectionOnce(MCAsmLayout &Layout, MCSectionData &SD) {
-  // Holds the first fragment which needed relaxing during this layout. It will
-  // remain NULL if none were relaxed.
-  // When a fragment is relaxed, all the fragments following it should get
-  // invalidated because their offset is going to change.
-  MCFragment *FirstRelaxedFragment = nullptr;
-
-  // Attempt to relax all the fragments in the section.
-  for (MCSectionData::iterator I = SD.begin(), IE = SD.end(); I != IE; ++I) {
-    // Check if this is a fragment that needs relaxation.
-    bool RelaxedFrag = false;
-    switch(I->getKind()) {
+namespace {
+/// A fragment whose size may change during relaxation, along with the
+/// fragments its size depends on.
+struct RelaxationCandidate {
+  MCFragment *F;
+  /// The size of F only depends on the sizes of the fragments with a layout
+  /// order in [Lo, Hi], unless IsGlobal is set.
+  unsigned Lo, Hi;
+  /// Whether the size of F depends on other sections, or on expressions too
+  /// complex to analyze.
+  bool IsGlobal;
+  /// Whether [Lo, Hi] contains alignment or .org padding, which changes when
+  /// the fragments before it change size.
+  bool SpansPadding;
+};
+}
+
+/// Add to [Lo, Hi] the fragments that \p Expr depends on, counting in \p
+/// Balance the labels that are added minus those that are subtracted, with
+/// the sign \p Sign. Returns false if \p Expr depends on the layout of other
+/// sections, or cannot be analyzed.
+static bool addExprDependencies(const MCAssembler &Asm, const MCExpr &Expr,
+                                const MCSection &Section, int Sign,
+                                unsigned &Lo, unsigned &Hi, int &Balance) {
+  switch (Expr.getKind()) {
+  case MCExpr::Constant:
+    return true;
+  case MCExpr::SymbolRef: {
+    const MCSymbol &Sym = cast<MCSymbolRefExpr>(Expr).getSymbol();
+    if (Sym.isVariable())
+      return false;
+    if (Sym.isUndefined())
+      return true;
+    if (!Sym.isInSection() || &Sym.getSection() != &Section)
+      return false;
+    const MCFragment *F = Asm.getSymbolData(Sym).getFragment();
+    if (!F)
+      return false;
+    Lo = std::min(Lo, F->getLayoutOrder());
+    Hi = std::max(Hi, F->getLayoutOrder());
+    Balance += Sign;
+    return true;
+  }
+  case MCExpr::Unary: {
+    const MCUnaryExpr &UE = cast<MCUnaryExpr>(Expr);
+    if (UE.getOpcode() == MCUnaryExpr::Minus)
+      Sign = -Sign;
+    else if (UE.getOpcode() != MCUnaryExpr::Plus)
+      return false;
+    return addExprDependencies(Asm, *UE.getSubExpr(), Section, Sign, Lo, Hi,
+                               Balance);
+  }
+  case MCExpr::Binary: {
+    const MCBinaryExpr &BE = cast<MCBinaryExpr>(Expr);
+    if (BE.getOpcode() != MCBinaryExpr::Add &&
+        BE.getOpcode() != MCBinaryExpr::Sub)
+      return false;
+    int RHSSign = BE.getOpcode() == MCBinaryExpr::Sub ? -Sign : Sign;
+    return addExprDependencies(Asm, *BE.getLHS(), Section, Sign, Lo, Hi,
+                               Balance) &&
+           addExprDependencies(Asm, *BE.getRHS(), Section, RHSSign, Lo, Hi,
+                               Balance);
+  }
+  case MCExpr::Target:
+    return false;
+  }
+  llvm_unreachable("Invalid assembly expression kind!");
+}
+
+/// Add to \p C the fragments that the value of \p Expr, used in C.F, depends
+/// on. A PC-relative value is relative to C.F itself.
+static void addDependencies(const MCAssembler &Asm, const MCExpr &Expr,
+                            bool IsPCRel, RelaxationCandidate &C) {
+  int Balance = IsPCRel ? -1 : 0;
+  if (!addExprDependencies(Asm, Expr, C.F->getParent()->getSection(), 1, C.Lo,
+                           C.Hi, Balance))
+    C.IsGlobal = true;
+  // Unless the labels cancel out, the value is an offset from the start of
+  // the section rather than a distance between two fragments.
+  else if (Balance != 0)
+    C.Lo = 0;
+}
+
+bool MCAssembler::relaxFragment(MCAsmLayout &Layout, MCFragment &F) {
+  switch(F.getKind()) {
+  default:
+    return false;
+  case MCFragment::FT_Relaxable:
+    assert(!getRelaxAll() &&
+           "Did not expect a MCRelaxableFragment in RelaxAll mode");
+    return relaxInstruction(Layout, cast<MCRelaxableFragment>(F));
+  case MCFragment::FT_Dwarf:
+    return relaxDwarfLineAddr(Layout, cast<MCDwarfLineAddrFragment>(F));
+  case MCFragment::FT_DwarfFrame:
+    return relaxDwarfCallFrameFragment(Layout,
+                                       cast<MCDwarfCallFrameFragment>(F));
+  case MCFragment::FT_LEB:
+    return relaxLEB(Layout, cast<MCLEBFragment>(F));
+  }
+}
+
+bool MCAssembler::relaxSection(MCAsmLayout &Layout, MCSectionData &SD) {
+  // Find the fragments which may change size, and what they depend on.
+  // Alignment and .org padding absorb the size changes before them, so a
+  // range containing some can change even if nothing in it was relaxed.
+  std::vector<RelaxationCandidate> Candidates;
+  std::vector<unsigned> PaddingBefore(1, 0);
+  for (MCFragment &F : SD) {
+    bool IsPadding = F.getKind() == MCFragment::FT_Align ||
+                     F.getKind() == MCFragment::FT_Org;
+    PaddingBefore.push_back(PaddingBefore.back() + IsPadding);
+
+    RelaxationCandidate C;
+    C.F = &F;
+    C.Lo = C.Hi = F.getLayoutOrder();
+    C.IsGlobal = false;
+    switch (F.getKind()) {
     default:
+      continue;
+    case MCFragment::FT_Relaxable: {
+      auto &RF = cast<MCRelaxableFragment>(F);
+      if (!getBackend().mayNeedRelaxation(RF.getInst()))
+        continue;
+      for (const MCFixup &Fixup : RF.getFixups())
+        addDependencies(*this, *Fixup.getValue(),
+                        getBackend().getFixupKindInfo(Fixup.getKind()).Flags &
+                            MCFixupKindInfo::FKF_IsPCRel,
+                        C);
       break;
-    case MCFragment::FT_Relaxable:
-      assert(!getRelaxAll() &&
-             "Did not expect a MCRelaxableFragment in RelaxAll mode");
-      RelaxedFrag = relaxInstruction(Layout, *cast<MCRelaxableFragment>(I));
-      break;
+    }
     case MCFragment::FT_Dwarf:
-      RelaxedFrag = relaxDwarfLineAddr(Layout,
-                                       *cast<MCDwarfLineAddrFragment>(I));
+      addDependencies(*this, cast<MCDwarfLineAddrFragment>(F).getAddrDelta(),
+                      false, C);
       break;
     case MCFragment::FT_DwarfFrame:
-      RelaxedFrag =
-        relaxDwarfCallFrameFragment(Layout,
-                                    *cast<MCDwarfCallFrameFragment>(I));
+      addDependencies(*this, cast<MCDwarfCallFrameFragment>(F).getAddrDelta(),
+                      false, C);
       break;
     case MCFragment::FT_LEB:
-      RelaxedFrag = relaxLEB(Layout, *cast<MCLEBFragment>(I));
+      addDependencies(*this, cast<MCLEBFragment>(F).getValue(), false, C);
       break;
     }
-    if (RelaxedFrag && !FirstRelaxedFragment)
-      FirstRelaxedFragment = I;
+    Candidates.push_back(C);
   }
-  if (FirstRelaxedFragment) {
+  for (RelaxationCandidate &C : Candidates)
+    // With bundling, any fragment may be padded.
+    C.SpansPadding =
+        getBundleAlignSize() || PaddingBefore[C.Hi + 1] != PaddingBefore[C.Lo];
+
+  // The first pass visits every candidate. A later pass only visits the
+  // candidates whose range was touched by the size changes of the previous
+  // pass, as the other ones would evaluate to the same size again.
+  std::vector<RelaxationCandidate *> Worklist;
+  for (RelaxationCandidate &C : Candidates)
+    Worklist.push_back(&C);
+
+  bool WasRelaxed = false;
+  std::vector<unsigned> Changed;
+  while (!Worklist.empty()) {
+    ++stats::RelaxationPasses;
+    stats::RelaxationVisits += Worklist.size();
+    DEBUG(dbgs() << "relaxation pass over '"
+                 << SD.getSection().getLabelBeginName() << "': visiting "
+                 << Worklist.size() << " of " << Candidates.size()
+                 << " fragments\n");
+
+    // When a fragment is relaxed, all the fragments following it get
+    // invalidated because their offset is going to change.
+    Changed.clear();
+    MCFragment *FirstRelaxedFragment = nullptr;
+    for (RelaxationCandidate *C : Worklist) {
+      if (!relaxFragment(Layout, *C->F))
+        continue;
+      if (!FirstRelaxedFragment)
+        FirstRelaxedFragment = C->F;
+      Changed.push_back(C->F->getLayoutOrder());
+    }
+    if (!FirstRelaxedFragment)
+      break;
     Layout.invalidateFragmentsFrom(FirstRelaxedFragment);
-    return true;
+    WasRelaxed = true;
+
+    // Changed is sorted, as the worklist is in layout order.
+    Worklist.clear();
+    for (RelaxationCandidate &C : Candidates) {
+      // Relaxed instructions that cannot grow any further are done.
+      if (auto *RF = dyn_cast<MCRelaxableFragment>(C.F))
+        if (!getBackend().mayNeedRelaxation(RF->getInst()))
+          continue;
+      auto FirstChangeInRange =
+          std::lower_bound(Changed.begin(), Changed.end(), C.Lo);
+      if (C.IsGlobal ||
+          (FirstChangeInRange != Changed.end() &&
+           *FirstChangeInRange <= C.Hi) ||
+          (C.SpansPadding && Changed.front() < C.Lo))
+        Worklist.push_back(&C);
+    }
   }
-  return false;
+  return WasRelaxed;
 }
 
-bool MCAssembler::layoutOnce(MCAsmLayout &Layout) {
+bool MCAssembler::layoutOnce(MCAsmLayout &Layout,
+                             ArrayRef<MCSectionData *> Sections) {
   ++stats::RelaxationSteps;
 
   bool WasRelaxed = false;
-  for (iterator it = begin(), ie = end(); it != ie; ++it) {
-    MCSectionData &SD = *it;
-    while (layoutSectionOnce(Layout, SD))
-      WasRelaxed = true;
-  }
+  for (MCSectionData *SD : Sections)
+    WasRelaxed |= relaxSection(Layout, *SD);
 
   return WasRelaxed;
 }
 
+void MCAssembler::relaxSectionsConcurrently(MCAsmLayout &Layout,
+                                            ArrayRef<MCSectionData *> Sections,
+                                            unsigned NumThreads) {
+  ++stats::RelaxationSteps;
+
+  // Each section is relaxed by a single thread, which only reads and writes
+  // the layout of that section.
+  std::atomic<unsigned> NextSection(0);
+  ThreadPool Pool(NumThreads);
+  TaskGroup Group(Pool);
+  for (unsigned I = 0; I != NumThreads; ++I)
+    Group.spawn([&] {
+      for (unsigned S = NextSection++; S < Sections.size(); S = NextSection++)
+        relaxSection(Layout, *Sections[S]);
+    });
+}
+
 void MCAssembler::finishLayout(MCAsmLayout &Layout) {
   // The layout is done. Mark every fragment as valid.
   for (unsigned int i = 0, n = Layout.getSectionOrder().size(); i != n; ++i) {
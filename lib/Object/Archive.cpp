@@ -207,6 +207,12 @@ ErrorOr<std::unique_ptr<Archive>> Archive::create(MemoryBufferRef Source) {
 
 Archive::Archive(MemoryBufferRef Source, std::error_code &ec)
     : Binary(Binary::ID_Archive, Source), SymbolTable(child_end()) {
+  parseSpecialMembers(ec);
+  if (!ec)
+    buildSymbolIndex();
+}
+
+void Archive::parseSpecialMembers(std::error_code &ec) {
   StringRef Buffer = Data.getBuffer();
   // Check for sufficient magic.
   if (Buffer.startswith(ThinMagic)) {
@@ -392,9 +398,7 @@ ErrorOr<Archive::child_iterator> Archive::Symbol::getMember() const {
                + OffsetIndex);
   }
 
-  const char *Loc = Parent->getData().begin() + Offset;
-  child_iterator Iter(Child(Parent, Loc));
-  return Iter;
+  return Parent->getChildAtOffset(Offset);
 }
 
 Archive::Symbol Archive::Symbol::getNext() const {
@@ -499,21 +503,45 @@ Archive::symbol_iterator Archive::symbol_end() const {
     Symbol(this, symbol_count, 0));
 }
 
+void Archive::buildSymbolIndex() {
+  for (symbol_iterator I = symbol_begin(), E = symbol_end(); I != E; ++I)
+    // Keep the first definition, as a walk of the symbol table would.
+    SymbolsByName.insert(std::make_pair(I->getName(), *I));
+}
+
 Archive::child_iterator Archive::findSym(StringRef name) const {
-  Archive::symbol_iterator bs = symbol_begin();
-  Archive::symbol_iterator es = symbol_end();
-
-  for (; bs != es; ++bs) {
-    StringRef SymName = bs->getName();
-    if (SymName == name) {
-      ErrorOr<Archive::child_iterator> ResultOrErr = bs->getMember();
-      // FIXME: Should we really eat the error?
-      if (ResultOrErr.getError())
-        return child_end();
-      return ResultOrErr.get();
-    }
-  }
-  return child_end();
+  auto It = SymbolsByName.find(name);
+  if (It == SymbolsByName.end())
+    return child_end();
+  ErrorOr<Archive::child_iterator> ResultOrErr = It->second.getMember();
+  // FIXME: Should we really eat the error?
+  if (ResultOrErr.getError())
+    return child_end();
+  return ResultOrErr.get();
+}
+
+ErrorOr<Archive::child_iterator>
+Archive::getChildAtOffset(uint64_t Offset) const {
+  // The member header must follow the magic and fit in the archive.
+  uint64_t BufferSize = Data.getBufferSize();
+  if (Offset < strlen(Magic) || BufferSize < sizeof(ArchiveMemberHeader) ||
+      Offset > BufferSize - sizeof(ArchiveMemberHeader))
+    return object_error::parse_failed;
+  const char *Loc = Data.getBufferStart() + Offset;
+  const auto *Header = reinterpret_cast<const ArchiveMemberHeader *>(Loc);
+  if (StringRef(Header->Terminator, sizeof(Header->Terminator)) != "`\n")
+    return object_error::parse_failed;
+
+  // So must the member itself, unless it is outside of a thin archive.
+  uint32_t Size;
+  if (StringRef(Header->Size, sizeof(Header->Size)).rtrim(" ")
+          .getAsInteger(10, Size))
+    return object_error::parse_failed;
+  StringRef Name = Header->getName();
+  if ((!IsThin || Name == "/" || Name == "//") &&
+      Size > BufferSize - Offset - sizeof(ArchiveMemberHeader))
+    return object_error::parse_failed;
+  return child_iterator(Child(this, Loc));
 }
 
 bool Archive::hasSymbolTable() const {
@@ -8,10 +8,11 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements the class that reads LLVM sample profiles. It
-// supports two file formats: text and binary. The textual representation
-// is useful for debugging and testing purposes. The binary representation
-// is more compact, resulting in smaller file sizes. However, they can
-// both be used interchangeably.
+// supports three file formats: text, binary and indexed. The textual
+// representation is useful for debugging and testing purposes. The binary
+// representation is more compact, resulting in smaller file sizes. The
+// indexed representation can be read lazily, one function at a time.
+// However, they can all be used interchangeably.
 //
 // NOTE: If you are making changes to the file format, please remember
 //       to document them in the Clang documentation at
@@ -92,9 +93,19 @@
 //    instruction that calls one of ``foo()``, ``bar()`` and ``baz()``,
 //    with ``baz()`` being the relatively more frequently called target.
 //
+// Indexed format
+// --------------
+//
+// The file starts with three little-endian 64-bit words: the magic number
+// "SPROFIDX", the version, and the offset of an on-disk chained hash table
+// mapping each function name (hashed with MD5) to its profile. The profile
+// of a function is encoded as in the binary format, without its name.
+// Only the profiles that are looked up need to be decoded.
+//
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ProfileData/SampleProfReader.h"
+#include "InstrProfIndexed.h"
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/LEB128.h"
@@ -264,62 +275,67 @@ ErrorOr<StringRef> SampleProfileReaderBinary::readString() {
   return Str;
 }
 
-std::error_code SampleProfileReaderBinary::read() {
-  while (!at_eof()) {
-    auto FName(readString());
-    if (std::error_code EC = FName.getError())
-      return EC;
+std::error_code
+SampleProfileReaderBinary::readProfile(FunctionSamples &FProfile) {
+  auto Val = readNumber<unsigned>();
+  if (std::error_code EC = Val.getError())
+    return EC;
+  FProfile.addTotalSamples(*Val);
 
-    Profiles[*FName] = FunctionSamples();
-    FunctionSamples &FProfile = Profiles[*FName];
+  Val = readNumber<unsigned>();
+  if (std::error_code EC = Val.getError())
+    return EC;
+  FProfile.addHeadSamples(*Val);
 
-    auto Val = readNumber<unsigned>();
-    if (std::error_code EC = Val.getError())
+  // Read the samples in the body.
+  auto NumRecords = readNumber<unsigned>();
+  if (std::error_code EC = NumRecords.getError())
+    return EC;
+  for (unsigned I = 0; I < *NumRecords; ++I) {
+    auto LineOffset = readNumber<uint64_t>();
+    if (std::error_code EC = LineOffset.getError())
       return EC;
-    FProfile.addTotalSamples(*Val);
 
-    Val = readNumber<unsigned>();
-    if (std::error_code EC = Val.getError())
+    auto Discriminator = readNumber<uint64_t>();
+    if (std::error_code EC = Discriminator.getError())
       return EC;
-    FProfile.addHeadSamples(*Val);
 
-    // Read the samples in the body.
-    auto NumRecords = readNumber<unsigned>();
-    if (std::error_code EC = NumRecords.getError())
+    auto NumSamples = readNumber<uint64_t>();
+    if (std::error_code EC = NumSamples.getError())
       return EC;
-    for (unsigned I = 0; I < *NumRecords; ++I) {
-      auto LineOffset = readNumber<uint64_t>();
-      if (std::error_code EC = LineOffset.getError())
-        return EC;
 
-      auto Discriminator = readNumber<uint64_t>();
-      if (std::error_code EC = Discriminator.getError())
-        return EC;
+    auto NumCalls = readNumber<unsigned>();
+    if (std::error_code EC = NumCalls.getError())
+      return EC;
 
-      auto NumSamples = readNumber<uint64_t>();
-      if (std::error_code EC = NumSamples.getError())
+    for (unsigned J = 0; J < *NumCalls; ++J) {
+      auto CalledFunction(readString());
+      if (std::error_code EC = CalledFunction.getError())
         return EC;
 
-      auto NumCalls = readNumber<unsigned>();
-      if (std::error_code EC = NumCalls.getError())
+      auto CalledFunctionSamples = readNumber<uint64_t>();
+      if (std::error_code EC = CalledFunctionSamples.getError())
         return EC;
 
-      for (unsigned J = 0; J < *NumCalls; ++J) {
-        auto CalledFunction(readString());
-        if (std::error_code EC = CalledFunction.getError())
-          return EC;
+      FProfile.addCalledTargetSamples(*LineOffset, *Discriminator,
+                                      *CalledFunction, *CalledFunctionSamples);
+    }
 
-        auto CalledFunctionSamples = readNumber<uint64_t>();
-        if (std::error_code EC = CalledFunctionSamples.getError())
-          return EC;
+    FProfile.addBodySamples(*LineOffset, *Discriminator, *NumSamples);
+  }
 
-        FProfile.addCalledTargetSamples(*LineOffset, *Discriminator,
-                                        *CalledFunction,
-                                        *CalledFunctionSamples);
-      }
+  return sampleprof_error::success;
+}
 
-      FProfile.addBodySamples(*LineOffset, *Discriminator, *NumSamples);
-    }
+std::error_code SampleProfileReaderBinary::read() {
+  while (!at_eof()) {
+    auto FName(readString());
+    if (std::error_code EC = FName.getError())
+      return EC;
+
+    Profiles[*FName] = FunctionSamples();
+    if (std::error_code EC = readProfile(Profiles[*FName]))
+      return EC;
   }
 
   return sampleprof_error::success;
@@ -353,6 +369,87 @@ bool SampleProfileReaderBinary::hasFormat(const MemoryBuffer &Buffer) {
   return Magic == SPMagic();
 }
 
+SampleProfLookupTrait::hash_value_type
+SampleProfLookupTrait::ComputeHash(StringRef K) {
+  return IndexedInstrProf::MD5Hash(K);
+}
+
+std::error_code SampleProfileReaderIndexed::readHeader() {
+  const unsigned char *Start =
+      reinterpret_cast<const unsigned char *>(Buffer->getBufferStart());
+  const unsigned char *Cur = Start;
+  uint64_t Size = Buffer->getBufferSize();
+  if (Size < 24)
+    return sampleprof_error::truncated;
+
+  using namespace support;
+
+  // Check the magic number and the version.
+  if (endian::readNext<uint64_t, little, unaligned>(Cur) != SPIndexedMagic())
+    return sampleprof_error::bad_magic;
+  if (endian::readNext<uint64_t, little, unaligned>(Cur) != SPIndexedVersion())
+    return sampleprof_error::unsupported_version;
+
+  // The hash table follows the profiles it points to.
+  uint64_t HashOffset = endian::readNext<uint64_t, little, unaligned>(Cur);
+  if (HashOffset > Size)
+    return sampleprof_error::truncated;
+  if (HashOffset < 24 || HashOffset % sizeof(uint64_t) ||
+      Size - HashOffset < 2 * sizeof(uint64_t))
+    return sampleprof_error::malformed;
+
+  // The bucket array after the bucket and entry counts must fit in the file.
+  const unsigned char *Buckets = Start + HashOffset;
+  uint64_t NumBuckets = endian::read<uint64_t, little, unaligned>(Buckets);
+  uint64_t BucketsSize = Size - HashOffset - 2 * sizeof(uint64_t);
+  if (NumBuckets > BucketsSize / sizeof(uint64_t))
+    return sampleprof_error::truncated;
+
+  Index.reset(SampleProfReaderIndex::Create(Buckets, Cur, Start));
+  return sampleprof_error::success;
+}
+
+std::error_code SampleProfileReaderIndexed::readFunction(StringRef FName,
+                                                         StringRef Data) {
+  this->Data = reinterpret_cast<const uint8_t *>(Data.begin());
+  End = reinterpret_cast<const uint8_t *>(Data.end());
+  Profiles[FName] = FunctionSamples();
+  return readProfile(Profiles[FName]);
+}
+
+std::error_code SampleProfileReaderIndexed::read() {
+  // The keys and the data are visited in the same order.
+  auto Data = Index->data_begin();
+  for (auto Key = Index->key_begin(), KeyEnd = Index->key_end(); Key != KeyEnd;
+       ++Key, ++Data)
+    if (std::error_code EC = readFunction(*Key, *Data))
+      return EC;
+  return sampleprof_error::success;
+}
+
+FunctionSamples *SampleProfileReaderIndexed::getSamplesFor(const Function &F) {
+  StringRef FName = F.getName();
+  auto Cached = Profiles.find(FName);
+  if (Cached != Profiles.end())
+    return &Cached->second;
+
+  // Decode the profile on first use. A function without a profile, or with
+  // a malformed one (which was diagnosed), gets an empty profile.
+  auto Iter = Index->find(FName);
+  if (Iter == Index->end() || readFunction(FName, *Iter))
+    Profiles[FName] = FunctionSamples();
+  return &Profiles[FName];
+}
+
+bool SampleProfileReaderIndexed::hasFormat(const MemoryBuffer &Buffer) {
+  if (Buffer.getBufferSize() < sizeof(uint64_t))
+    return false;
+  using namespace support;
+  uint64_t Magic = endian::read<uint64_t, little, unaligned>(
+      reinterpret_cast<const uint8_t *>(Buffer.getBufferStart()));
+  return Magic == SPIndexedMagic();
+}
+
 /// \brief Prepare a memory buffer for the contents of \p Filename.
 ///
 /// \returns an error code indicating the status of the buffer.
@@ -387,7 +484,9 @@ SampleProfileReader::create(StringRef Filename, LLVMContext &C) {
 
   auto Buffer = std::move(BufferOrError.get());
   std::unique_ptr<SampleProfileReader> Reader;
-  if (SampleProfileReaderBinary::hasFormat(*Buffer))
+  if (SampleProfileReaderIndexed::hasFormat(*Buffer))
+    Reader.reset(new SampleProfileReaderIndexed(std::move(Buffer), C));
+  else if (SampleProfileReaderBinary::hasFormat(*Buffer))
     Reader.reset(new SampleProfileReaderBinary(std::move(Buffer), C));
   else
     Reader.reset(new SampleProfileReaderText(std::move(Buffer), C));
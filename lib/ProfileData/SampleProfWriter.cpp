@@ -8,10 +8,11 @@
 //===----------------------------------------------------------------------===//
 //
 // This file implements the class that writes LLVM sample profiles. It
-// supports two file formats: text and binary. The textual representation
-// is useful for debugging and testing purposes. The binary representation
-// is more compact, resulting in smaller file sizes. However, they can
-// both be used interchangeably.
+// supports three file formats: text, binary and indexed. The textual
+// representation is useful for debugging and testing purposes. The binary
+// representation is more compact, resulting in smaller file sizes. The
+// indexed representation can be read lazily, one function at a time.
+// However, they can all be used interchangeably.
 //
 // See lib/ProfileData/SampleProfReader.cpp for documentation on each of the
 // supported formats.
@@ -19,11 +20,15 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/ProfileData/SampleProfWriter.h"
+#include "InstrProfIndexed.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/Support/Debug.h"
+#include "llvm/Support/EndianStream.h"
 #include "llvm/Support/ErrorOr.h"
 #include "llvm/Support/LEB128.h"
 #include "llvm/Support/LineIterator.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/OnDiskHashTable.h"
 #include "llvm/Support/Regex.h"
 
 using namespace llvm::sampleprof;
@@ -66,16 +71,8 @@ SampleProfileWriterBinary::SampleProfileWriterBinary(StringRef F,
   encodeULEB128(SPVersion(), OS);
 }
 
-/// \brief Write samples to a binary file.
-///
-/// \returns true if the samples were written successfully, false otherwise.
-bool SampleProfileWriterBinary::write(StringRef FName,
-                                      const FunctionSamples &S) {
-  if (S.empty())
-    return true;
-
-  OS << FName;
-  encodeULEB128(0, OS);
+/// \brief Encode the samples \p S of a function, without its name.
+static void encodeProfile(raw_ostream &OS, const FunctionSamples &S) {
   encodeULEB128(S.getTotalSamples(), OS);
   encodeULEB128(S.getHeadSamples(), OS);
   encodeULEB128(S.getBodySamples().size(), OS);
@@ -94,10 +91,112 @@ bool SampleProfileWriterBinary::write(StringRef FName,
       encodeULEB128(CalleeSamples, OS);
     }
   }
+}
+
+/// \brief Write samples to a binary file.
+///
+/// \returns true if the samples were written successfully, false otherwise.
+bool SampleProfileWriterBinary::write(StringRef FName,
+                                      const FunctionSamples &S) {
+  if (S.empty())
+    return true;
+
+  OS << FName;
+  encodeULEB128(0, OS);
+  encodeProfile(OS, S);
+
+  return true;
+}
+
+namespace {
+class SampleProfRecordTrait {
+public:
+  typedef StringRef key_type;
+  typedef StringRef key_type_ref;
+
+  typedef StringRef data_type;
+  typedef StringRef data_type_ref;
+
+  typedef uint64_t hash_value_type;
+  typedef uint64_t offset_type;
+
+  static hash_value_type ComputeHash(key_type_ref K) {
+    return IndexedInstrProf::MD5Hash(K);
+  }
+
+  static std::pair<offset_type, offset_type>
+  EmitKeyDataLength(raw_ostream &Out, key_type_ref K, data_type_ref V) {
+    using namespace llvm::support;
+    endian::Writer<little> LE(Out);
+    LE.write<offset_type>(K.size());
+    LE.write<offset_type>(V.size());
+    return std::make_pair(K.size(), V.size());
+  }
+
+  static void EmitKey(raw_ostream &Out, key_type_ref K, offset_type N) {
+    Out.write(K.data(), N);
+  }
+
+  static void EmitData(raw_ostream &Out, key_type_ref, data_type_ref V,
+                       offset_type N) {
+    Out.write(V.data(), N);
+  }
+};
+}
+
+/// \brief Buffer the encoded samples of a function for the index.
+///
+/// \returns true if the samples were recorded successfully.
+bool SampleProfileWriterIndexed::write(StringRef FName,
+                                       const FunctionSamples &S) {
+  if (S.empty())
+    return true;
 
+  std::string &Data = Profiles[FName];
+  Data.clear();
+  raw_string_ostream DataOS(Data);
+  encodeProfile(DataOS, S);
   return true;
 }
 
+/// \brief Write the buffered profiles, indexed by the hash table of the
+/// function names.
+///
+/// \returns an error code if the output could not be written.
+std::error_code SampleProfileWriterIndexed::write() {
+  OnDiskChainedHashTableGenerator<SampleProfRecordTrait> Generator;
+  for (const auto &I : Profiles)
+    Generator.insert(I.getKey(), I.getValue());
+
+  // The output might not be seekable, build the file in memory to fill in
+  // the offset of the hash table.
+  SmallString<4096> Buffer;
+  {
+    raw_svector_ostream BufferOS(Buffer);
+    using namespace llvm::support;
+    endian::Writer<little> LE(BufferOS);
+    LE.write<uint64_t>(SPIndexedMagic());
+    LE.write<uint64_t>(SPIndexedVersion());
+    LE.write<uint64_t>(0);
+    uint64_t HashTableStart = Generator.Emit(BufferOS);
+    BufferOS.flush();
+    endian::write<uint64_t, little, unaligned>(Buffer.data() + 16,
+                                               HashTableStart);
+  }
+  OS << Buffer;
+  return SampleProfileWriter::write();
+}
+
+std::error_code SampleProfileWriter::write() {
+  OS.flush();
+  if (OS.has_error()) {
+    // The error is reported to the caller, not by the stream destructor.
+    OS.clear_error();
+    return std::make_error_code(std::errc::io_error);
+  }
+  return sampleprof_error::success;
+}
+
 /// \brief Create a sample profile writer based on the specified format.
 ///
 /// \param Filename The file to create.
@@ -116,6 +215,8 @@ SampleProfileWriter::create(StringRef Filename, SampleProfileFormat Format) {
     Writer.reset(new SampleProfileWriterBinary(Filename, EC));
   else if (Format == SPF_Text)
     Writer.reset(new SampleProfileWriterText(Filename, EC));
+  else if (Format == SPF_Indexed)
+    Writer.reset(new SampleProfileWriterIndexed(Filename, EC));
   else
     EC = sampleprof_error::unrecognized_format;
 
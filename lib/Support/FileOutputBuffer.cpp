@@ -103,4 +103,60 @@ std::error_code FileOutputBuffer::commit() {
   // Rename file to final name.
   return sys::fs::rename(Twine(TempPath), Twine(FinalPath));
 }
+
+raw_output_buffer_ostream::raw_output_buffer_ostream(StringRef Path,
+                                                     unsigned Flags)
+    : Path(Path), Flags(Flags), Pos(0) {
+  // The data is copied to its final location as it is written, buffering it
+  // would only add a copy.
+  SetUnbuffered();
+}
+
+raw_output_buffer_ostream::~raw_output_buffer_ostream() { flush(); }
+
+void raw_output_buffer_ostream::write_impl(const char *Ptr, size_t Size) {
+  if (Buffer && Overflow.empty() && Size <= Buffer->getBufferSize() - Pos)
+    memcpy(Buffer->getBufferStart() + Pos, Ptr, Size);
+  else
+    Overflow.append(Ptr, Ptr + Size);
+  Pos += Size;
+}
+
+void raw_output_buffer_ostream::reserveExtraSpace(uint64_t ExtraSize) {
+  // The mapping cannot grow, only the first reservation is used.
+  if (Buffer || ExtraSize == 0)
+    return;
+  if (FileOutputBuffer::create(Path, Pos + ExtraSize, Buffer, Flags)) {
+    Buffer.reset();
+    return;
+  }
+  memcpy(Buffer->getBufferStart(), Overflow.data(), Overflow.size());
+  Overflow.clear();
+}
+
+std::error_code raw_output_buffer_ostream::commit() {
+  flush();
+  uint64_t InBuffer = Pos - Overflow.size();
+  if (!Buffer || !Overflow.empty() || InBuffer != Buffer->getBufferSize()) {
+    // The reservation was missing or wrong, copy everything to a buffer of
+    // the right size.
+    if (Pos == 0) {
+      std::error_code EC;
+      raw_fd_ostream OS(Path, EC, sys::fs::F_None);
+      return EC;
+    }
+    std::unique_ptr<FileOutputBuffer> Exact;
+    if (std::error_code EC = FileOutputBuffer::create(Path, Pos, Exact, Flags))
+      return EC;
+    uint8_t *Out = Exact->getBufferStart();
+    if (Buffer)
+      memcpy(Out, Buffer->getBufferStart(), InBuffer);
+    memcpy(Out + InBuffer, Overflow.data(), Overflow.size());
+    Overflow.clear();
+    Buffer = std::move(Exact);
+  }
+  std::error_code EC = Buffer->commit();
+  Buffer.reset();
+  return EC;
+}
 } // namespace
@@ -12,6 +12,8 @@
 //===----------------------------------------------------------------------===//
 
 #include "llvm/Support/Host.h"
+#include "llvm/ADT/SmallSet.h"
+#include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/ADT/StringSwitch.h"
@@ -762,6 +764,71 @@ bool sys::getHostCPUFeatures(StringMap<bool> &Features){
 }
 #endif
 
+#if defined(__linux__)
+static int computeHostNumPhysicalCores() {
+  // /proc/cpuinfo reports a zero size, so it can neither be mapped nor read
+  // with a single fixed-size read on machines with many cores. Read it as a
+  // stream until EOF instead.
+  int FD;
+  if (sys::fs::openFileForRead("/proc/cpuinfo", FD))
+    return -1;
+  SmallString<16384> Text;
+  char Chunk[4096];
+  ssize_t ReadBytes;
+  while ((ReadBytes = read(FD, Chunk, sizeof(Chunk))) > 0)
+    Text.append(Chunk, Chunk + ReadBytes);
+  close(FD);
+  if (ReadBytes < 0)
+    return -1;
+
+  SmallVector<StringRef, 128> Lines;
+  Text.str().split(Lines, "\n", -1, false);
+
+  // Count distinct (physical id, core id) pairs. Both keys appear once per
+  // logical processor, so hyperthread siblings collapse onto the same pair.
+  int CurPhysicalId = -1;
+  int CurCoreId = -1;
+  SmallSet<std::pair<int, int>, 32> UniqueItems;
+  for (StringRef Line : Lines) {
+    std::pair<StringRef, StringRef> Data = Line.split(':');
+    StringRef Name = Data.first.trim();
+    StringRef Val = Data.second.trim();
+    if (Name == "physical id")
+      Val.getAsInteger(10, CurPhysicalId);
+    else if (Name == "core id")
+      Val.getAsInteger(10, CurCoreId);
+    else
+      continue;
+    if (CurPhysicalId != -1 && CurCoreId != -1) {
+      UniqueItems.insert(std::make_pair(CurPhysicalId, CurCoreId));
+      CurPhysicalId = -1;
+      CurCoreId = -1;
+    }
+  }
+  if (UniqueItems.empty())
+    return -1;
+  return UniqueItems.size();
+}
+#elif defined(__APPLE__)
+#include <sys/types.h>
+#include <sys/sysctl.h>
+
+static int computeHostNumPhysicalCores() {
+  uint32_t Count;
+  size_t Len = sizeof(Count);
+  if (sysctlbyname("hw.physicalcpu", &Count, &Len, nullptr, 0) || Count < 1)
+    return -1;
+  return Count;
+}
+#else
+static int computeHostNumPhysicalCores() { return -1; }
+#endif
+
+int sys::getHostNumPhysicalCores() {
+  static int NumCores = computeHostNumPhysicalCores();
+  return NumCores;
+}
+
 std::string sys::getProcessTriple() {
   Triple PT(Triple::normalize(LLVM_HOST_TRIPLE));
 
@@ -0,0 +1,140 @@
+//==-- llvm/Support/ThreadPool.cpp - A ThreadPool implementation -*- C++ -*-==//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file implements a crude C++11 based thread pool.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include <cassert>
+
+using namespace llvm;
+
+ThreadPool::ThreadPool() : ThreadPool(heavyweight_hardware_concurrency()) {}
+
+#if LLVM_ENABLE_THREADS
+
+ThreadPool::ThreadPool(unsigned ThreadCount)
+    : ActiveThreads(0), EnableFlag(true),
+      ThreadCount(ThreadCount ? ThreadCount : 1) {
+  // Create ThreadCount threads that will loop forever, wait on QueueCondition
+  // for tasks to be queued or the Pool to be destroyed.
+  Threads.reserve(this->ThreadCount);
+  for (unsigned ThreadID = 0; ThreadID < this->ThreadCount; ++ThreadID)
+    Threads.emplace_back([this] { workerLoop(); });
+}
+
+void ThreadPool::workerLoop() {
+  while (true) {
+    TaskTy Task;
+    {
+      std::unique_lock<std::mutex> LockGuard(QueueLock);
+      // Wait for tasks to be pushed in the queue.
+      QueueCondition.wait(LockGuard,
+                          [&] { return !EnableFlag || !Tasks.empty(); });
+      // Exit condition.
+      if (!EnableFlag && Tasks.empty())
+        return;
+      // Yeah, we have a task, grab it and release the lock on the queue.
+      // We first need to signal that we are active before popping the queue
+      // in order for wait() to properly detect that even if the queue is
+      // empty, there is still a task in flight.
+      ++ActiveThreads;
+      Task = std::move(Tasks.front());
+      Tasks.pop();
+    }
+    // Run the task we just grabbed.
+    Task();
+
+    bool Idle;
+    {
+      std::unique_lock<std::mutex> LockGuard(QueueLock);
+      --ActiveThreads;
+      Idle = !ActiveThreads && Tasks.empty();
+    }
+    // Notify task completion, in case someone waits on ThreadPool::wait().
+    if (Idle)
+      CompletionCondition.notify_all();
+  }
+}
+
+void ThreadPool::wait() {
+  // Wait for all threads to complete and the queue to be empty.
+  std::unique_lock<std::mutex> LockGuard(QueueLock);
+  CompletionCondition.wait(LockGuard,
+                           [&] { return !ActiveThreads && Tasks.empty(); });
+}
+
+void ThreadPool::enqueue(TaskTy Task) {
+  {
+    std::unique_lock<std::mutex> LockGuard(QueueLock);
+    assert(EnableFlag && "Queuing a task during ThreadPool destruction");
+    Tasks.push(std::move(Task));
+  }
+  QueueCondition.notify_one();
+}
+
+// The destructor joins all threads, waiting for completion.
+ThreadPool::~ThreadPool() {
+  {
+    std::unique_lock<std::mutex> LockGuard(QueueLock);
+    EnableFlag = false;
+  }
+  QueueCondition.notify_all();
+  for (auto &Worker : Threads)
+    Worker.join();
+}
+
+TaskGroup::TaskGroup(ThreadPool &Pool) : Pool(Pool), Pending(0) {}
+
+void TaskGroup::spawnImpl(ThreadPool::TaskTy Task) {
+  {
+    std::unique_lock<std::mutex> LockGuard(Lock);
+    ++Pending;
+  }
+  // The group outlives every task it spawned (the destructor waits), so the
+  // task can safely refer back to it.
+  Pool.enqueue([this, Task]() {
+    Task();
+    // Notify while still holding the lock: as soon as it is released a
+    // waiter may return and destroy the group.
+    std::unique_lock<std::mutex> LockGuard(Lock);
+    if (--Pending == 0)
+      Done.notify_all();
+  });
+}
+
+void TaskGroup::wait() {
+  std::unique_lock<std::mutex> LockGuard(Lock);
+  Done.wait(LockGuard, [&] { return Pending == 0; });
+}
+
+#else // LLVM_ENABLE_THREADS Disabled
+
+// No threads are launched, tasks are run synchronously at submission time.
+ThreadPool::ThreadPool(unsigned ThreadCount) : ThreadCount(1) {
+  (void)ThreadCount;
+}
+
+void ThreadPool::wait() {}
+
+void ThreadPool::enqueue(TaskTy Task) { Task(); }
+
+ThreadPool::~ThreadPool() {}
+
+TaskGroup::TaskGroup(ThreadPool &Pool) : Pool(Pool) {}
+
+void TaskGroup::spawnImpl(ThreadPool::TaskTy Task) { Pool.enqueue(Task); }
+
+void TaskGroup::wait() {}
+
+#endif
+
+TaskGroup::~TaskGroup() { wait(); }
@@ -15,8 +15,12 @@
 #include "llvm/Support/Threading.h"
 #include "llvm/Config/config.h"
 #include "llvm/Support/Atomic.h"
+#include "llvm/Support/Host.h"
 #include "llvm/Support/Mutex.h"
 #include <cassert>
+#if LLVM_ENABLE_THREADS != 0
+#include <thread>
+#endif
 
 using namespace llvm;
 
@@ -110,3 +114,15 @@ void llvm::llvm_execute_on_thread(void (*Fn)(void*), void *UserData,
 }
 
 #endif
+
+unsigned llvm::heavyweight_hardware_concurrency() {
+#if LLVM_ENABLE_THREADS != 0
+  int NumPhysical = sys::getHostNumPhysicalCores();
+  if (NumPhysical > 0)
+    return NumPhysical;
+  unsigned NumLogical = std::thread::hardware_concurrency();
+  return NumLogical ? NumLogical : 1;
+#else
+  return 1;
+#endif
+}
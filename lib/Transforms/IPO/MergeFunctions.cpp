@@ -28,6 +28,12 @@
 // -- "FunctionPtr" instances are stored in std::set collection, so every
 //    std::set::insert operation will give you result in log(N) time.
 //
+// Each function is also given a cheap structural hash, equal for every pair of
+// functions the comparator considers equal. Functions with a unique hash are
+// never inserted in the tree, and inside the tree the hash is compared before
+// falling back to the full comparison, so only functions of the same bucket
+// are ever compared structurally.
+//
 // When a match is found the functions are folded. If both functions are
 // overridable, we move the functionality into a new internal function and
 // leave two overridable thunks to it.
@@ -84,6 +90,7 @@
 #include "llvm/Transforms/IPO.h"
 #include "llvm/ADT/DenseSet.h"
 #include "llvm/ADT/FoldingSet.h"
+#include "llvm/ADT/Hashing.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/ADT/SmallSet.h"
 #include "llvm/ADT/Statistic.h"
@@ -102,6 +109,7 @@
 #include "llvm/Support/Debug.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
 #include <vector>
 using namespace llvm;
 
@@ -111,6 +119,10 @@ STATISTIC(NumFunctionsMerged, "Number of functions merged");
 STATISTIC(NumThunksWritten, "Number of thunks generated");
 STATISTIC(NumAliasesWritten, "Number of aliases generated");
 STATISTIC(NumDoubleWeak, "Number of new functions created");
+STATISTIC(NumUniqueHashes, "Number of functions skipped for their unique hash");
+STATISTIC(NumComparisons, "Number of full function comparisons");
+STATISTIC(NumHashCollisions,
+          "Number of full comparisons of different functions with equal hash");
 
 static cl::opt<unsigned> NumFunctionsForSanityCheck(
     "mergefunc-sanity",
@@ -134,6 +146,12 @@ public:
   /// Test whether the two functions have equivalent behaviour.
   int compare();
 
+  typedef uint64_t FunctionHash;
+
+  /// Compute a hash guaranteed to be equal for two equivalent functions, but
+  /// very likely to be different for different functions.
+  static FunctionHash functionHash(const Function &F);
+
 private:
   /// Test whether two basic blocks have equivalent behaviour.
   int compare(const BasicBlock *BBL, const BasicBlock *BBR);
@@ -395,13 +413,23 @@ private:
 class FunctionNode {
   AssertingVH<Function> F;
   const DataLayout *DL;
+  FunctionComparator::FunctionHash Hash;
 
 public:
-  FunctionNode(Function *F, const DataLayout *DL) : F(F), DL(DL) {}
+  FunctionNode(Function *F, const DataLayout *DL)
+      : F(F), DL(DL), Hash(FunctionComparator::functionHash(*F)) {}
   Function *getFunc() const { return F; }
+  FunctionComparator::FunctionHash getHash() const { return Hash; }
   void release() { F = 0; }
   bool operator<(const FunctionNode &RHS) const {
-    return (FunctionComparator(DL, F, RHS.getFunc()).compare()) == -1;
+    // Order by hash first, then by the full function comparison.
+    if (Hash != RHS.Hash)
+      return Hash < RHS.Hash;
+    ++NumComparisons;
+    int Res = FunctionComparator(DL, F, RHS.getFunc()).compare();
+    if (Res != 0)
+      ++NumHashCollisions;
+    return Res == -1;
   }
 };
 }
@@ -1059,6 +1087,35 @@ int FunctionComparator::compare() {
   return 0;
 }
 
+// The hash only accounts for properties the comparator checks exactly: the
+// function signature shape, the block structure and the opcodes of the
+// instructions, visited in the same CFG order as compare(), so that
+// unreachable blocks are ignored too. Types are left out, since the comparator
+// considers some of them equivalent, and so are operand counts, since cmpGEPs
+// considers GEPs adding the same constant offset equivalent.
+FunctionComparator::FunctionHash
+FunctionComparator::functionHash(const Function &F) {
+  hash_code H = hash_combine(F.isVarArg(), F.arg_size(), F.getCallingConv());
+
+  SmallVector<const BasicBlock *, 8> BBs;
+  SmallSet<const BasicBlock *, 16> VisitedBBs;
+  BBs.push_back(&F.getEntryBlock());
+  VisitedBBs.insert(BBs[0]);
+  while (!BBs.empty()) {
+    const BasicBlock *BB = BBs.pop_back_val();
+    // A sentinel separates the blocks, so that moving instructions between
+    // blocks changes the hash.
+    H = hash_combine(H, 45798);
+    for (const Instruction &I : *BB)
+      H = hash_combine(H, I.getOpcode());
+    const TerminatorInst *Term = BB->getTerminator();
+    for (unsigned i = 0, e = Term->getNumSuccessors(); i != e; ++i)
+      if (VisitedBBs.insert(Term->getSuccessor(i)).second)
+        BBs.push_back(Term->getSuccessor(i));
+  }
+  return H;
+}
+
 namespace {
 
 /// MergeFunctions finds functions which will generate identical machine code,
@@ -1215,11 +1272,39 @@ bool MergeFunctions::runOnModule(Module &M) {
   DataLayoutPass *DLP = getAnalysisIfAvailable<DataLayoutPass>();
   DL = DLP ? &DLP->getDataLayout() : nullptr;
 
-  for (Module::iterator I = M.begin(), E = M.end(); I != E; ++I) {
-    if (!I->isDeclaration() && !I->hasAvailableExternallyLinkage())
-      Deferred.push_back(WeakVH(I));
+  // All functions are hashed up front. Only the ones sharing their hash with
+  // another function can be merged, the others need not be compared at all.
+  typedef std::pair<FunctionComparator::FunctionHash, Function *> HashedFunc;
+  std::vector<HashedFunc> HashedFuncs;
+  for (Function &F : M)
+    if (!F.isDeclaration() && !F.hasAvailableExternallyLinkage())
+      HashedFuncs.push_back(
+          std::make_pair(FunctionComparator::functionHash(F), &F));
+
+  // Sort by hash, keeping the module order inside each bucket so that the
+  // merge decisions do not depend on the function addresses.
+  std::stable_sort(HashedFuncs.begin(), HashedFuncs.end(),
+                   [](const HashedFunc &L, const HashedFunc &R) {
+                     return L.first < R.first;
+                   });
+
+  DenseSet<const Function *> Candidates;
+  for (auto I = HashedFuncs.begin(), E = HashedFuncs.end(); I != E;) {
+    auto BucketEnd = std::next(I);
+    while (BucketEnd != E && BucketEnd->first == I->first)
+      ++BucketEnd;
+    if (BucketEnd - I == 1)
+      ++NumUniqueHashes;
+    else
+      for (; I != BucketEnd; ++I)
+        Candidates.insert(I->second);
+    I = BucketEnd;
   }
 
+  for (Function &F : M)
+    if (Candidates.count(&F))
+      Deferred.push_back(WeakVH(&F));
+
   do {
     std::vector<WeakVH> Worklist;
     Deferred.swap(Worklist);
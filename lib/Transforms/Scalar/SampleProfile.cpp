@@ -744,7 +744,7 @@ bool SampleProfileLoader::doInitialization(Module &M) {
     return false;
   }
   Reader = std::move(ReaderOrErr.get());
-  ProfileIsValid = (Reader->read() == sampleprof_error::success);
+  ProfileIsValid = (Reader->readForLookups() == sampleprof_error::success);
   return true;
 }
 
@@ -33,6 +33,23 @@ Module *llvm::CloneModule(const Module *M) {
 }
 
 Module *llvm::CloneModule(const Module *M, ValueToValueMapTy &VMap) {
+  return CloneModule(M, VMap, [](const GlobalValue *GV) { return true; });
+}
+
+/// Give the clone \p New of the global object \p Old a comdat of the same
+/// name and selection kind in the destination module.
+static void cloneComdat(GlobalObject *New, const GlobalObject *Old) {
+  const Comdat *C = Old->getComdat();
+  if (!C)
+    return;
+  Comdat *NewC = New->getParent()->getOrInsertComdat(C->getName());
+  NewC->setSelectionKind(C->getSelectionKind());
+  New->setComdat(NewC);
+}
+
+Module *llvm::CloneModule(
+    const Module *M, ValueToValueMapTy &VMap,
+    std::function<bool(const GlobalValue *)> ShouldCloneDefinition) {
   // First off, we need to create the new module.
   Module *New = new Module(M->getModuleIdentifier(), M->getContext());
   New->setDataLayout(M->getDataLayout());
@@ -69,11 +86,30 @@ Module *llvm::CloneModule(const Module *M, ValueToValueMapTy &VMap) {
   for (Module::const_alias_iterator I = M->alias_begin(), E = M->alias_end();
        I != E; ++I) {
     auto *PTy = cast<PointerType>(I->getType());
-    auto *GA =
-        GlobalAlias::create(PTy->getElementType(), PTy->getAddressSpace(),
-                            I->getLinkage(), I->getName(), New);
-    GA->copyAttributesFrom(I);
-    VMap[I] = GA;
+    if (ShouldCloneDefinition(I)) {
+      auto *GA =
+          GlobalAlias::create(PTy->getElementType(), PTy->getAddressSpace(),
+                              I->getLinkage(), I->getName(), New);
+      GA->copyAttributesFrom(I);
+      VMap[I] = GA;
+      continue;
+    }
+
+    // An alias cannot act as an external reference, so we need to create
+    // either a function or a global variable depending on the value type.
+    // Attributes are not copied: copying them between different kinds of
+    // globals is not supported, and they are not needed on a declaration.
+    GlobalValue *GV;
+    if (auto *FTy = dyn_cast<FunctionType>(PTy->getElementType()))
+      GV = Function::Create(FTy, GlobalValue::ExternalLinkage, I->getName(),
+                            New);
+    else
+      GV = new GlobalVariable(*New, PTy->getElementType(), false,
+                              GlobalValue::ExternalLinkage, nullptr,
+                              I->getName(), nullptr,
+                              I->getThreadLocalMode(),
+                              PTy->getAddressSpace());
+    VMap[I] = GV;
   }
   
   // Now that all of the things that global variable initializer can refer to
@@ -82,31 +118,54 @@ Module *llvm::CloneModule(const Module *M, ValueToValueMapTy &VMap) {
   //
   for (Module::const_global_iterator I = M->global_begin(), E = M->global_end();
        I != E; ++I) {
+    if (I->isDeclaration())
+      continue;
+
     GlobalVariable *GV = cast<GlobalVariable>(VMap[I]);
+    if (!ShouldCloneDefinition(I)) {
+      // Skip after setting the correct linkage for an external reference.
+      GV->setLinkage(GlobalValue::ExternalLinkage);
+      continue;
+    }
     if (I->hasInitializer())
       GV->setInitializer(MapValue(I->getInitializer(), VMap));
+    cloneComdat(GV, I);
   }
 
   // Similarly, copy over function bodies now...
   //
   for (Module::const_iterator I = M->begin(), E = M->end(); I != E; ++I) {
+    if (I->isDeclaration())
+      continue;
+
     Function *F = cast<Function>(VMap[I]);
-    if (!I->isDeclaration()) {
-      Function::arg_iterator DestI = F->arg_begin();
-      for (Function::const_arg_iterator J = I->arg_begin(); J != I->arg_end();
-           ++J) {
-        DestI->setName(J->getName());
-        VMap[J] = DestI++;
-      }
-
-      SmallVector<ReturnInst*, 8> Returns;  // Ignore returns cloned.
-      CloneFunctionInto(F, I, VMap, /*ModuleLevelChanges=*/true, Returns);
+    if (!ShouldCloneDefinition(I)) {
+      // Skip after setting the correct linkage for an external reference.
+      F->setLinkage(GlobalValue::ExternalLinkage);
+      // Prefix and prologue data are not valid on a declaration.
+      F->setPrefixData(nullptr);
+      F->setPrologueData(nullptr);
+      continue;
     }
+
+    Function::arg_iterator DestI = F->arg_begin();
+    for (Function::const_arg_iterator J = I->arg_begin(); J != I->arg_end();
+         ++J) {
+      DestI->setName(J->getName());
+      VMap[J] = DestI++;
+    }
+
+    SmallVector<ReturnInst*, 8> Returns;  // Ignore returns cloned.
+    CloneFunctionInto(F, I, VMap, /*ModuleLevelChanges=*/true, Returns);
+    cloneComdat(F, I);
   }
 
   // And aliases
   for (Module::const_alias_iterator I = M->alias_begin(), E = M->alias_end();
        I != E; ++I) {
+    // We already dealt with undefined aliases above.
+    if (!ShouldCloneDefinition(I))
+      continue;
     GlobalAlias *GA = cast<GlobalAlias>(VMap[I]);
     if (const Constant *C = I->getAliasee())
       GA->setAliasee(MapValue(C, VMap));
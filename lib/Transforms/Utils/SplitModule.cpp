@@ -0,0 +1,210 @@
+//===- SplitModule.cpp - Split a module into partitions -------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This file defines the function llvm::SplitModule, which splits a module
+// into multiple linkable partitions. It can be used to implement parallel code
+// generation for link-time optimization.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Transforms/Utils/SplitModule.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/EquivalenceClasses.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/Analysis/CallGraph.h"
+#include "llvm/IR/Constants.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalAlias.h"
+#include "llvm/IR/GlobalObject.h"
+#include "llvm/IR/GlobalValue.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/Debug.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include <algorithm>
+#include <vector>
+
+using namespace llvm;
+
+#define DEBUG_TYPE "split-module"
+
+namespace {
+typedef EquivalenceClasses<const GlobalValue *> ClusterMapType;
+}
+
+/// Put \p GV in the same cluster as every global value of \p M that uses
+/// \p V, looking through constant expressions and aggregates.
+static void addAllGlobalValueUsers(ClusterMapType &GVtoClusterMap,
+                                   const Module &M, const GlobalValue *GV,
+                                   const Value *V) {
+  for (const User *U : V->users()) {
+    const GlobalValue *UserGV;
+    if (const Instruction *I = dyn_cast<Instruction>(U))
+      UserGV = I->getParent()->getParent();
+    else if (!(UserGV = dyn_cast<GlobalValue>(U))) {
+      // Constants are uniqued in the context: look through them to find the
+      // global values that really use GV.
+      addAllGlobalValueUsers(GVtoClusterMap, M, GV, U);
+      continue;
+    }
+    // Ignore stale users left behind in other modules of the same context.
+    if (UserGV->getParent() == &M)
+      GVtoClusterMap.unionSets(GV, UserGV);
+  }
+}
+
+/// Return a rough estimate of the code generation cost of \p GV.
+static unsigned getGlobalValueSize(const GlobalValue &GV) {
+  unsigned Size = 1;
+  if (const Function *F = dyn_cast<Function>(&GV))
+    for (const BasicBlock &BB : *F)
+      Size += BB.size();
+  return Size;
+}
+
+/// Record in \p GVtoClusterMap the global values of \p M that must end up in
+/// the same partition.
+static void findClusters(Module &M, ClusterMapType &GVtoClusterMap) {
+  DenseMap<const Comdat *, const GlobalValue *> ComdatMembers;
+  auto RecordGVSet = [&](const GlobalValue &GV) {
+    if (GV.isDeclaration())
+      return;
+    GVtoClusterMap.insert(&GV);
+
+    // Comdat groups must not be partitioned.
+    if (const Comdat *C = GV.getComdat()) {
+      auto Insert = ComdatMembers.insert(std::make_pair(C, &GV));
+      if (!Insert.second)
+        GVtoClusterMap.unionSets(Insert.first->second, &GV);
+    }
+
+    // An alias must be emitted next to the object it aliases.
+    if (const GlobalAlias *GA = dyn_cast<GlobalAlias>(&GV))
+      if (const GlobalObject *Base = GA->getBaseObject())
+        GVtoClusterMap.unionSets(GA, Base);
+
+    // A blockaddress cannot refer to a function in another partition.
+    if (const Function *F = dyn_cast<Function>(&GV))
+      for (const User *U : F->users())
+        if (isa<BlockAddress>(U))
+          addAllGlobalValueUsers(GVtoClusterMap, M, F, U);
+
+    // Keep locals with their users so that they never need to be exported.
+    if (GV.hasLocalLinkage())
+      addAllGlobalValueUsers(GVtoClusterMap, M, &GV, &GV);
+  };
+
+  for (const GlobalVariable &GV : M.globals())
+    RecordGVSet(GV);
+  for (const Function &F : M)
+    RecordGVSet(F);
+  for (const GlobalAlias &GA : M.aliases())
+    RecordGVSet(GA);
+
+  // Functions that call each other, directly or through other functions,
+  // are generated together.
+  CallGraph CG(M);
+  for (scc_iterator<CallGraph *> I = scc_begin(&CG); !I.isAtEnd(); ++I) {
+    const Function *Leader = nullptr;
+    for (const CallGraphNode *Node : *I) {
+      const Function *F = Node->getFunction();
+      if (!F || F->isDeclaration())
+        continue;
+      if (Leader)
+        GVtoClusterMap.unionSets(Leader, F);
+      else
+        Leader = F;
+    }
+  }
+}
+
+void llvm::SplitModule(
+    Module &M, unsigned N,
+    std::function<void(std::unique_ptr<Module> MPart)> ModuleCallback) {
+  assert(N > 0 && "Expected at least one partition");
+
+  // Unnamed entities must be named consistently between modules. setName will
+  // give a distinct name to each such entity.
+  for (GlobalVariable &GV : M.globals())
+    if (!GV.hasName())
+      GV.setName("__llvmsplit_unnamed");
+  for (Function &F : M)
+    if (!F.hasName())
+      F.setName("__llvmsplit_unnamed");
+  for (GlobalAlias &GA : M.aliases())
+    if (!GA.hasName())
+      GA.setName("__llvmsplit_unnamed");
+
+  ClusterMapType GVtoClusterMap;
+  findClusters(M, GVtoClusterMap);
+
+  // Number the clusters in module order, so that the result does not depend
+  // on the addresses of the global values, and compute their sizes.
+  DenseMap<const GlobalValue *, unsigned> ClusterIDs;
+  std::vector<unsigned> ClusterSizes;
+  auto VisitGV = [&](const GlobalValue &GV) {
+    if (GV.isDeclaration())
+      return;
+    const GlobalValue *Leader = GVtoClusterMap.getLeaderValue(&GV);
+    auto Insert =
+        ClusterIDs.insert(std::make_pair(Leader, ClusterSizes.size()));
+    if (Insert.second)
+      ClusterSizes.push_back(0);
+    ClusterSizes[Insert.first->second] += getGlobalValueSize(GV);
+  };
+  for (const GlobalVariable &GV : M.globals())
+    VisitGV(GV);
+  for (const Function &F : M)
+    VisitGV(F);
+  for (const GlobalAlias &GA : M.aliases())
+    VisitGV(GA);
+
+  // Hand the clusters out, largest first, to the least loaded partition.
+  std::vector<unsigned> SortedClusters(ClusterSizes.size());
+  for (unsigned I = 0, E = SortedClusters.size(); I != E; ++I)
+    SortedClusters[I] = I;
+  std::stable_sort(SortedClusters.begin(), SortedClusters.end(),
+                   [&](unsigned A, unsigned B) {
+                     return ClusterSizes[A] > ClusterSizes[B];
+                   });
+  std::vector<unsigned> ClusterPartition(ClusterSizes.size());
+  std::vector<uint64_t> PartitionSizes(N, 0);
+  for (unsigned Cluster : SortedClusters) {
+    unsigned Smallest = std::min_element(PartitionSizes.begin(),
+                                         PartitionSizes.end()) -
+                        PartitionSizes.begin();
+    ClusterPartition[Cluster] = Smallest;
+    PartitionSizes[Smallest] += ClusterSizes[Cluster];
+  }
+
+  DEBUG({
+    dbgs() << "Split " << M.getModuleIdentifier() << " into " << N
+           << " partitions from " << ClusterSizes.size() << " clusters:";
+    for (uint64_t Size : PartitionSizes)
+      dbgs() << ' ' << Size;
+    dbgs() << '\n';
+  });
+
+  auto IsInPartition = [&](const GlobalValue *GV, unsigned I) {
+    auto It = ClusterIDs.find(GVtoClusterMap.getLeaderValue(GV));
+    return It != ClusterIDs.end() && ClusterPartition[It->second] == I;
+  };
+
+  for (unsigned I = 0; I < N; ++I) {
+    ValueToValueMapTy VMap;
+    std::unique_ptr<Module> MPart(
+        CloneModule(&M, VMap, [&](const GlobalValue *GV) {
+          return IsInPartition(GV, I);
+        }));
+    if (I != 0)
+      MPart->setModuleInlineAsm("");
+    ModuleCallback(std::move(MPart));
+  }
+}
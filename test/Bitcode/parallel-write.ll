@@ -0,0 +1,65 @@
+; Check that encoding the function blocks concurrently writes the same bytes.
+; RUN: llvm-as < %s -o %t.serial.bc
+; RUN: llvm-as -bitcode-write-threads=3 < %s -o %t.parallel.bc
+; RUN: cmp %t.serial.bc %t.parallel.bc
+; RUN: llvm-as -preserve-bc-use-list-order < %s -o %t.serial.bc
+; RUN: llvm-as -preserve-bc-use-list-order -bitcode-write-threads=3 < %s \
+; RUN:     -o %t.parallel.bc
+; RUN: cmp %t.serial.bc %t.parallel.bc
+; RUN: llvm-dis < %t.parallel.bc | FileCheck %s
+
+@g = global i32 0
+@table = constant [1 x i8*] [i8* blockaddress(@branches, %bb)]
+
+; CHECK: define i32 @constants(i32 %x)
+define i32 @constants(i32 %x) {
+entry:
+  %a = add i32 %x, 42
+  %b = mul i32 %a, -7
+  %c = xor i32 %b, 1000000
+  ret i32 %c
+}
+
+; CHECK: define void @metadata(i32 %x)
+define void @metadata(i32 %x) {
+  call void @llvm.foo(metadata i32 %x)
+  store i32 %x, i32* @g, !attached !0
+  ret void
+}
+
+; CHECK: define i32 @uselists(i32 %x)
+define i32 @uselists(i32 %x) {
+  %a = add i32 %x, 1
+  %b = add i32 %x, 2
+  %c = add i32 %a, %b
+  %d = add i32 %x, %c
+  ret i32 %d
+}
+
+; CHECK: define i8* @branches(i1 %c)
+define i8* @branches(i1 %c) {
+entry:
+  br i1 %c, label %bb, label %other
+bb:
+  ret i8* blockaddress(@branches, %other)
+other:
+  ret i8* null
+}
+
+; CHECK: define void @locations()
+define void @locations() {
+  store i32 1, i32* @g, !dbg !1
+  store i32 2, i32* @g, !dbg !1
+  store i32 3, i32* @g, !dbg !2
+  ret void
+}
+
+declare void @llvm.foo(metadata)
+
+!llvm.module.flags = !{!4}
+
+!0 = !{!"attachment"}
+!1 = !MDLocation(line: 1, column: 2, scope: !3)
+!2 = !MDLocation(line: 3, column: 4, scope: !3)
+!3 = !{!"scope"}
+!4 = !{i32 1, !"Debug Info Version", i32 2}
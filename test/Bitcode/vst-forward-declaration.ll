@@ -0,0 +1,43 @@
+; Check that the module symbol table is written after the function blocks,
+; with the offset of each function block, and that a forward declaration
+; in the module block records where to find it.
+; RUN: llvm-as < %s | llvm-bcanalyzer -dump | FileCheck %s --check-prefix=BCA
+; RUN: llvm-as < %s | llvm-dis | FileCheck %s --check-prefix=DIS
+; RUN: verify-uselistorder < %s
+
+; BCA: <MODULE_BLOCK
+; BCA: <VSTOFFSET {{.*}}op0=
+; BCA: <FUNCTION_BLOCK
+; BCA: <FUNCTION_BLOCK
+; BCA: <FUNCTION_BLOCK
+; BCA: <VALUE_SYMTAB
+; The operands are the value id, the offset and the name.
+; BCA-DAG: <FNENTRY {{.*}}op0={{[0-9]+}} op1={{[0-9]+}} op2=102 op3=111 op4=111/>
+; BCA-DAG: <FNENTRY {{.*}}op0={{[0-9]+}} op1={{[0-9]+}} op2=98 op3=97 op4=114/>
+; BCA-DAG: <ENTRY {{.*}}op0={{[0-9]+}} op1=98 op2=97 op3=122/>
+; BCA-DAG: <ENTRY {{.*}}op0={{[0-9]+}} op1=103/>
+; BCA: </VALUE_SYMTAB>
+
+@g = global i32 0
+
+; DIS: define void @foo()
+define void @foo() {
+  call void @bar()
+  call void @0()
+  ret void
+}
+
+; DIS: define void @bar()
+define void @bar() {
+  store i32 1, i32* @g
+  ret void
+}
+
+; Anonymous functions are not in the symbol table and are found by
+; scanning the module block.
+; DIS: define void @0()
+define void @0() {
+  ret void
+}
+
+declare void @baz()
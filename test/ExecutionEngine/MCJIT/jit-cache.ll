@@ -0,0 +1,38 @@
+; RUN: rm -rf %t.cache
+; RUN: %lli -jit-cache-dir=%t.cache -stats %s 2>&1 | FileCheck %s -check-prefix=MISS
+; RUN: %lli -jit-cache-dir=%t.cache -stats %s 2>&1 | FileCheck %s -check-prefix=HIT
+; RUN: ls %t.cache/*.o | count 1
+
+; The key does not depend on the module identifier, a copy of the module is
+; found in the cache as well.
+; RUN: cp %s %t.copy.ll
+; RUN: %lli -jit-cache-dir=%t.cache -stats %t.copy.ll 2>&1 | FileCheck %s -check-prefix=HIT
+
+; It does depend on the code generation options.
+; RUN: %lli -jit-cache-dir=%t.cache -O0 -stats %s 2>&1 | FileCheck %s -check-prefix=MISS
+; RUN: ls %t.cache/*.o | count 2
+
+; A cache too small for two objects keeps the last one only.
+; RUN: rm -rf %t.cache
+; RUN: %lli -jit-cache-dir=%t.cache -jit-cache-size=1 -stats \
+; RUN:   -extra-module=%p/Inputs/cross-module-b.ll %p/cross-module-a.ll 2>&1 \
+; RUN:   | FileCheck %s -check-prefix=EVICT
+; RUN: ls %t.cache/*.o | count 1
+
+; REQUIRES: asserts
+
+; MISS-NOT: Number of objects loaded from the cache
+; MISS: 1 object-cache - Number of modules missing from the cache
+; MISS: 1 object-cache - Number of objects stored in the cache
+
+; HIT-NOT: Number of modules missing from the cache
+; HIT: 1 object-cache - Number of objects loaded from the cache
+; HIT-NOT: Number of objects stored in the cache
+
+; EVICT: 1 object-cache - Number of objects evicted from the cache
+; EVICT: 2 object-cache - Number of objects stored in the cache
+
+define i32 @main() {
+entry:
+  ret i32 0
+}
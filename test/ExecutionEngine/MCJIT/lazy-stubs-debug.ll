@@ -0,0 +1,24 @@
+; RUN: %lli -lazy-stubs -debug-only=mcjit %s 2>&1 | FileCheck %s
+; REQUIRES: asserts
+
+; Only the functions that are called get compiled.
+
+; CHECK: MCJIT: compiling 'main' on its first call
+; CHECK: MCJIT: compiling 'used' on its first call
+; CHECK-NOT: MCJIT: compiling
+
+define i32 @used() {
+entry:
+  ret i32 0
+}
+
+define i32 @unused() {
+entry:
+  ret i32 1
+}
+
+define i32 @main() {
+entry:
+  %r = call i32 @used()
+  ret i32 %r
+}
@@ -0,0 +1,72 @@
+; RUN: %lli -lazy-stubs %s
+
+; Every function but the variadic one goes through a stub, including the
+; internal ones. The program returns 0 if they all behave as before.
+
+@counter = internal global i32 0
+@fptr = global i32 (i32)* null
+
+define internal i32 @fib(i32 %n) {
+entry:
+  %small = icmp slt i32 %n, 2
+  br i1 %small, label %done, label %recurse
+
+recurse:
+  %a = sub i32 %n, 1
+  %fa = call i32 @fib(i32 %a)
+  %b = sub i32 %n, 2
+  %fb = call i32 @fib(i32 %b)
+  %s = add i32 %fa, %fb
+  ret i32 %s
+
+done:
+  ret i32 %n
+}
+
+define void @bump() {
+entry:
+  %v = load i32* @counter
+  %w = add i32 %v, 1
+  store i32 %w, i32* @counter
+  ret void
+}
+
+; Names the engine could have picked for its own symbols are left alone.
+define i32 @"fib.body"() {
+entry:
+  ret i32 3
+}
+
+define i32 @first(i32 %n, ...) {
+entry:
+  ret i32 %n
+}
+
+define void @never_called() {
+entry:
+  call void @abort()
+  unreachable
+}
+
+declare void @abort()
+
+define i32 @main() {
+entry:
+  store i32 (i32)* @fib, i32 (i32)** @fptr
+  call void @bump()
+  call void @bump()
+  %f = load i32 (i32)** @fptr
+  %x = call i32 %f(i32 10)
+  %c = load i32* @counter
+  %y = call i32 (i32, ...)* @first(i32 %c, i32 1)
+  %z = call i32 @"fib.body"()
+  %xy = add i32 %x, %y
+  %t = add i32 %xy, %z
+  %ok = icmp eq i32 %t, 60
+  ; The address of a function does not change once it is compiled.
+  %g = load i32 (i32)** @fptr
+  %same = icmp eq i32 (i32)* %g, @fib
+  %pass = and i1 %ok, %same
+  %ret = select i1 %pass, i32 0, i32 1
+  ret i32 %ret
+}
@@ -0,0 +1,38 @@
+; RUN: %lli -tier-up-threshold=10 %s
+; RUN: %lli -tier-up-threshold=10 -debug-only=mcjit %s 2>&1 | FileCheck %s
+; REQUIRES: asserts
+
+; Functions are compiled without optimization first, and the ones called
+; often enough are recompiled in the background. The program keeps working
+; while the calls switch to the new code.
+
+; CHECK-DAG: MCJIT: compiling 'main' on its first call
+; CHECK-DAG: MCJIT: compiling 'square' on its first call
+; CHECK-DAG: MCJIT: recompiling 'square' with optimization
+; CHECK-NOT: MCJIT: recompiling 'main'
+
+define i64 @square(i64 %x) {
+entry:
+  %r = mul i64 %x, %x
+  ret i64 %r
+}
+
+define i32 @main() {
+entry:
+  br label %loop
+
+loop:
+  %i = phi i64 [ 0, %entry ], [ %next, %loop ]
+  %sum = phi i64 [ 0, %entry ], [ %newsum, %loop ]
+  %sq = call i64 @square(i64 %i)
+  %newsum = add i64 %sum, %sq
+  %next = add i64 %i, 1
+  %done = icmp eq i64 %next, 100000
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ; The sum of the squares of 0 to 99999.
+  %ok = icmp eq i64 %newsum, 333328333350000
+  %ret = select i1 %ok, i32 0, i32 1
+  ret i32 %ret
+}
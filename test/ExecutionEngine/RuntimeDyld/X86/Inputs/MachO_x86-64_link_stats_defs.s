@@ -0,0 +1,13 @@
+        .section	__TEXT,__text,regular,pure_instructions
+	.globl	bar
+	.align	4, 0x90
+bar:
+        retq
+
+        .section	__DATA,__data
+	.globl	y
+	.align	2
+y:
+        .long   5
+
+.subsections_via_symbols
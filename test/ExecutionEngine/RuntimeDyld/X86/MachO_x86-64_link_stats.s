@@ -0,0 +1,40 @@
+# RUN: llvm-mc -triple=x86_64-apple-macosx10.9 -relocation-model=pic -filetype=obj -o %T/test_x86-64_link_stats.o %s
+# RUN: llvm-mc -triple=x86_64-apple-macosx10.9 -relocation-model=pic -filetype=obj -o %T/test_x86-64_link_stats_defs.o %p/Inputs/MachO_x86-64_link_stats_defs.s
+# RUN: llvm-rtdyld -triple=x86_64-apple-macosx10.9 -verify -check=%s -link-stats %/T/test_x86-64_link_stats.o %/T/test_x86-64_link_stats_defs.o | FileCheck %s
+
+# The symbols defined by the second object are looked up once when the first
+# object is loaded, and once when the relocations are resolved, however many
+# relocations refer to them. All the relocations referring to them are
+# applied.
+# CHECK: Symbol lookups: 4 ({{[0-9.]+}} s)
+# CHECK: Relocations: 6 ({{[0-9.]+}} s)
+
+        .section	__TEXT,__text,regular,pure_instructions
+	.globl	main
+	.align	4, 0x90
+main:
+# rtdyld-check: decode_operand(insn1, 0) = bar - next_pc(insn1)
+insn1:
+        callq	bar
+# rtdyld-check: decode_operand(insn2, 4) = y - next_pc(insn2)
+insn2:
+	movl	y(%rip), %eax
+# rtdyld-check: decode_operand(insn3, 0) = bar - next_pc(insn3)
+insn3:
+        callq	bar
+# rtdyld-check: decode_operand(insn4, 4) = y - next_pc(insn4)
+insn4:
+	movl	y(%rip), %eax
+# rtdyld-check: decode_operand(insn5, 0) = bar - next_pc(insn5)
+insn5:
+        callq	bar
+        retq
+
+        .section	__DATA,__data
+	.globl	bar_ptr
+	.align	3
+# rtdyld-check: *{8}bar_ptr = bar
+bar_ptr:
+        .quad   bar
+
+.subsections_via_symbols
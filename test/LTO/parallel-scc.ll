@@ -0,0 +1,33 @@
+; RUN: llvm-as -o %t.bc %s
+; RUN: llvm-lto -exported-symbol=even -exported-symbol=odd \
+; RUN:     -exported-symbol=other -disable-opt -disable-inlining -j2 \
+; RUN:     -o %t.o %t.bc
+; RUN: llvm-nm %t.o.0 | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-nm %t.o.1 | FileCheck --check-prefix=CHECK1 %s
+
+; Mutually recursive functions are generated in the same partition, even
+; though balancing the partitions alone would separate them.
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+; CHECK0: T even
+; CHECK0: T odd
+; CHECK1-NOT: T even
+; CHECK1-NOT: T odd
+; CHECK1: T other
+
+define i32 @even(i32 %n) {
+  %r = call i32 @odd(i32 %n)
+  ret i32 %r
+}
+
+define i32 @odd(i32 %n) {
+  %r = call i32 @even(i32 %n)
+  ret i32 %r
+}
+
+define i32 @other(i32 %n) {
+  %r = call i32 @even(i32 %n)
+  ret i32 %r
+}
@@ -0,0 +1,50 @@
+; RUN: llvm-as -o %t.bc %s
+; RUN: llvm-lto -exported-symbol=foo -exported-symbol=bar \
+; RUN:     -exported-symbol=cd1 -exported-symbol=cd2 -disable-opt \
+; RUN:     -disable-inlining -j2 -o %t.o %t.bc
+; RUN: llvm-nm %t.o.0 | FileCheck --check-prefix=CHECK0 %s
+; RUN: llvm-nm %t.o.1 | FileCheck --check-prefix=CHECK1 %s
+
+; Internal functions stay in the partition of their callers, and the two
+; members of a comdat are never separated.
+
+target datalayout = "e-m:e-i64:64-f80:128-n8:16:32:64-S128"
+target triple = "x86_64-unknown-linux-gnu"
+
+$cd = comdat any
+
+; CHECK0-NOT: bar
+; CHECK0: T foo
+; CHECK0: t helper
+; CHECK0-NOT: bar
+; CHECK1: T bar
+; CHECK1: W cd1
+; CHECK1: W cd2
+; CHECK1: U foo
+
+define void @foo() {
+  call void @helper()
+  call void @helper()
+  call void @helper()
+  call void @helper()
+  ret void
+}
+
+define internal void @helper() {
+  ret void
+}
+
+define void @bar() {
+  call void @foo()
+  call void @cd1()
+  ret void
+}
+
+define linkonce_odr void @cd1() comdat($cd) {
+  call void @cd2()
+  ret void
+}
+
+define linkonce_odr void @cd2() comdat($cd) {
+  ret void
+}
@@ -0,0 +1,21 @@
+@needed_global = global i32 1
+@unneeded_global = global i32 2
+
+define void @needed() {
+  call void @transitive()
+  ret void
+}
+
+define void @transitive() {
+  store i32 0, i32* @needed_global
+  ret void
+}
+
+define void @unneeded() {
+  store i32 0, i32* @unneeded_global
+  ret void
+}
+
+define void @rooted() {
+  ret void
+}
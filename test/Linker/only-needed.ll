@@ -0,0 +1,33 @@
+; RUN: llvm-link -S -only-needed %s %p/Inputs/only-needed.ll | FileCheck %s
+; RUN: llvm-link -S -only-needed %s %p/Inputs/only-needed.ll \
+; RUN:   | FileCheck %s --check-prefix=UNNEEDED --check-prefix=NOROOT
+; RUN: llvm-link -S -only-needed -root=rooted %s %p/Inputs/only-needed.ll \
+; RUN:   | FileCheck %s --check-prefix=CHECK --check-prefix=ROOT
+; RUN: llvm-link -S -only-needed -root=rooted %s %p/Inputs/only-needed.ll \
+; RUN:   | FileCheck %s --check-prefix=UNNEEDED
+; RUN: llvm-link -S %s %p/Inputs/only-needed.ll \
+; RUN:   | FileCheck %s --check-prefix=ALL
+
+; Only the definitions of the second file that the first one needs, directly
+; or not, are linked. The negative checks have prefixes of their own, so that
+; they apply to the whole output.
+
+; CHECK-DAG: @needed_global = global i32 1
+; CHECK-DAG: define void @main()
+; CHECK-DAG: define void @needed()
+; CHECK-DAG: define void @transitive()
+; ROOT-DAG: define void @rooted()
+
+; UNNEEDED-NOT: @unneeded
+; NOROOT-NOT: @rooted
+
+; ALL-DAG: @unneeded_global = global i32 2
+; ALL-DAG: define void @unneeded()
+; ALL-DAG: define void @rooted()
+
+declare void @needed()
+
+define void @main() {
+  call void @needed()
+  ret void
+}
@@ -0,0 +1,37 @@
+// RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu %s -o %t.stream
+// RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu -mmap-output %s \
+// RUN:   -o %t.mapped
+// RUN: cmp %t.stream %t.mapped
+// RUN: llvm-mc -filetype=obj -triple i386-pc-linux-gnu %s -o %t.stream
+// RUN: llvm-mc -filetype=obj -triple i386-pc-linux-gnu -mmap-output %s \
+// RUN:   -o %t.mapped
+// RUN: cmp %t.stream %t.mapped
+
+// Writing through a memory mapped file must produce the same object,
+// including the sections placed after the section header table.
+
+        .text
+        .globl  f
+f:
+        call    g
+        jmp     f
+        .p2align 4
+        ret
+
+        .section .text.h,"axG",@progbits,h,comdat
+        .weak   h
+h:
+        call    f
+
+        .data
+        .p2align 3
+d:
+        .long   f
+        .long   d
+
+        .bss
+        .zero   100
+
+        .comm   c,8,8
+        .section .rodata.str1.1,"aMS",@progbits,1
+        .asciz  "hello"
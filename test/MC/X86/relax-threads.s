@@ -0,0 +1,39 @@
+# RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu -mc-relax-threads=1 %s -o %t.1
+# RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu -mc-relax-threads=4 %s -o %t.4
+# RUN: cmp %t.1 %t.4
+# RUN: llvm-objdump -d %t.4 | FileCheck %s
+
+# Sections whose relaxation only depends on themselves are relaxed
+# concurrently, the others afterwards. The object must not change.
+
+# CHECK-LABEL: Disassembly of section .text.a:
+# CHECK: e9 {{.*}} jmp
+# CHECK: eb {{.*}} jmp
+# CHECK-LABEL: Disassembly of section .text.b:
+# CHECK: 0f 84 {{.*}} je
+# CHECK: 74 {{.*}} je
+
+	.section .text.a,"ax",@progbits
+a_start:
+	jmp a_far
+	jmp a_near
+a_near:
+	.fill 200, 1, 0x90
+a_far:
+	ret
+a_end:
+
+	.section .text.b,"ax",@progbits
+b_start:
+	je b_far
+	je b_near
+b_near:
+	.fill 300, 1, 0x90
+b_far:
+	.uleb128 b_far - b_start
+	ret
+
+# Refers to another section, relaxed serially.
+	.section .text.c,"ax",@progbits
+	jmp a_far
+	.uleb128 a_end - a_start
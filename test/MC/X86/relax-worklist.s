@@ -0,0 +1,35 @@
+# RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu %s -o %t
+# RUN: llvm-objdump -d %t | FileCheck %s
+# RUN: llvm-mc -filetype=obj -triple x86_64-pc-linux-gnu %s -o /dev/null \
+# RUN:   -stats 2>&1 | FileCheck %s --check-prefix=STATS
+# REQUIRES: asserts
+
+# Relaxing j2 pushes l1 out of the range of j1, which needs a second pass.
+# That pass only revisits j1, the only fragment whose range contains j2.
+# The layout step that confirms nothing changes anymore visits the 20 short
+# jumps before j1 once more, but not the two jumps which cannot grow further.
+
+# CHECK: j1:
+# CHECK-NEXT: e9 {{.*}} jmp
+# CHECK: j2:
+# CHECK-NEXT: e9 {{.*}} jmp
+
+# STATS-DAG: 2 assembler - Number of assembler layout and relaxation steps
+# STATS-DAG: 3 assembler - Number of relaxation passes over the fragments of a section
+# STATS-DAG: 43 assembler - Number of fragments visited during relaxation
+
+	.text
+	.rept 20
+	jmp 1f
+	nop
+1:
+	.endr
+j1:
+	jmp l1
+	.fill 123, 1, 0x90
+j2:
+	jmp l2
+l1:
+	.fill 130, 1, 0x90
+l2:
+	ret
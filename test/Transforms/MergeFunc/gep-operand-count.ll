@@ -0,0 +1,27 @@
+; RUN: opt -S -mergefunc < %s | FileCheck %s
+
+; The GEPs of these functions have a different number of operands but add the
+; same constant offset, so the functions are equal and must hash equal.
+
+target datalayout = "e-p:64:64:64-i1:8:8-i8:8:8-i16:16:16-i32:32:32-i64:64:64-f32:32:32-f64:64:64-v64:64:64-v128:128:128-a0:0:64-s0:64:64-f80:128:128-n8:16:32:64-S128"
+
+%S = type { i32, i32, i32 }
+
+declare void @stuff()
+
+; CHECK-LABEL: define i32* @f0(
+; CHECK: getelementptr
+define i32* @f0(%S* %s) {
+  call void @stuff()
+  %g = getelementptr %S* %s, i64 0, i32 2
+  ret i32* %g
+}
+
+; CHECK-LABEL: define i32* @f1(
+; CHECK-NOT: getelementptr
+; CHECK: tail call i32* @f0(
+define i32* @f1(i32* %p) {
+  call void @stuff()
+  %g = getelementptr i32* %p, i64 2
+  ret i32* %g
+}
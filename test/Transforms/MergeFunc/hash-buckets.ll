@@ -0,0 +1,38 @@
+; REQUIRES: asserts
+; RUN: opt -mergefunc -stats -disable-output < %s 2>&1 | FileCheck %s
+
+; Only the two functions sharing a hash are compared (once in each direction
+; by the tree) and merged. The others have a unique hash and never reach the
+; function comparator.
+
+; CHECK: 2 mergefunc - Number of full function comparisons
+; CHECK: 1 mergefunc - Number of functions merged
+; CHECK: 2 mergefunc - Number of functions skipped for their unique hash
+
+define i32 @add1(i32 %a, i32 %b) {
+  %x = add i32 %a, %b
+  %y = add i32 %x, %b
+  %z = add i32 %y, %a
+  ret i32 %z
+}
+
+define i32 @add2(i32 %a, i32 %b) {
+  %x = add i32 %a, %b
+  %y = add i32 %x, %b
+  %z = add i32 %y, %a
+  ret i32 %z
+}
+
+define i32 @mul(i32 %a, i32 %b) {
+  %x = mul i32 %a, %b
+  %y = mul i32 %x, %b
+  %z = mul i32 %y, %a
+  ret i32 %z
+}
+
+define i32 @sub(i32 %a) {
+  %x = sub i32 %a, 1
+  %y = sub i32 %x, 2
+  %z = sub i32 %y, 3
+  ret i32 %z
+}
@@ -20,6 +20,7 @@
 #include "llvm/ADT/Triple.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/CodeGen/LinkAllCodegenComponents.h"
+#include "llvm/ExecutionEngine/FileObjectCache.h"
 #include "llvm/ExecutionEngine/GenericValue.h"
 #include "llvm/ExecutionEngine/Interpreter.h"
 #include "llvm/ExecutionEngine/JITEventListener.h"
@@ -153,6 +154,18 @@ namespace {
                            "(must be user writable)"),
                   cl::init(""));
 
+  cl::opt<std::string>
+  JITCacheDir("jit-cache-dir",
+              cl::desc("Directory to share the compiled objects in, keyed by "
+                       "the contents of the modules"),
+              cl::value_desc("directory"), cl::init(""));
+
+  cl::opt<unsigned>
+  JITCacheSize("jit-cache-size",
+               cl::desc("Maximum size of the -jit-cache-dir directory, in "
+                        "kilobytes (0 = unlimited)"),
+               cl::init(512 * 1024));
+
   cl::opt<std::string>
   FakeArgv0("fake-argv0",
             cl::desc("Override the 'argv[0]' value passed into the executing"
@@ -167,6 +180,19 @@ namespace {
                   cl::desc("Disable JIT lazy compilation"),
                   cl::init(false));
 
+  cl::opt<bool>
+  LazyStubs("lazy-stubs",
+            cl::desc("Compile each function on its first call, through a "
+                     "stub"),
+            cl::init(false));
+
+  cl::opt<unsigned>
+  TierUpThreshold("tier-up-threshold",
+                  cl::desc("Compile functions without optimization first, and "
+                           "recompile them in the background after this many "
+                           "calls (implies -lazy-stubs)"),
+                  cl::init(0));
+
   cl::opt<Reloc::Model>
   RelocModel("relocation-model",
              cl::desc("Choose relocation model"),
@@ -312,6 +338,7 @@ private:
 
 static ExecutionEngine *EE = nullptr;
 static LLIObjectCache *CacheManager = nullptr;
+static FileObjectCache *JITCache = nullptr;
 
 static void do_shutdown() {
   // Cygwin-1.5 invokes DLL's dtors before atexit handler.
@@ -319,6 +346,7 @@ static void do_shutdown() {
   delete EE;
   if (CacheManager)
     delete CacheManager;
+  delete JITCache;
   llvm_shutdown();
 #endif
 }
@@ -484,6 +512,15 @@ int main(int argc, char **argv, char * const *envp) {
   if (EnableCacheManager) {
     CacheManager = new LLIObjectCache(ObjectCacheDir);
     EE->setObjectCache(CacheManager);
+  } else if (!JITCacheDir.empty()) {
+    if (EE->getTargetMachine()) {
+      JITCache = new FileObjectCache(JITCacheDir, *EE->getTargetMachine(),
+                                     uint64_t(JITCacheSize) * 1024);
+      EE->setObjectCache(JITCache);
+    } else {
+      errs() << argv[0] << ": warning: -jit-cache-dir requires MCJIT, "
+             << "ignoring it\n";
+    }
   }
 
   // Load any additional modules specified on the command line.
@@ -551,7 +588,17 @@ int main(int argc, char **argv, char * const *envp) {
     errs() << "warning: remote mcjit does not support lazy compilation\n";
     NoLazyCompilation = true;
   }
-  EE->DisableLazyCompilation(NoLazyCompilation);
+  if (TierUpThreshold && (ForceInterpreter || RemoteMCJIT)) {
+    errs() << "warning: tiered compilation requires local mcjit\n";
+    TierUpThreshold = 0;
+  }
+  // MCJIT compiles whole modules unless it is explicitly asked for stubs.
+  EE->DisableLazyCompilation(NoLazyCompilation ||
+                             (!LazyStubs && !TierUpThreshold));
+  // do_shutdown() waits for the background compilations, even if the program
+  // calls exit itself.
+  if (TierUpThreshold)
+    EE->setTieredCompilation(TierUpThreshold);
 
   // If the user specifically requested an argv[0] to pass into the program,
   // do it now.
@@ -607,6 +654,11 @@ int main(int argc, char **argv, char * const *envp) {
     // Run main.
     Result = EE->runFunctionAsMain(EntryFn, InputArgv, envp);
 
+    // Wait for the background recompilations before exit tears down the
+    // statics they use.
+    if (TierUpThreshold)
+      EE->setTieredCompilation(0);
+
     // Run static destructors.
     EE->runStaticConstructorsDestructors(true);
 
@@ -19,6 +19,7 @@
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Errc.h"
+#include "llvm/Support/FileOutputBuffer.h"
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Format.h"
 #include "llvm/Support/LineIterator.h"
@@ -27,10 +28,12 @@
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
 #include "llvm/Support/TargetSelect.h"
-#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
 #include <algorithm>
 #include <cstdlib>
+#include <cstring>
 #include <memory>
 
 #if !defined(_MSC_VER) && !defined(__MINGW32__)
@@ -44,16 +47,9 @@ using namespace llvm;
 // The name this program was invoked as.
 static StringRef ToolName;
 
-static const char *TemporaryOutput;
-static int TmpArchiveFD = -1;
-
 // Show the error message and exit.
 LLVM_ATTRIBUTE_NORETURN static void fail(Twine Error) {
   outs() << ToolName << ": " << Error << ".\n";
-  if (TmpArchiveFD != -1)
-    close(TmpArchiveFD);
-  if (TemporaryOutput)
-    sys::fs::remove(TemporaryOutput);
   exit(1);
 }
 
@@ -74,6 +70,11 @@ static cl::list<std::string>
 
 static cl::opt<bool> MRI("M", cl::desc(""));
 
+static cl::opt<unsigned>
+    NumThreads("num-threads", cl::init(0),
+               cl::desc("Number of threads reading the members to build the "
+                        "symbol table (default: one per physical core)"));
+
 std::string Options;
 
 // Provide additional help output explaining the operations and modifiers of
@@ -606,31 +607,30 @@ computeNewArchiveMembers(ArchiveOperation Operation,
 }
 
 template <typename T>
-static void printWithSpacePadding(raw_fd_ostream &OS, T Data, unsigned Size,
+static void printWithSpacePadding(raw_ostream &OS, T Data, unsigned Size,
 				  bool MayTruncate = false) {
-  uint64_t OldPos = OS.tell();
-  OS << Data;
-  unsigned SizeSoFar = OS.tell() - OldPos;
-  if (Size > SizeSoFar) {
-    unsigned Remaining = Size - SizeSoFar;
-    for (unsigned I = 0; I < Remaining; ++I)
-      OS << ' ';
-  } else if (Size < SizeSoFar) {
+  std::string Buf;
+  raw_string_ostream BufOS(Buf);
+  BufOS << Data;
+  StringRef Str = BufOS.str();
+  if (Size < Str.size()) {
     assert(MayTruncate && "Data doesn't fit in Size");
     // Some of the data this is used for (like UID) can be larger than the
     // space available in the archive format. Truncate in that case.
-    OS.seek(OldPos + Size);
+    Str = Str.substr(0, Size);
   }
+  OS << Str;
+  OS.indent(Size - Str.size());
 }
 
-static void print32BE(raw_fd_ostream &Out, unsigned Val) {
+static void print32BE(raw_ostream &Out, unsigned Val) {
   for (int I = 3; I >= 0; --I) {
     char V = (Val >> (8 * I)) & 0xff;
     Out << V;
   }
 }
 
-static void printRestOfMemberHeader(raw_fd_ostream &Out,
+static void printRestOfMemberHeader(raw_ostream &Out,
                                     const sys::TimeValue &ModTime, unsigned UID,
                                     unsigned GID, unsigned Perms,
                                     unsigned Size) {
@@ -642,14 +642,14 @@ static void printRestOfMemberHeader(raw_fd_ostream &Out,
   Out << "`\n";
 }
 
-static void printMemberHeader(raw_fd_ostream &Out, StringRef Name,
+static void printMemberHeader(raw_ostream &Out, StringRef Name,
                               const sys::TimeValue &ModTime, unsigned UID,
                               unsigned GID, unsigned Perms, unsigned Size) {
   printWithSpacePadding(Out, Twine(Name) + "/", 16);
   printRestOfMemberHeader(Out, ModTime, UID, GID, Perms, Size);
 }
 
-static void printMemberHeader(raw_fd_ostream &Out, unsigned NameOffset,
+static void printMemberHeader(raw_ostream &Out, unsigned NameOffset,
                               const sys::TimeValue &ModTime, unsigned UID,
                               unsigned GID, unsigned Perms, unsigned Size) {
   Out << '/';
@@ -657,108 +657,149 @@ static void printMemberHeader(raw_fd_ostream &Out, unsigned NameOffset,
   printRestOfMemberHeader(Out, ModTime, UID, GID, Perms, Size);
 }
 
-static void writeStringTable(raw_fd_ostream &Out,
-                             ArrayRef<NewArchiveIterator> Members,
-                             std::vector<unsigned> &StringMapIndexes) {
-  unsigned StartOffset = 0;
-  for (ArrayRef<NewArchiveIterator>::iterator I = Members.begin(),
-                                              E = Members.end();
-       I != E; ++I) {
-    StringRef Name = I->getName();
+static const unsigned MemberHeaderSize = 60;
+
+// Returns the size of a member with \p Size bytes of contents, including its
+// header and padding.
+static uint64_t getPaddedMemberSize(uint64_t Size) {
+  return MemberHeaderSize + Size + Size % 2;
+}
+
+// Fills \p Table with the contents of the string table and \p
+// StringMapIndexes with the offsets of the long member names in it.
+static void computeStringTable(ArrayRef<NewArchiveIterator> Members,
+                               std::string &Table,
+                               std::vector<unsigned> &StringMapIndexes) {
+  for (const NewArchiveIterator &Member : Members) {
+    StringRef Name = Member.getName();
     if (Name.size() < 16)
       continue;
-    if (StartOffset == 0) {
-      printWithSpacePadding(Out, "//", 58);
-      Out << "`\n";
-      StartOffset = Out.tell();
-    }
-    StringMapIndexes.push_back(Out.tell() - StartOffset);
-    Out << Name << "/\n";
+    StringMapIndexes.push_back(Table.size());
+    Table += Name;
+    Table += "/\n";
   }
-  if (StartOffset == 0)
+  if (Table.size() % 2)
+    Table += '\n';
+}
+
+static void writeStringTable(raw_ostream &Out, StringRef Table) {
+  if (Table.empty())
     return;
-  if (Out.tell() % 2)
-    Out << '\n';
-  int Pos = Out.tell();
-  Out.seek(StartOffset - 12);
-  printWithSpacePadding(Out, Pos - StartOffset, 10);
-  Out.seek(Pos);
+  printWithSpacePadding(Out, "//", 48);
+  printWithSpacePadding(Out, Table.size(), 10);
+  Out << "`\n";
+  Out << Table;
 }
 
-// Returns the offset of the first reference to a member offset.
-static unsigned writeSymbolTable(raw_fd_ostream &Out,
-                                 ArrayRef<NewArchiveIterator> Members,
-                                 ArrayRef<MemoryBufferRef> Buffers,
-                                 std::vector<unsigned> &MemberOffsetRefs) {
-  unsigned StartOffset = 0;
-  unsigned MemberNum = 0;
-  std::string NameBuf;
-  raw_string_ostream NameOS(NameBuf);
-  unsigned NumSyms = 0;
-  LLVMContext &Context = getGlobalContext();
-  for (ArrayRef<NewArchiveIterator>::iterator I = Members.begin(),
-                                              E = Members.end();
-       I != E; ++I, ++MemberNum) {
-    MemoryBufferRef MemberBuffer = Buffers[MemberNum];
-    ErrorOr<std::unique_ptr<object::SymbolicFile>> ObjOrErr =
-        object::SymbolicFile::createSymbolicFile(
-            MemberBuffer, sys::fs::file_magic::unknown, &Context);
-    if (!ObjOrErr)
-      continue;  // FIXME: check only for "not an object file" errors.
-    object::SymbolicFile &Obj = *ObjOrErr.get();
-
-    if (!StartOffset) {
-      printMemberHeader(Out, "", sys::TimeValue::now(), 0, 0, 0, 0);
-      StartOffset = Out.tell();
-      print32BE(Out, 0);
-    }
+namespace {
+// The global symbols defined by an archive member.
+struct MemberSymbols {
+  std::error_code EC;
+  // Whether the member is an object or bitcode file at all.
+  bool IsSymbolic;
+  unsigned NumSyms;
+  // The null terminated names of the symbols.
+  std::string Names;
+
+  MemberSymbols() : IsSymbolic(false), NumSyms(0) {}
+};
+}
 
-    for (const object::BasicSymbolRef &S : Obj.symbols()) {
-      uint32_t Symflags = S.getFlags();
-      if (Symflags & object::SymbolRef::SF_FormatSpecific)
-        continue;
-      if (!(Symflags & object::SymbolRef::SF_Global))
-        continue;
-      if (Symflags & object::SymbolRef::SF_Undefined)
-        continue;
-      failIfError(S.printName(NameOS));
-      NameOS << '\0';
-      ++NumSyms;
-      MemberOffsetRefs.push_back(MemberNum);
-      print32BE(Out, 0);
-    }
+static void computeMemberSymbols(MemoryBufferRef MemberBuffer,
+                                 MemberSymbols &Result) {
+  // LLVMContexts cannot be shared between threads, so bitcode members get
+  // their own.
+  LLVMContext Context;
+  ErrorOr<std::unique_ptr<object::SymbolicFile>> ObjOrErr =
+      object::SymbolicFile::createSymbolicFile(
+          MemberBuffer, sys::fs::file_magic::unknown, &Context);
+  if (!ObjOrErr)
+    return;  // FIXME: check only for "not an object file" errors.
+  object::SymbolicFile &Obj = *ObjOrErr.get();
+  Result.IsSymbolic = true;
+
+  raw_string_ostream NameOS(Result.Names);
+  for (const object::BasicSymbolRef &S : Obj.symbols()) {
+    uint32_t Symflags = S.getFlags();
+    if (Symflags & object::SymbolRef::SF_FormatSpecific)
+      continue;
+    if (!(Symflags & object::SymbolRef::SF_Global))
+      continue;
+    if (Symflags & object::SymbolRef::SF_Undefined)
+      continue;
+    if ((Result.EC = S.printName(NameOS)))
+      return;
+    NameOS << '\0';
+    ++Result.NumSyms;
   }
-  Out << NameOS.str();
+  NameOS.flush();
+}
 
-  if (StartOffset == 0)
-    return 0;
+// Opening the members as object files dominates the time it takes to build
+// the symbol table, so it is done in parallel. The results are kept per
+// member and consumed in member order, which makes the table independent of
+// the number of threads.
+static void computeSymbols(ArrayRef<MemoryBufferRef> Buffers,
+                           std::vector<MemberSymbols> &Symbols) {
+  Symbols.resize(Buffers.size());
+  {
+    ThreadPool Pool(NumThreads ? NumThreads
+                               : heavyweight_hardware_concurrency());
+    TaskGroup Group(Pool);
+    for (unsigned I = 0, E = Buffers.size(); I != E; ++I)
+      Group.spawn([I, &Buffers, &Symbols] {
+        computeMemberSymbols(Buffers[I], Symbols[I]);
+      });
+  }
+  for (const MemberSymbols &MS : Symbols)
+    failIfError(MS.EC);
+}
 
-  if (Out.tell() % 2)
-    Out << '\0';
+// Returns the size of the symbol table of \p Symbols, or 0 if none of the
+// members is an object file.
+static uint64_t getSymbolTableSize(ArrayRef<MemberSymbols> Symbols) {
+  bool HasObject = false;
+  uint64_t Size = 4;
+  for (const MemberSymbols &MS : Symbols) {
+    HasObject |= MS.IsSymbolic;
+    Size += 4 * MS.NumSyms + MS.Names.size();
+  }
+  if (!HasObject)
+    return 0;
+  return getPaddedMemberSize(Size);
+}
 
-  unsigned Pos = Out.tell();
-  Out.seek(StartOffset - 12);
-  printWithSpacePadding(Out, Pos - StartOffset, 10);
-  Out.seek(StartOffset);
+static void writeSymbolTable(raw_ostream &Out, uint64_t SymbolTableSize,
+                             ArrayRef<MemberSymbols> Symbols,
+                             ArrayRef<uint64_t> MemberOffsets) {
+  if (!SymbolTableSize)
+    return;
+  // The symbol table gets no timestamp so that archiving the same members
+  // twice produces the same bytes.
+  printMemberHeader(Out, "", sys::TimeValue::PosixZeroTime(), 0, 0, 0,
+                    SymbolTableSize - MemberHeaderSize);
+  unsigned NumSyms = 0;
+  uint64_t NamesSize = 0;
+  for (const MemberSymbols &MS : Symbols) {
+    NumSyms += MS.NumSyms;
+    NamesSize += MS.Names.size();
+  }
   print32BE(Out, NumSyms);
-  Out.seek(Pos);
-  return StartOffset + 4;
+  for (unsigned I = 0, E = Symbols.size(); I != E; ++I)
+    for (unsigned J = 0; J != Symbols[I].NumSyms; ++J)
+      print32BE(Out, MemberOffsets[I]);
+  for (const MemberSymbols &MS : Symbols)
+    Out << MS.Names;
+  if (NamesSize % 2)
+    Out << '\0';
 }
 
+// Write the archive through a FileOutputBuffer. Its layout is computed
+// up-front, so that each member can be copied straight from its mapped input
+// to its final position.
 static void
 performWriteOperation(ArchiveOperation Operation, object::Archive *OldArchive,
                       std::vector<NewArchiveIterator> &NewMembers) {
-  SmallString<128> TmpArchive;
-  failIfError(sys::fs::createUniqueFile(ArchiveName + ".temp-archive-%%%%%%%.a",
-                                        TmpArchiveFD, TmpArchive));
-
-  TemporaryOutput = TmpArchive.c_str();
-  tool_output_file Output(TemporaryOutput, TmpArchiveFD);
-  raw_fd_ostream &Out = Output.os();
-  Out << "!<arch>\n";
-
-  std::vector<unsigned> MemberOffsetRefs;
-
   std::vector<std::unique_ptr<MemoryBuffer>> Buffers;
   std::vector<MemoryBufferRef> Members;
   std::vector<sys::fs::file_status> NewMemberStatus;
@@ -789,29 +830,48 @@ performWriteOperation(ArchiveOperation Operation, object::Archive *OldArchive,
     Members.push_back(MemberRef);
   }
 
-  unsigned MemberReferenceOffset = 0;
+  std::vector<MemberSymbols> Symbols;
+  uint64_t SymbolTableSize = 0;
   if (Symtab) {
-    MemberReferenceOffset =
-        writeSymbolTable(Out, NewMembers, Members, MemberOffsetRefs);
+    computeSymbols(Members, Symbols);
+    SymbolTableSize = getSymbolTableSize(Symbols);
   }
 
+  std::string StringTable;
   std::vector<unsigned> StringMapIndexes;
-  writeStringTable(Out, NewMembers, StringMapIndexes);
+  computeStringTable(NewMembers, StringTable, StringMapIndexes);
+
+  uint64_t Offset = 8 + SymbolTableSize;
+  if (!StringTable.empty())
+    Offset += getPaddedMemberSize(StringTable.size());
+  std::vector<uint64_t> MemberOffsets;
+  for (MemoryBufferRef File : Members) {
+    MemberOffsets.push_back(Offset);
+    Offset += getPaddedMemberSize(File.getBufferSize());
+  }
 
-  unsigned MemberNum = 0;
-  unsigned LongNameMemberNum = 0;
-  unsigned NewMemberNum = 0;
-  std::vector<unsigned> MemberOffset;
-  for (std::vector<NewArchiveIterator>::iterator I = NewMembers.begin(),
-                                                 E = NewMembers.end();
-       I != E; ++I, ++MemberNum) {
+  std::unique_ptr<FileOutputBuffer> Output;
+  failIfError(FileOutputBuffer::create(ArchiveName, Offset, Output),
+              ArchiveName);
+  char *Buf = reinterpret_cast<char *>(Output->getBufferStart());
 
-    unsigned Pos = Out.tell();
-    MemberOffset.push_back(Pos);
+  std::string Head;
+  raw_string_ostream HeadOS(Head);
+  HeadOS << "!<arch>\n";
+  writeSymbolTable(HeadOS, SymbolTableSize, Symbols, MemberOffsets);
+  writeStringTable(HeadOS, StringTable);
+  HeadOS.flush();
+  memcpy(Buf, Head.data(), Head.size());
 
-    MemoryBufferRef File = Members[MemberNum];
-    if (I->isNewMember()) {
-      StringRef FileName = I->getNew();
+  unsigned LongNameMemberNum = 0;
+  unsigned NewMemberNum = 0;
+  for (unsigned MemberNum = 0, N = NewMembers.size(); MemberNum != N;
+       ++MemberNum) {
+    const NewArchiveIterator &Member = NewMembers[MemberNum];
+    std::string Header;
+    raw_string_ostream Out(Header);
+    if (Member.isNewMember()) {
+      StringRef FileName = Member.getNew();
       const sys::fs::file_status &Status = NewMemberStatus[NewMemberNum];
       NewMemberNum++;
 
@@ -826,8 +886,8 @@ performWriteOperation(ArchiveOperation Operation, object::Archive *OldArchive,
                           Status.getGroup(), Status.permissions(),
                           Status.getSize());
     } else {
-      object::Archive::child_iterator OldMember = I->getOld();
-      StringRef Name = I->getName();
+      object::Archive::child_iterator OldMember = Member.getOld();
+      StringRef Name = Member.getName();
 
       if (Name.size() < 16)
         printMemberHeader(Out, Name, OldMember->getLastModified(),
@@ -839,23 +899,19 @@ performWriteOperation(ArchiveOperation Operation, object::Archive *OldArchive,
                           OldMember->getGID(), OldMember->getAccessMode(),
                           OldMember->getSize());
     }
-
-    Out << File.getBuffer();
-
-    if (Out.tell() % 2)
-      Out << '\n';
-  }
-
-  if (MemberReferenceOffset) {
-    Out.seek(MemberReferenceOffset);
-    for (unsigned MemberNum : MemberOffsetRefs)
-      print32BE(Out, MemberOffset[MemberNum]);
+    Out.flush();
+    assert(Header.size() == MemberHeaderSize && "Bad member header size");
+
+    StringRef File = Members[MemberNum].getBuffer();
+    char *P = Buf + MemberOffsets[MemberNum];
+    memcpy(P, Header.data(), MemberHeaderSize);
+    P += MemberHeaderSize;
+    memcpy(P, File.data(), File.size());
+    if (File.size() % 2)
+      P[File.size()] = '\n';
   }
 
-  Output.keep();
-  Out.close();
-  sys::fs::rename(TemporaryOutput, ArchiveName);
-  TemporaryOutput = nullptr;
+  failIfError(Output->commit(), ArchiveName);
 }
 
 static void
@@ -158,6 +158,7 @@ static const char *GetCodeName(unsigned CodeID, unsigned BlockID,
     case bitc::MODULE_CODE_ALIAS:       return "ALIAS";
     case bitc::MODULE_CODE_PURGEVALS:   return "PURGEVALS";
     case bitc::MODULE_CODE_GCNAME:      return "GCNAME";
+    case bitc::MODULE_CODE_VSTOFFSET:   return "VSTOFFSET";
     }
   case bitc::PARAMATTR_BLOCK_ID:
     switch (CodeID) {
@@ -254,6 +255,7 @@ static const char *GetCodeName(unsigned CodeID, unsigned BlockID,
     default: return nullptr;
     case bitc::VST_CODE_ENTRY: return "ENTRY";
     case bitc::VST_CODE_BBENTRY: return "BBENTRY";
+    case bitc::VST_CODE_FNENTRY: return "FNENTRY";
     }
   case bitc::METADATA_ATTACHMENT_ID:
     switch(CodeID) {
@@ -53,6 +53,17 @@ Verbose("v", cl::desc("Print information about actions taken"));
 static cl::opt<bool>
 DumpAsm("d", cl::desc("Print assembly as linked"), cl::Hidden);
 
+static cl::opt<bool>
+OnlyNeeded("only-needed",
+           cl::desc("Link all of the first file, but only the definitions of "
+                    "the later files that are referenced by the files before "
+                    "them"));
+
+static cl::list<std::string>
+Roots("root", cl::desc("Link this symbol with -only-needed, even if nothing "
+                       "references it"),
+      cl::value_desc("symbol"));
+
 static cl::opt<bool>
 SuppressWarnings("suppress-warnings", cl::desc("Suppress all linking warnings"),
                  cl::init(false));
@@ -113,7 +124,16 @@ int main(int argc, char **argv) {
 
     if (Verbose) errs() << "Linking in '" << InputFilenames[i] << "'\n";
 
-    if (L.linkInModule(M.get()))
+    unsigned Flags = Linker::None;
+    std::vector<const GlobalValue *> RootValues;
+    if (OnlyNeeded && i != 0) {
+      Flags |= Linker::LinkOnlyNeeded;
+      for (const std::string &Root : Roots)
+        if (const GlobalValue *GV = M->getNamedValue(Root))
+          RootValues.push_back(GV);
+    }
+
+    if (L.linkInModule(M.get(), Flags, RootValues))
       return 1;
   }
 
@@ -12,6 +12,7 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringSet.h"
 #include "llvm/CodeGen/CommandFlags.h"
 #include "llvm/LTO/LTOCodeGenerator.h"
@@ -65,6 +66,12 @@ DSOSymbols("dso-symbol",
   cl::desc("Symbol to put in the symtab in the resulting dso"),
   cl::ZeroOrMore);
 
+static cl::opt<unsigned> Parallelism(
+    "j", cl::Prefix, cl::init(1),
+    cl::desc("Split the merged module into this many partitions and generate "
+             "code for them in parallel; with -o, partition N is written to "
+             "<filename>.N"));
+
 static cl::opt<bool> ListSymbolsOnly(
     "list-symbols-only", cl::init(false),
     cl::desc("Instead of running LTO, list the symbols in each IR file"));
@@ -227,6 +234,12 @@ int main(int argc, char **argv) {
   if (!attrs.empty())
     CodeGen.setAttr(attrs.c_str());
 
+  if (Parallelism > 1 && OutputFilename.empty()) {
+    errs() << argv[0] << ": -j requires an output filename (-o)\n";
+    return 1;
+  }
+  CodeGen.setCodeGenParallelism(Parallelism);
+
   if (!OutputFilename.empty()) {
     size_t len = 0;
     std::string ErrorInfo;
@@ -239,15 +252,22 @@ int main(int argc, char **argv) {
       return 1;
     }
 
-    std::error_code EC;
-    raw_fd_ostream FileStream(OutputFilename, EC, sys::fs::F_None);
-    if (EC) {
-      errs() << argv[0] << ": error opening the file '" << OutputFilename
-             << "': " << EC.message() << "\n";
-      return 1;
+    for (unsigned I = 0, E = CodeGen.getNumObjects(); I != E; ++I) {
+      std::string PartFilename = OutputFilename;
+      if (E > 1)
+        PartFilename += "." + utostr(I);
+      Code = CodeGen.getObject(I, &len);
+
+      std::error_code EC;
+      raw_fd_ostream FileStream(PartFilename, EC, sys::fs::F_None);
+      if (EC) {
+        errs() << argv[0] << ": error opening the file '" << PartFilename
+               << "': " << EC.message() << "\n";
+        return 1;
+      }
+
+      FileStream.write(reinterpret_cast<const char *>(Code), len);
     }
-
-    FileStream.write(reinterpret_cast<const char *>(Code), len);
   } else {
     std::string ErrorInfo;
     const char *OutputName = nullptr;
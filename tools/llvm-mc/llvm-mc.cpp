@@ -28,6 +28,7 @@
 #include "llvm/MC/MCTargetOptionsCommandFlags.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/Compression.h"
+#include "llvm/Support/FileOutputBuffer.h"
 #include "llvm/Support/FileUtilities.h"
 #include "llvm/Support/FormattedStream.h"
 #include "llvm/Support/Host.h"
@@ -164,6 +165,10 @@ static cl::opt<bool> SaveTempLabels("save-temp-labels",
 static cl::opt<bool> NoExecStack("no-exec-stack",
                                  cl::desc("File doesn't need an exec stack"));
 
+static cl::opt<bool>
+MMapOutput("mmap-output",
+           cl::desc("Write object files through a memory mapped file"));
+
 enum ActionType {
   AC_AsLex,
   AC_Assemble,
@@ -439,6 +444,7 @@ int main(int argc, char **argv) {
     return 1;
 
   formatted_raw_ostream FOS(Out->os());
+  std::unique_ptr<raw_output_buffer_ostream> BufferOS;
   std::unique_ptr<MCStreamer> Str;
 
   std::unique_ptr<MCInstrInfo> MCII(TheTarget->createMCInstrInfo());
@@ -470,7 +476,12 @@ int main(int argc, char **argv) {
     assert(FileType == OFT_ObjectFile && "Invalid file type!");
     MCCodeEmitter *CE = TheTarget->createMCCodeEmitter(*MCII, *MRI, *STI, Ctx);
     MCAsmBackend *MAB = TheTarget->createMCAsmBackend(*MRI, TripleName, MCPU);
-    Str.reset(TheTarget->createMCObjectStreamer(TripleName, Ctx, *MAB, FOS, CE,
+    raw_ostream *OS = &FOS;
+    if (MMapOutput && OutputFilename != "-") {
+      BufferOS.reset(new raw_output_buffer_ostream(OutputFilename));
+      OS = BufferOS.get();
+    }
+    Str.reset(TheTarget->createMCObjectStreamer(TripleName, Ctx, *MAB, *OS, CE,
                                                 *STI, RelaxAll));
     if (NoExecStack)
       Str->InitSections(true);
@@ -499,6 +510,17 @@ int main(int argc, char **argv) {
     Res = Disassembler::disassemble(*TheTarget, TripleName, *STI, *Str,
                                     *Buffer, SrcMgr, Out->os());
 
+  if (BufferOS && Res == 0) {
+    // Close the file opened for the other kinds of output before it is
+    // replaced.
+    Out->os().close();
+    if (std::error_code EC = BufferOS->commit()) {
+      errs() << ProgName << ": " << OutputFilename << ": " << EC.message()
+             << '\n';
+      Res = 1;
+    }
+  }
+
   // Keep output if no errors.
   if (Res == 0) Out->keep();
   return Res;
@@ -24,7 +24,13 @@
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/PrettyStackTrace.h"
 #include "llvm/Support/Signals.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <future>
+#include <memory>
+#include <vector>
 
 using namespace llvm;
 
@@ -38,8 +44,42 @@ static void exitWithError(const Twine &Message, StringRef Whence = "") {
 
 enum ProfileKinds { instr, sample };
 
+namespace {
+/// A function record read from an input, owning its name and counts.
+struct LoadedRecord {
+  std::string Name;
+  uint64_t Hash;
+  std::vector<uint64_t> Counts;
+};
+
+/// The records of one input, in the order they were read.
+struct LoadedInput {
+  std::vector<LoadedRecord> Records;
+  /// The error that stopped the reading of the input, if any.
+  std::error_code Err;
+};
+}
+
+/// Read all the records of \p Filename into \p LI.
+static void loadInput(StringRef Filename, LoadedInput &LI) {
+  auto ReaderOrErr = InstrProfReader::create(Filename);
+  if ((LI.Err = ReaderOrErr.getError()))
+    return;
+
+  auto Reader = std::move(ReaderOrErr.get());
+  for (const auto &I : *Reader) {
+    LoadedRecord R;
+    R.Name = I.Name;
+    R.Hash = I.Hash;
+    R.Counts.assign(I.Counts.begin(), I.Counts.end());
+    LI.Records.push_back(std::move(R));
+  }
+  if (Reader->hasError())
+    LI.Err = Reader->getError();
+}
+
 void mergeInstrProfile(const cl::list<std::string> &Inputs,
-                       StringRef OutputFilename) {
+                       StringRef OutputFilename, unsigned NumThreads) {
   if (OutputFilename.compare("-") == 0)
     exitWithError("Cannot write indexed profdata format to stdout.");
 
@@ -48,19 +88,44 @@ void mergeInstrProfile(const cl::list<std::string> &Inputs,
   if (EC)
     exitWithError(EC.message(), OutputFilename);
 
-  InstrProfWriter Writer;
-  for (const auto &Filename : Inputs) {
-    auto ReaderOrErr = InstrProfReader::create(Filename);
-    if (std::error_code ec = ReaderOrErr.getError())
-      exitWithError(ec.message(), Filename);
+  // The inputs are read concurrently, but their records are added to the
+  // writer on this thread in input order. Which occurrence of a function wins
+  // on a count mismatch or an overflow, and the diagnostics, are thus the
+  // same whatever the number of threads. At most two inputs per thread are
+  // held in memory at a time.
+  if (NumThreads == 0)
+    NumThreads = heavyweight_hardware_concurrency();
+  NumThreads = std::max(1U, std::min<unsigned>(NumThreads, Inputs.size()));
+  size_t Window = 2 * NumThreads;
+
+  std::vector<std::unique_ptr<LoadedInput>> Loaded(Inputs.size());
+  std::vector<std::shared_future<void>> Done(Inputs.size());
+  ThreadPool Pool(NumThreads);
+  auto Schedule = [&](size_t I) {
+    Loaded[I].reset(new LoadedInput());
+    LoadedInput *LI = Loaded[I].get();
+    StringRef Filename = Inputs[I];
+    Done[I] = Pool.async([LI, Filename] { loadInput(Filename, *LI); });
+  };
+  for (size_t I = 0, E = std::min(Window, Inputs.size()); I != E; ++I)
+    Schedule(I);
 
-    auto Reader = std::move(ReaderOrErr.get());
-    for (const auto &I : *Reader)
+  InstrProfWriter Writer;
+  for (size_t I = 0, E = Inputs.size(); I != E; ++I) {
+    Done[I].wait();
+    LoadedInput &LI = *Loaded[I];
+    for (const LoadedRecord &R : LI.Records)
       if (std::error_code EC =
-              Writer.addFunctionCounts(I.Name, I.Hash, I.Counts))
-        errs() << Filename << ": " << I.Name << ": " << EC.message() << "\n";
-    if (Reader->hasError())
-      exitWithError(Reader->getError().message(), Filename);
+              Writer.addFunctionCounts(R.Name, R.Hash, R.Counts))
+        errs() << Inputs[I] << ": " << R.Name << ": " << EC.message() << "\n";
+    if (LI.Err) {
+      // Let the pending reads finish before exiting.
+      Pool.wait();
+      exitWithError(LI.Err.message(), Inputs[I]);
+    }
+    Loaded[I].reset();
+    if (I + Window < E)
+      Schedule(I + Window);
   }
   Writer.write(Output);
 }
@@ -95,6 +160,8 @@ void mergeSampleProfile(const cl::list<std::string> &Inputs,
     }
   }
   Writer->write(ProfileMap);
+  if (std::error_code EC = Writer->write())
+    exitWithError(EC.message(), OutputFilename);
 }
 
 int merge_main(int argc, const char *argv[]) {
@@ -118,12 +185,21 @@ int merge_main(int argc, const char *argv[]) {
                             "Binary encoding (default)"),
                  clEnumValN(sampleprof::SPF_Text, "text", "Text encoding"),
                  clEnumValN(sampleprof::SPF_GCC, "gcc", "GCC encoding"),
+                 clEnumValN(sampleprof::SPF_Indexed, "indexed",
+                            "Indexed binary encoding, read lazily"),
                  clEnumValEnd));
 
+  cl::opt<unsigned> NumThreads(
+      "num-threads", cl::init(0),
+      cl::desc("Number of threads merging instrumentation profiles "
+               "(default: one per physical core)"));
+  cl::alias NumThreadsA("j", cl::desc("Alias for --num-threads"),
+                        cl::aliasopt(NumThreads));
+
   cl::ParseCommandLineOptions(argc, argv, "LLVM profile data merger\n");
 
   if (ProfileKind == instr)
-    mergeInstrProfile(Inputs, OutputFilename);
+    mergeInstrProfile(Inputs, OutputFilename, NumThreads);
   else
     mergeSampleProfile(Inputs, OutputFilename, OutputFormat);
 
@@ -24,6 +24,7 @@
 #include "llvm/Object/MachO.h"
 #include "llvm/Support/CommandLine.h"
 #include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/ManagedStatic.h"
 #include "llvm/Support/Memory.h"
 #include "llvm/Support/MemoryBuffer.h"
@@ -102,6 +103,12 @@ SpecificSectionMappings("map-section",
                         cl::desc("Map a section to a specific address."),
                         cl::ZeroOrMore);
 
+static cl::opt<bool>
+PrintLinkStats("link-stats",
+               cl::desc("Print the number of symbol lookups and relocations, "
+                        "and the time spent on them."),
+               cl::init(false));
+
 /* *** */
 
 // A trivial memory manager that doesn't do anything fancy, just uses the
@@ -258,6 +265,14 @@ static int printLineInfoForInput() {
   return 0;
 }
 
+static void printLinkStatistics(const RuntimeDyld &Dyld) {
+  RuntimeDyld::Statistics Stats = Dyld.getStatistics();
+  outs() << "Symbol lookups: " << Stats.NumSymbolLookups << " ("
+         << format("%.6f", Stats.SymbolLookupTime) << " s)\n"
+         << "Relocations: " << Stats.NumRelocations << " ("
+         << format("%.6f", Stats.RelocationTime) << " s)\n";
+}
+
 static int executeInput() {
   // Load any dylibs requested on the command line.
   loadDylibs();
@@ -292,6 +307,8 @@ static int executeInput() {
 
   // Resolve all the relocations we can.
   Dyld.resolveRelocations();
+  if (PrintLinkStats)
+    printLinkStatistics(Dyld);
   // Clear instruction cache before code will be executed.
   MemMgr.invalidateInstructionCache();
 
@@ -549,6 +566,8 @@ static int linkAndVerify() {
 
   // Resolve all the relocations we can.
   Dyld.resolveRelocations();
+  if (PrintLinkStats)
+    printLinkStatistics(Dyld);
 
   // Register EH frames.
   Dyld.registerEHFrames();
@@ -0,0 +1,259 @@
+//===-- AddressIndex.cpp --------------------------------------------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Implementation of the persistent address index used by the symbolizer.
+//
+//===----------------------------------------------------------------------===//
+
+#include "AddressIndex.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Object/MachO.h"
+#include "llvm/Support/DataExtractor.h"
+#include "llvm/Support/EndianStream.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MathExtras.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#define DEBUG_TYPE "address-index"
+
+STATISTIC(NumIndexesBuilt, "Number of address indexes built");
+STATISTIC(NumIndexesReused, "Number of address indexes reused");
+STATISTIC(NumIndexedLookups,
+          "Number of compile units found through an address index");
+
+namespace llvm {
+namespace symbolize {
+
+using namespace support;
+
+static const char IndexMagic[] = {'L', 'L', 'V', 'M', 'A', 'I', 'D', 'X'};
+static const uint32_t IndexVersion = 1;
+static const size_t EntrySize = 8 + 8 + 4;
+
+/// Size of the header for a build ID of \p BuildIDSize bytes.
+static uint64_t getHeaderSize(uint64_t BuildIDSize) {
+  return sizeof(IndexMagic) + 4 + 4 + 8 + 8 + 8 +
+         RoundUpToAlignment(BuildIDSize, 8);
+}
+
+/// Get the build ID of an ELF file from its .note.gnu.build-id section, or the
+/// UUID of a Mach-O file. Returns an empty ID for other formats.
+static ArrayRef<uint8_t> getBuildID(const object::ObjectFile &Obj) {
+  if (const auto *MachO = dyn_cast<object::MachOObjectFile>(&Obj))
+    return MachO->getUuid();
+  if (!Obj.isELF())
+    return ArrayRef<uint8_t>();
+  for (const object::SectionRef &Section : Obj.sections()) {
+    StringRef Name;
+    if (Section.getName(Name) || Name != ".note.gnu.build-id")
+      continue;
+    StringRef Data;
+    if (Section.getContents(Data))
+      break;
+    // The note is made of its name and descriptor sizes, its type, and the
+    // name and the descriptor themselves, each padded to 4 bytes.
+    DataExtractor DE(Data, Obj.isLittleEndian(), 0);
+    uint32_t Offset = 0;
+    uint32_t NameSize = DE.getU32(&Offset);
+    uint32_t DescSize = DE.getU32(&Offset);
+    DE.getU32(&Offset); // Note type.
+    Offset += RoundUpToAlignment(NameSize, 4);
+    if (!DE.isValidOffsetForDataOfSize(Offset, DescSize))
+      break;
+    return ArrayRef<uint8_t>(Data.bytes_begin() + Offset, DescSize);
+  }
+  return ArrayRef<uint8_t>();
+}
+
+/// Name the index file after the build ID if there is one, else after the
+/// MD5 of the path of the binary and of the arch, which is stable across runs
+/// and builds of the symbolizer. A binary and its separate debug file have the
+/// same build ID but different debug info, so the latter is told apart by a
+/// suffix.
+static std::string getIndexName(const object::ObjectFile &Obj,
+                                ArrayRef<uint8_t> BuildID, StringRef ArchName,
+                                bool IsDebugFile) {
+  std::string Name;
+  if (!BuildID.empty()) {
+    for (uint8_t Byte : BuildID) {
+      Name += hexdigit(Byte >> 4, /*LowerCase=*/true);
+      Name += hexdigit(Byte & 0xf, /*LowerCase=*/true);
+    }
+    if (IsDebugFile)
+      Name += ".debug";
+  } else {
+    SmallString<128> Path(Obj.getFileName());
+    sys::fs::make_absolute(Path);
+    MD5 Hash;
+    Hash.update(Path.str());
+    Hash.update(StringRef("\0", 1));
+    Hash.update(ArchName);
+    MD5::MD5Result Result;
+    Hash.final(Result);
+    SmallString<32> Hex;
+    MD5::stringifyResult(Result, Hex);
+    Name = Hex.str();
+  }
+  return Name + ".aidx";
+}
+
+/// Map the index at \p Path into \p Buf, checking that it matches the given
+/// key. Returns false if the index is missing, stale or malformed.
+static bool load(StringRef Path, ArrayRef<uint8_t> BuildID, uint64_t ModTime,
+                 uint64_t FileSize, std::unique_ptr<MemoryBuffer> &Buf,
+                 const char *&Entries, uint64_t &NumEntries) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr =
+      MemoryBuffer::getFile(Path, -1, /*RequiresNullTerminator=*/false);
+  if (!BufOrErr)
+    return false;
+  StringRef Data = BufOrErr.get()->getBuffer();
+  uint64_t HeaderSize = getHeaderSize(BuildID.size());
+  if (Data.size() < HeaderSize ||
+      memcmp(Data.data(), IndexMagic, sizeof(IndexMagic)) != 0)
+    return false;
+
+  const char *P = Data.data() + sizeof(IndexMagic);
+  auto Read32 = [&]() {
+    uint32_t V = endian::read<uint32_t, little, unaligned>(P);
+    P += 4;
+    return V;
+  };
+  auto Read64 = [&]() {
+    uint64_t V = endian::read<uint64_t, little, unaligned>(P);
+    P += 8;
+    return V;
+  };
+  if (Read32() != IndexVersion || Read32() != BuildID.size() ||
+      Read64() != ModTime || Read64() != FileSize)
+    return false;
+  NumEntries = Read64();
+  if (memcmp(P, BuildID.data(), BuildID.size()) != 0 ||
+      (Data.size() - HeaderSize) / EntrySize != NumEntries ||
+      (Data.size() - HeaderSize) % EntrySize != 0)
+    return false;
+  Entries = Data.data() + HeaderSize;
+  Buf = std::move(BufOrErr.get());
+  return true;
+}
+
+/// Write the index of \p DICtx to \p Path. The file is written under a
+/// temporary name and renamed, so that concurrent symbolizers never see a
+/// partial index.
+static bool write(StringRef Path, ArrayRef<uint8_t> BuildID, uint64_t ModTime,
+                  uint64_t FileSize, DWARFContext &DICtx) {
+  const DWARFDebugAranges *Aranges = DICtx.getDebugAranges();
+  uint64_t NumEntries =
+      std::distance(Aranges->ranges().begin(), Aranges->ranges().end());
+
+  int FD;
+  SmallString<128> TempPath;
+  if (sys::fs::createUniqueFile(Path + "-%%%%%%.tmp", FD, TempPath))
+    return false;
+  {
+    raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    endian::Writer<little> W(OS);
+    OS.write(IndexMagic, sizeof(IndexMagic));
+    W.write<uint32_t>(IndexVersion);
+    W.write<uint32_t>(BuildID.size());
+    W.write<uint64_t>(ModTime);
+    W.write<uint64_t>(FileSize);
+    W.write<uint64_t>(NumEntries);
+    OS.write(reinterpret_cast<const char *>(BuildID.data()), BuildID.size());
+    OS.write("\0\0\0\0\0\0\0", OffsetToAlignment(BuildID.size(), 8));
+    for (const auto &R : Aranges->ranges()) {
+      W.write<uint64_t>(R.LowPC);
+      W.write<uint64_t>(R.HighPC());
+      W.write<uint32_t>(R.CUOffset);
+    }
+    // Errors may only be reported when the file is closed.
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      sys::fs::remove(TempPath.str());
+      return false;
+    }
+  }
+  if (sys::fs::rename(TempPath.str(), Path)) {
+    sys::fs::remove(TempPath.str());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<AddressIndex>
+AddressIndex::getOrCreate(StringRef IndexDir, const object::ObjectFile &Obj,
+                          StringRef ArchName, bool IsDebugFile,
+                          DWARFContext &DICtx) {
+  sys::fs::file_status Status;
+  if (sys::fs::status(Obj.getFileName(), Status))
+    return nullptr;
+  uint64_t ModTime = Status.getLastModificationTime().toEpochTime();
+  uint64_t FileSize = Status.getSize();
+  ArrayRef<uint8_t> BuildID = getBuildID(Obj);
+
+  SmallString<128> Path(IndexDir);
+  sys::path::append(Path, getIndexName(Obj, BuildID, ArchName, IsDebugFile));
+
+  const char *Entries = nullptr;
+  uint64_t NumEntries = 0;
+  std::unique_ptr<MemoryBuffer> Buf;
+  if (load(Path, BuildID, ModTime, FileSize, Buf, Entries, NumEntries)) {
+    ++NumIndexesReused;
+  } else {
+    if (sys::fs::create_directories(IndexDir) ||
+        !write(Path, BuildID, ModTime, FileSize, DICtx) ||
+        !load(Path, BuildID, ModTime, FileSize, Buf, Entries, NumEntries))
+      return nullptr;
+    ++NumIndexesBuilt;
+  }
+  return std::unique_ptr<AddressIndex>(
+      new AddressIndex(std::move(Buf), Entries, NumEntries));
+}
+
+AddressIndex::Entry AddressIndex::getEntry(uint64_t I) const {
+  const char *P = Entries + I * EntrySize;
+  Entry E;
+  E.LowPC = endian::read<uint64_t, little, unaligned>(P);
+  E.HighPC = endian::read<uint64_t, little, unaligned>(P + 8);
+  E.CUOffset = endian::read<uint32_t, little, unaligned>(P + 16);
+  return E;
+}
+
+bool AddressIndex::lookup(uint64_t Address, Entry &Result) const {
+  // Find the last entry starting at or before Address.
+  uint64_t Lo = 0, Hi = NumEntries;
+  while (Lo < Hi) {
+    uint64_t Mid = Lo + (Hi - Lo) / 2;
+    if (getEntry(Mid).LowPC <= Address)
+      Lo = Mid + 1;
+    else
+      Hi = Mid;
+  }
+  if (Lo == 0)
+    return false;
+  Result = getEntry(Lo - 1);
+  return Address < Result.HighPC;
+}
+
+uint32_t IndexedDWARFContext::getCompileUnitOffsetForAddress(uint64_t Address) {
+  if (!Index)
+    return DWARFContextInMemory::getCompileUnitOffsetForAddress(Address);
+  AddressIndex::Entry E;
+  if (!Index->lookup(Address, E))
+    return -1U;
+  ++NumIndexedLookups;
+  return E.CUOffset;
+}
+
+} // namespace symbolize
+} // namespace llvm
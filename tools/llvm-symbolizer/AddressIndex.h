@@ -0,0 +1,106 @@
+//===-- AddressIndex.h ------------------------------------------ C++ -----===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// Header for the persistent address index used by the symbolizer.
+//
+//===----------------------------------------------------------------------===//
+#ifndef LLVM_TOOLS_LLVM_SYMBOLIZER_ADDRESSINDEX_H
+#define LLVM_TOOLS_LLVM_SYMBOLIZER_ADDRESSINDEX_H
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/DebugInfo/DWARFContext.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include <memory>
+
+namespace llvm {
+namespace symbolize {
+
+/// An on-disk index of the address ranges covered by the compile units of a
+/// binary, as computed by DWARFDebugAranges.
+///
+/// Computing the address ranges requires parsing the DIEs of every compile
+/// unit not described by .debug_aranges, which dominates the cost of the first
+/// lookup in a large binary. The index is written once to a cache directory
+/// and memory mapped by later processes, which then only need to parse the
+/// compile unit covering the looked up address. It is keyed by the build ID
+/// and kind (binary or separate debug file) of the file holding the debug
+/// info, and records its modification time and size, so that a stale index is
+/// detected and rebuilt.
+///
+/// The file starts with a header, followed by an array of entries sorted by
+/// address and not overlapping each other. All integers are little-endian.
+///
+///   char     Magic[8]        "LLVMAIDX"
+///   uint32_t Version
+///   uint32_t BuildIDSize
+///   uint64_t ModificationTime
+///   uint64_t FileSize
+///   uint64_t NumEntries
+///   uint8_t  BuildID[BuildIDSize], zero padded to a multiple of 8 bytes
+///   Entry    Entries[NumEntries]
+///
+/// where each Entry is made of a uint64_t LowPC and HighPC, followed by the
+/// uint32_t offset of the compile unit in .debug_info. The offset of the line
+/// table is not recorded: it is an attribute of the compile unit DIE, which is
+/// read anyway for the compilation directory and the function names.
+class AddressIndex {
+public:
+  struct Entry {
+    uint64_t LowPC;
+    uint64_t HighPC;
+    uint32_t CUOffset;
+  };
+
+  /// Open the index of the debug info in \p Obj from \p IndexDir, building and
+  /// saving it first if it is missing or stale. \p ArchName distinguishes the
+  /// slices of a universal binary. \p IsDebugFile tells whether \p Obj is a
+  /// separate debug file of the binary rather than the binary itself. Returns
+  /// null if no index can be used.
+  static std::unique_ptr<AddressIndex> getOrCreate(StringRef IndexDir,
+                                                   const object::ObjectFile &Obj,
+                                                   StringRef ArchName,
+                                                   bool IsDebugFile,
+                                                   DWARFContext &DICtx);
+
+  /// Find the entry covering \p Address. Returns false if there is none.
+  bool lookup(uint64_t Address, Entry &Result) const;
+
+  uint64_t getNumEntries() const { return NumEntries; }
+
+private:
+  AddressIndex(std::unique_ptr<MemoryBuffer> Buffer, const char *Entries,
+               uint64_t NumEntries)
+      : Buffer(std::move(Buffer)), Entries(Entries), NumEntries(NumEntries) {}
+
+  Entry getEntry(uint64_t I) const;
+
+  std::unique_ptr<MemoryBuffer> Buffer;
+  const char *Entries;
+  uint64_t NumEntries;
+};
+
+/// A DWARFContext finding the compile unit of an address through an
+/// AddressIndex rather than by computing the address ranges of every unit.
+class IndexedDWARFContext : public DWARFContextInMemory {
+  std::unique_ptr<AddressIndex> Index;
+
+public:
+  explicit IndexedDWARFContext(const object::ObjectFile &Obj)
+      : DWARFContextInMemory(Obj) {}
+
+  void setIndex(std::unique_ptr<AddressIndex> I) { Index = std::move(I); }
+
+protected:
+  uint32_t getCompileUnitOffsetForAddress(uint64_t Address) override;
+};
+
+} // namespace symbolize
+} // namespace llvm
+
+#endif
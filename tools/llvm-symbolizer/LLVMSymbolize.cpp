@@ -12,6 +12,7 @@
 //===----------------------------------------------------------------------===//
 
 #include "LLVMSymbolize.h"
+#include "AddressIndex.h"
 #include "llvm/ADT/STLExtras.h"
 #include "llvm/Config/config.h"
 #include "llvm/Object/ELFObjectFile.h"
@@ -23,6 +24,8 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 #include <sstream>
 #include <stdlib.h>
 
@@ -43,8 +46,16 @@ getDILineInfoSpecifier(const LLVMSymbolizer::Options &Opts) {
       Opts.PrintFunctions);
 }
 
-ModuleInfo::ModuleInfo(ObjectFile *Obj, DIContext *DICtx)
-    : Module(Obj), DebugInfoContext(DICtx) {
+uint64_t OwnedObjects::getMemorySize() const {
+  uint64_t Size = 0;
+  for (const auto &Buffer : MemoryBuffers)
+    Size += Buffer->getBufferSize();
+  return Size;
+}
+
+ModuleInfo::ModuleInfo(ObjectFile *Obj, DIContext *DICtx,
+                       std::shared_ptr<OwnedObjects> Owner)
+    : Owner(std::move(Owner)), Module(Obj), DebugInfoContext(DICtx) {
   std::unique_ptr<DataExtractor> OpdExtractor;
   uint64_t OpdAddress = 0;
   // Find the .opd (function descriptor) section if any, for big-endian
@@ -145,6 +156,7 @@ DILineInfo ModuleInfo::symbolizeCode(
     uint64_t ModuleOffset, const LLVMSymbolizer::Options &Opts) const {
   DILineInfo LineInfo;
   if (DebugInfoContext) {
+    sys::ScopedLock Lock(DebugInfoLock);
     LineInfo = DebugInfoContext->getLineInfoForAddress(
         ModuleOffset, getDILineInfoSpecifier(Opts));
   }
@@ -164,6 +176,7 @@ DIInliningInfo ModuleInfo::symbolizeInlinedCode(
     uint64_t ModuleOffset, const LLVMSymbolizer::Options &Opts) const {
   DIInliningInfo InlinedContext;
   if (DebugInfoContext) {
+    sys::ScopedLock Lock(DebugInfoLock);
     InlinedContext = DebugInfoContext->getInliningInfoForAddress(
         ModuleOffset, getDILineInfoSpecifier(Opts));
   }
@@ -201,7 +214,57 @@ const char LLVMSymbolizer::kBadString[] = "??";
 
 std::string LLVMSymbolizer::symbolizeCode(const std::string &ModuleName,
                                           uint64_t ModuleOffset) {
-  ModuleInfo *Info = getOrCreateModuleInfo(ModuleName);
+  return symbolizeCode(getOrCreateModuleInfo(ModuleName).get(), ModuleOffset);
+}
+
+std::string LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
+                                          uint64_t ModuleOffset) {
+  std::shared_ptr<ModuleInfo> Info;
+  if (Opts.UseSymbolTable)
+    Info = getOrCreateModuleInfo(ModuleName);
+  return symbolizeData(Info.get(), ModuleOffset);
+}
+
+std::vector<std::string>
+LLVMSymbolizer::symbolizeBatch(ArrayRef<Request> Requests,
+                               unsigned NumThreads) {
+  // Group the requests by module, so that each module is opened once and
+  // looked up by a single thread.
+  std::map<std::string, std::vector<size_t>> RequestsByModule;
+  for (size_t I = 0, E = Requests.size(); I != E; ++I)
+    RequestsByModule[Requests[I].ModuleName].push_back(I);
+
+  std::vector<std::string> Results(Requests.size());
+  ThreadPool Pool(NumThreads ? NumThreads : heavyweight_hardware_concurrency());
+  TaskGroup Group(Pool);
+  for (const auto &ModuleRequests : RequestsByModule) {
+    Group.spawn([&](const std::string &ModuleName,
+                    const std::vector<size_t> &Indices) {
+      std::shared_ptr<ModuleInfo> Info;
+      if (!Opts.UseSymbolTable) {
+        // Data requests are answered without opening the module, as in
+        // symbolizeData().
+        for (size_t I : Indices)
+          if (!Requests[I].IsData) {
+            Info = getOrCreateModuleInfo(ModuleName);
+            break;
+          }
+      } else {
+        Info = getOrCreateModuleInfo(ModuleName);
+      }
+      // Each request has its own slot in Results, no locking is needed.
+      for (size_t I : Indices)
+        Results[I] = Requests[I].IsData
+                         ? symbolizeData(Info.get(), Requests[I].ModuleOffset)
+                         : symbolizeCode(Info.get(), Requests[I].ModuleOffset);
+    }, std::cref(ModuleRequests.first), std::cref(ModuleRequests.second));
+  }
+  Group.wait();
+  return Results;
+}
+
+std::string LLVMSymbolizer::symbolizeCode(const ModuleInfo *Info,
+                                          uint64_t ModuleOffset) {
   if (!Info)
     return printDILineInfo(DILineInfo());
   if (Opts.PrintInlining) {
@@ -220,16 +283,14 @@ std::string LLVMSymbolizer::symbolizeCode(const std::string &ModuleName,
   return printDILineInfo(LineInfo);
 }
 
-std::string LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
+std::string LLVMSymbolizer::symbolizeData(const ModuleInfo *Info,
                                           uint64_t ModuleOffset) {
   std::string Name = kBadString;
   uint64_t Start = 0;
   uint64_t Size = 0;
-  if (Opts.UseSymbolTable) {
-    if (ModuleInfo *Info = getOrCreateModuleInfo(ModuleName)) {
-      if (Info->symbolizeData(ModuleOffset, Name, Start, Size) && Opts.Demangle)
-        Name = DemangleName(Name);
-    }
+  if (Opts.UseSymbolTable && Info) {
+    if (Info->symbolizeData(ModuleOffset, Name, Start, Size) && Opts.Demangle)
+      Name = DemangleName(Name);
   }
   std::stringstream ss;
   ss << Name << "\n" << Start << " " << Size << "\n";
@@ -237,9 +298,11 @@ std::string LLVMSymbolizer::symbolizeData(const std::string &ModuleName,
 }
 
 void LLVMSymbolizer::flush() {
-  DeleteContainerSeconds(Modules);
+  sys::ScopedLock Lock(CacheLock);
+  Modules.clear();
+  ModulesLRU.clear();
+  OpenModulesMemory = 0;
   ObjectPairForPathArch.clear();
-  ObjectFileForArch.clear();
 }
 
 // For Path="/path/to/foo" and Basename="foo" assume that debug info is in
@@ -342,7 +405,8 @@ bool darwinDsymMatchesBinary(const MachOObjectFile *DbgObj,
 }
 
 ObjectFile *LLVMSymbolizer::lookUpDsymFile(const std::string &ExePath,
-    const MachOObjectFile *MachExeObj, const std::string &ArchName) {
+    const MachOObjectFile *MachExeObj, const std::string &ArchName,
+    OwnedObjects &Owner) {
   // On Darwin we may find DWARF in separate object file in
   // resource directory.
   std::vector<std::string> DsymPaths;
@@ -357,12 +421,12 @@ ObjectFile *LLVMSymbolizer::lookUpDsymFile(const std::string &ExePath,
     if (EC != errc::no_such_file_or_directory && !error(EC)) {
       OwningBinary<Binary> B = std::move(BinaryOrErr.get());
       ObjectFile *DbgObj =
-          getObjectFileFromBinary(B.getBinary(), ArchName);
+          getObjectFileFromBinary(B.getBinary(), ArchName, Owner);
       const MachOObjectFile *MachDbgObj =
           dyn_cast<const MachOObjectFile>(DbgObj);
       if (!MachDbgObj) continue;
       if (darwinDsymMatchesBinary(MachDbgObj, MachExeObj)) {
-        addOwningBinary(std::move(B));
+        Owner.addOwningBinary(std::move(B));
         return DbgObj; 
       }
     }
@@ -372,24 +436,38 @@ ObjectFile *LLVMSymbolizer::lookUpDsymFile(const std::string &ExePath,
 
 LLVMSymbolizer::ObjectPair
 LLVMSymbolizer::getOrCreateObjects(const std::string &Path,
-                                   const std::string &ArchName) {
-  const auto &I = ObjectPairForPathArch.find(std::make_pair(Path, ArchName));
-  if (I != ObjectPairForPathArch.end())
-    return I->second;
+                                   const std::string &ArchName,
+                                   std::shared_ptr<OwnedObjects> &Owner) {
+  const auto Key = std::make_pair(Path, ArchName);
+  {
+    sys::ScopedLock Lock(CacheLock);
+    const auto &I = ObjectPairForPathArch.find(Key);
+    if (I != ObjectPairForPathArch.end()) {
+      Owner = I->second.second;
+      return I->second.first;
+    }
+  }
+  // Record the objects, unless another thread opened the same ones in the
+  // meantime, in which case ours are dropped in favor of them.
+  auto Record = [&](ObjectPair Res) {
+    sys::ScopedLock Lock(CacheLock);
+    auto Insert = ObjectPairForPathArch.insert(
+        std::make_pair(Key, std::make_pair(Res, Owner)));
+    Owner = Insert.first->second.second;
+    return Insert.first->second.first;
+  };
+  Owner = std::make_shared<OwnedObjects>();
   ObjectFile *Obj = nullptr;
   ObjectFile *DbgObj = nullptr;
   ErrorOr<OwningBinary<Binary>> BinaryOrErr = createBinary(Path);
   if (!error(BinaryOrErr.getError())) {
     OwningBinary<Binary> &B = BinaryOrErr.get();
-    Obj = getObjectFileFromBinary(B.getBinary(), ArchName);
-    if (!Obj) {
-      ObjectPair Res = std::make_pair(nullptr, nullptr);
-      ObjectPairForPathArch[std::make_pair(Path, ArchName)] = Res;
-      return Res;
-    }
-    addOwningBinary(std::move(B));
+    Obj = getObjectFileFromBinary(B.getBinary(), ArchName, *Owner);
+    if (!Obj)
+      return Record(std::make_pair(nullptr, nullptr));
+    Owner->addOwningBinary(std::move(B));
     if (auto MachObj = dyn_cast<const MachOObjectFile>(Obj))
-      DbgObj = lookUpDsymFile(Path, MachObj, ArchName);
+      DbgObj = lookUpDsymFile(Path, MachObj, ArchName, *Owner);
     // Try to locate the debug binary using .gnu_debuglink section.
     if (!DbgObj) {
       std::string DebuglinkName;
@@ -400,48 +478,60 @@ LLVMSymbolizer::getOrCreateObjects(const std::string &Path,
         BinaryOrErr = createBinary(DebugBinaryPath);
         if (!error(BinaryOrErr.getError())) {
           OwningBinary<Binary> B = std::move(BinaryOrErr.get());
-          DbgObj = getObjectFileFromBinary(B.getBinary(), ArchName);
-          addOwningBinary(std::move(B));
+          DbgObj = getObjectFileFromBinary(B.getBinary(), ArchName, *Owner);
+          Owner->addOwningBinary(std::move(B));
         }
       }
     }
   }
   if (!DbgObj)
     DbgObj = Obj;
-  ObjectPair Res = std::make_pair(Obj, DbgObj);
-  ObjectPairForPathArch[std::make_pair(Path, ArchName)] = Res;
-  return Res;
+  return Record(std::make_pair(Obj, DbgObj));
 }
 
 ObjectFile *
 LLVMSymbolizer::getObjectFileFromBinary(Binary *Bin,
-                                        const std::string &ArchName) {
+                                        const std::string &ArchName,
+                                        OwnedObjects &Owner) {
   if (!Bin)
     return nullptr;
   ObjectFile *Res = nullptr;
   if (MachOUniversalBinary *UB = dyn_cast<MachOUniversalBinary>(Bin)) {
-    const auto &I = ObjectFileForArch.find(
-        std::make_pair(UB, ArchName));
-    if (I != ObjectFileForArch.end())
-      return I->second;
     ErrorOr<std::unique_ptr<ObjectFile>> ParsedObj =
         UB->getObjectForArch(Triple(ArchName).getArch());
     if (ParsedObj) {
       Res = ParsedObj.get().get();
-      ParsedBinariesAndObjects.push_back(std::move(ParsedObj.get()));
+      Owner.addObject(std::move(ParsedObj.get()));
     }
-    ObjectFileForArch[std::make_pair(UB, ArchName)] = Res;
   } else if (Bin->isObject()) {
     Res = cast<ObjectFile>(Bin);
   }
   return Res;
 }
 
-ModuleInfo *
+std::shared_ptr<ModuleInfo>
 LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
-  const auto &I = Modules.find(ModuleName);
-  if (I != Modules.end())
-    return I->second;
+  std::promise<std::shared_ptr<ModuleInfo>> Promise;
+  std::shared_future<std::shared_ptr<ModuleInfo>> Future;
+  {
+    sys::ScopedLock Lock(CacheLock);
+    const auto &I = Modules.find(ModuleName);
+    if (I != Modules.end()) {
+      if (I->second.LRUPosition != ModulesLRU.end())
+        ModulesLRU.splice(ModulesLRU.begin(), ModulesLRU,
+                          I->second.LRUPosition);
+      Future = I->second.Info;
+    } else {
+      // Claim the module, and load it once the lock is released.
+      ModuleEntry &Entry = Modules[ModuleName];
+      Entry.Info = Promise.get_future().share();
+      Entry.LRUPosition = ModulesLRU.end();
+    }
+  }
+  // Another thread loads the module, wait for it without holding the lock.
+  if (Future.valid())
+    return Future.get();
+
   std::string BinaryName = ModuleName;
   std::string ArchName = Opts.DefaultArch;
   size_t ColonPos = ModuleName.find_last_of(':');
@@ -453,20 +543,60 @@ LLVMSymbolizer::getOrCreateModuleInfo(const std::string &ModuleName) {
       ArchName = ArchStr;
     }
   }
-  ObjectPair Objects = getOrCreateObjects(BinaryName, ArchName);
-
+  std::shared_ptr<OwnedObjects> Owner;
+  ObjectPair Objects = getOrCreateObjects(BinaryName, ArchName, Owner);
   if (!Objects.first) {
     // Failed to find valid object file.
-    Modules.insert(make_pair(ModuleName, (ModuleInfo *)nullptr));
+    Promise.set_value(nullptr);
     return nullptr;
   }
-  DIContext *Context = DIContext::getDWARFContext(*Objects.second);
+  DIContext *Context;
+  if (Opts.AddressIndexDir.empty()) {
+    Context = DIContext::getDWARFContext(*Objects.second);
+  } else {
+    // Find compile units through the persistent index of the debug info, so
+    // that only the unit covering a looked up address needs to be parsed.
+    IndexedDWARFContext *IndexedContext =
+        new IndexedDWARFContext(*Objects.second);
+    IndexedContext->setIndex(AddressIndex::getOrCreate(
+        Opts.AddressIndexDir, *Objects.second, ArchName,
+        Objects.second != Objects.first, *IndexedContext));
+    Context = IndexedContext;
+  }
   assert(Context);
-  ModuleInfo *Info = new ModuleInfo(Objects.first, Context);
-  Modules.insert(make_pair(ModuleName, Info));
+  auto Info = std::make_shared<ModuleInfo>(Objects.first, Context, Owner);
+  Promise.set_value(Info);
+
+  sys::ScopedLock Lock(CacheLock);
+  const auto &I = Modules.find(ModuleName);
+  // The cache may have been flushed while the module was loading.
+  if (I == Modules.end())
+    return Info;
+  ModuleEntry &Entry = I->second;
+  Entry.LRUPosition = ModulesLRU.insert(ModulesLRU.begin(), ModuleName);
+  Entry.ObjectsKey = std::make_pair(BinaryName, ArchName);
+  Entry.MemorySize = Owner->getMemorySize();
+  OpenModulesMemory += Entry.MemorySize;
+  evictModules();
   return Info;
 }
 
+void LLVMSymbolizer::evictModules() {
+  // The most recently used module is never evicted, however large it is.
+  while (ModulesLRU.size() > 1 &&
+         ((Opts.MaxOpenModules && ModulesLRU.size() > Opts.MaxOpenModules) ||
+          (Opts.MaxModuleMemory &&
+           OpenModulesMemory > Opts.MaxModuleMemory))) {
+    auto I = Modules.find(ModulesLRU.back());
+    assert(I != Modules.end() && I->second.LRUPosition != ModulesLRU.end());
+    OpenModulesMemory -= I->second.MemorySize;
+    ObjectPairForPathArch.erase(I->second.ObjectsKey);
+    // The objects are released once the last user of the module is done.
+    Modules.erase(I);
+    ModulesLRU.pop_back();
+  }
+}
+
 std::string LLVMSymbolizer::printDILineInfo(DILineInfo LineInfo) const {
   // By default, DILineInfo contains "<invalid>" for function/filename it
   // cannot fetch. We replace it to "??" to make our output closer to addr2line.
@@ -13,15 +13,20 @@
 #ifndef LLVM_TOOLS_LLVM_SYMBOLIZER_LLVMSYMBOLIZE_H
 #define LLVM_TOOLS_LLVM_SYMBOLIZER_LLVMSYMBOLIZE_H
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/DebugInfo/DIContext.h"
 #include "llvm/Object/MachOUniversal.h"
 #include "llvm/Object/ObjectFile.h"
 #include "llvm/Support/DataExtractor.h"
 #include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Mutex.h"
+#include <future>
+#include <list>
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace llvm {
 
@@ -32,6 +37,28 @@ namespace symbolize {
 
 class ModuleInfo;
 
+/// Owns the binaries and object files opened for a module, which are released
+/// together when no module refers to them anymore.
+class OwnedObjects {
+public:
+  void addOwningBinary(OwningBinary<Binary> OwningBin) {
+    std::unique_ptr<Binary> Bin;
+    std::unique_ptr<MemoryBuffer> MemBuf;
+    std::tie(Bin, MemBuf) = OwningBin.takeBinary();
+    ParsedBinariesAndObjects.push_back(std::move(Bin));
+    MemoryBuffers.push_back(std::move(MemBuf));
+  }
+  void addObject(std::unique_ptr<ObjectFile> Obj) {
+    ParsedBinariesAndObjects.push_back(std::move(Obj));
+  }
+  /// Returns the total size of the files backing the objects.
+  uint64_t getMemorySize() const;
+
+private:
+  SmallVector<std::unique_ptr<Binary>, 4> ParsedBinariesAndObjects;
+  SmallVector<std::unique_ptr<MemoryBuffer>, 4> MemoryBuffers;
+};
+
 class LLVMSymbolizer {
 public:
   struct Options {
@@ -41,16 +68,33 @@ public:
     bool Demangle : 1;
     std::string DefaultArch;
     std::vector<std::string> DsymHints;
+    // If not empty, directory holding the address indexes of the binaries
+    // (see AddressIndex).
+    std::string AddressIndexDir;
+    // Least recently used modules are closed when more than MaxOpenModules
+    // are open, or when their files take more than MaxModuleMemory bytes.
+    // Zero means no limit.
+    unsigned MaxOpenModules;
+    uint64_t MaxModuleMemory;
     Options(bool UseSymbolTable = true,
             FunctionNameKind PrintFunctions = FunctionNameKind::LinkageName,
             bool PrintInlining = true, bool Demangle = true,
             std::string DefaultArch = "")
         : UseSymbolTable(UseSymbolTable),
           PrintFunctions(PrintFunctions), PrintInlining(PrintInlining),
-          Demangle(Demangle), DefaultArch(DefaultArch) {}
+          Demangle(Demangle), DefaultArch(DefaultArch), MaxOpenModules(0),
+          MaxModuleMemory(0) {}
+  };
+
+  /// A single address to symbolize, for symbolizeBatch().
+  struct Request {
+    std::string ModuleName;
+    uint64_t ModuleOffset;
+    bool IsData;
   };
 
-  LLVMSymbolizer(const Options &Opts = Options()) : Opts(Opts) {}
+  LLVMSymbolizer(const Options &Opts = Options())
+      : OpenModulesMemory(0), Opts(Opts) {}
   ~LLVMSymbolizer() {
     flush();
   }
@@ -61,40 +105,68 @@ public:
   symbolizeCode(const std::string &ModuleName, uint64_t ModuleOffset);
   std::string
   symbolizeData(const std::string &ModuleName, uint64_t ModuleOffset);
+
+  /// Symbolize all of \p Requests and return the results in the same order.
+  /// The requests are grouped by module, and the groups are resolved in
+  /// parallel on \p NumThreads threads (one per physical core if zero).
+  std::vector<std::string> symbolizeBatch(ArrayRef<Request> Requests,
+                                          unsigned NumThreads = 0);
+
   void flush();
   static std::string DemangleName(const std::string &Name);
 private:
   typedef std::pair<ObjectFile*, ObjectFile*> ObjectPair;
 
-  ModuleInfo *getOrCreateModuleInfo(const std::string &ModuleName);
+  std::string symbolizeCode(const ModuleInfo *Info, uint64_t ModuleOffset);
+  std::string symbolizeData(const ModuleInfo *Info, uint64_t ModuleOffset);
+
+  /// Returns the module info for \p ModuleName, which stays valid while the
+  /// returned pointer is held even if the module is evicted from the cache.
+  std::shared_ptr<ModuleInfo>
+  getOrCreateModuleInfo(const std::string &ModuleName);
   ObjectFile *lookUpDsymFile(const std::string &Path, const MachOObjectFile *ExeObj,
-                             const std::string &ArchName);
+                             const std::string &ArchName, OwnedObjects &Owner);
 
-  /// \brief Returns pair of pointers to object and debug object.
+  /// \brief Returns pair of pointers to object and debug object, and the
+  /// owner of both. The files are opened without holding CacheLock.
   ObjectPair getOrCreateObjects(const std::string &Path,
-                                const std::string &ArchName);
+                                const std::string &ArchName,
+                                std::shared_ptr<OwnedObjects> &Owner);
   /// \brief Returns a parsed object file for a given architecture in a
   /// universal binary (or the binary itself if it is an object file).
-  ObjectFile *getObjectFileFromBinary(Binary *Bin, const std::string &ArchName);
+  ObjectFile *getObjectFileFromBinary(Binary *Bin, const std::string &ArchName,
+                                      OwnedObjects &Owner);
+
+  /// Close least recently used modules until the cache limits are met.
+  void evictModules();
 
   std::string printDILineInfo(DILineInfo LineInfo) const;
 
-  // Owns all the parsed binaries and object files.
-  SmallVector<std::unique_ptr<Binary>, 4> ParsedBinariesAndObjects;
-  SmallVector<std::unique_ptr<MemoryBuffer>, 4> MemoryBuffers;
-  void addOwningBinary(OwningBinary<Binary> OwningBin) {
-    std::unique_ptr<Binary> Bin;
-    std::unique_ptr<MemoryBuffer> MemBuf;
-    std::tie(Bin, MemBuf) = OwningBin.takeBinary();
-    ParsedBinariesAndObjects.push_back(std::move(Bin));
-    MemoryBuffers.push_back(std::move(MemBuf));
-  }
+  struct ModuleEntry {
+    // Ready once the module is loaded. The loading thread inserts the entry
+    // and loads the module without holding CacheLock, and other threads
+    // asking for the same module wait on the future.
+    std::shared_future<std::shared_ptr<ModuleInfo>> Info;
+    // Position in the LRU list for open modules, ModulesLRU.end() while the
+    // module is loading or if it could not be loaded.
+    std::list<std::string>::iterator LRUPosition;
+    // Key of the objects of the module in ObjectPairForPathArch.
+    std::pair<std::string, std::string> ObjectsKey;
+    uint64_t MemorySize;
+  };
+
+  // Guards all the caches below, but is not held while modules are loaded.
+  // The module infos themselves are guarded by their own lock, so that
+  // different modules are loaded and symbolized concurrently.
+  sys::Mutex CacheLock;
 
   // Owns module info objects.
-  std::map<std::string, ModuleInfo *> Modules;
-  std::map<std::pair<MachOUniversalBinary *, std::string>, ObjectFile *>
-      ObjectFileForArch;
-  std::map<std::pair<std::string, std::string>, ObjectPair>
+  std::map<std::string, ModuleEntry> Modules;
+  // Names of the open modules, most recently used first.
+  std::list<std::string> ModulesLRU;
+  uint64_t OpenModulesMemory;
+  std::map<std::pair<std::string, std::string>,
+           std::pair<ObjectPair, std::shared_ptr<OwnedObjects>>>
       ObjectPairForPathArch;
 
   Options Opts;
@@ -103,7 +175,8 @@ private:
 
 class ModuleInfo {
 public:
-  ModuleInfo(ObjectFile *Obj, DIContext *DICtx);
+  ModuleInfo(ObjectFile *Obj, DIContext *DICtx,
+             std::shared_ptr<OwnedObjects> Owner);
 
   DILineInfo symbolizeCode(uint64_t ModuleOffset,
                            const LLVMSymbolizer::Options &Opts) const;
@@ -121,8 +194,12 @@ private:
   void addSymbol(const SymbolRef &Symbol,
                  DataExtractor *OpdExtractor = nullptr,
                  uint64_t OpdAddress = 0);
+  // Keeps the objects alive, and must be destroyed last.
+  std::shared_ptr<OwnedObjects> Owner;
   ObjectFile *Module;
   std::unique_ptr<DIContext> DebugInfoContext;
+  // The debug info context parses its data lazily, so lookups are serialized.
+  mutable sys::Mutex DebugInfoLock;
 
   struct SymbolDesc {
     uint64_t Addr;
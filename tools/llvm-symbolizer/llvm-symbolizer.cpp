@@ -67,6 +67,32 @@ ClDsymHint("dsym-hint", cl::ZeroOrMore,
            cl::desc("Path to .dSYM bundles to search for debug info for the "
                     "object files"));
 
+static cl::opt<std::string>
+ClAddressIndexDir("address-index-dir", cl::init(""),
+                  cl::desc("Directory in which to cache an index of the "
+                           "address ranges of each binary, speeding up the "
+                           "first lookup in later runs"));
+
+static cl::opt<bool>
+ClBatch("batch", cl::init(false),
+        cl::desc("Read all the input before symbolizing it, resolving the "
+                 "addresses of different modules in parallel"));
+
+static cl::opt<unsigned>
+ClThreads("threads", cl::init(0),
+          cl::desc("Number of threads used in batch mode (default: one per "
+                   "physical core)"));
+
+static cl::opt<unsigned>
+ClMaxOpenModules("max-open-modules", cl::init(0),
+                 cl::desc("Maximum number of modules kept open (0 means "
+                          "no limit)"));
+
+static cl::opt<unsigned>
+ClMaxModuleMemory("max-module-memory", cl::init(0),
+                  cl::desc("Maximum size in megabytes of the files of the "
+                           "modules kept open (0 means no limit)"));
+
 static bool parseCommand(bool &IsData, std::string &ModuleName,
                          uint64_t &ModuleOffset) {
   const char *kDataCmd = "DATA ";
@@ -133,11 +159,25 @@ int main(int argc, char **argv) {
                 "\" (must have the '.dSYM' extension).\n";
     }
   }
+  Opts.AddressIndexDir = ClAddressIndexDir;
+  Opts.MaxOpenModules = ClMaxOpenModules;
+  Opts.MaxModuleMemory = uint64_t(ClMaxModuleMemory) << 20;
   LLVMSymbolizer Symbolizer(Opts);
 
   bool IsData = false;
   std::string ModuleName;
   uint64_t ModuleOffset;
+  if (ClBatch) {
+    std::vector<LLVMSymbolizer::Request> Requests;
+    while (parseCommand(IsData, ModuleName, ModuleOffset)) {
+      LLVMSymbolizer::Request R = { ModuleName, ModuleOffset, IsData };
+      Requests.push_back(R);
+    }
+    for (const std::string &Result :
+         Symbolizer.symbolizeBatch(Requests, ClThreads))
+      outs() << Result << "\n";
+    return 0;
+  }
   while (parseCommand(IsData, ModuleName, ModuleOffset)) {
     std::string Result =
         IsData ? Symbolizer.symbolizeData(ModuleName, ModuleOffset)
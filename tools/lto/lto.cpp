@@ -289,6 +289,19 @@ const void *lto_codegen_compile(lto_code_gen_t cg, size_t *length) {
                              sLastErrorString);
 }
 
+void lto_codegen_set_parallelism(lto_code_gen_t cg, unsigned parallelism) {
+  unwrap(cg)->setCodeGenParallelism(parallelism);
+}
+
+unsigned lto_codegen_get_num_objects(lto_code_gen_t cg) {
+  return unwrap(cg)->getNumObjects();
+}
+
+const void *lto_codegen_get_object(lto_code_gen_t cg, unsigned index,
+                                   size_t *length) {
+  return unwrap(cg)->getObject(index, length);
+}
+
 bool lto_codegen_compile_to_file(lto_code_gen_t cg, const char **name) {
   if (!parsedOptions) {
     unwrap(cg)->parseCodeGenDebugOptions();
@@ -164,4 +164,43 @@ TEST(BitReaderTest, MaterializeFunctionsForBlockAddrInFunctionAfter) {
   EXPECT_FALSE(verifyModule(*M, &dbgs()));
 }
 
+TEST(BitReaderTest, MaterializeFunctionsThroughOffsetIndex) {
+  SmallString<1024> Mem;
+
+  LLVMContext Context;
+  std::unique_ptr<Module> M = getLazyModuleFromAssembly(
+      Context, Mem, "define void @first() {\n"
+                    "  unreachable\n"
+                    "}\n"
+                    "define void @0() {\n"
+                    "  unreachable\n"
+                    "}\n"
+                    "define void @last() {\n"
+                    "  call void @0()\n"
+                    "  ret void\n"
+                    "}\n");
+  EXPECT_FALSE(verifyModule(*M, &dbgs()));
+
+  // @last is found through the symbol table, without reading the other
+  // function blocks.
+  EXPECT_FALSE(M->getFunction("last")->materialize());
+  EXPECT_FALSE(M->getFunction("last")->empty());
+  EXPECT_TRUE(M->getFunction("first")->empty());
+  EXPECT_FALSE(verifyModule(*M, &dbgs()));
+
+  // The anonymous function has no symbol table entry and is found by
+  // scanning the module.
+  Function *Anon = cast<Function>(
+      cast<CallInst>(M->getFunction("last")->front().front())
+          .getCalledValue());
+  EXPECT_TRUE(Anon->empty());
+  EXPECT_FALSE(Anon->materialize());
+  EXPECT_FALSE(Anon->empty());
+  EXPECT_TRUE(M->getFunction("first")->empty());
+
+  EXPECT_FALSE(M->getFunction("first")->materialize());
+  EXPECT_FALSE(M->getFunction("first")->empty());
+  EXPECT_FALSE(verifyModule(*M, &dbgs()));
+}
+
 } // end namespace
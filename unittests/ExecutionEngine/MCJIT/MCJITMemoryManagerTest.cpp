@@ -166,5 +166,47 @@ TEST(MCJITMemoryManagerTest, ManyVariedAllocations) {
   }
 }
 
+TEST(MCJITMemoryManagerTest, AllocationsAfterFinalize) {
+  std::unique_ptr<SectionMemoryManager> MemMgr(new SectionMemoryManager());
+
+  uint8_t *code1 = MemMgr->allocateCodeSection(256, 0, 1, "");
+  uint8_t *data1 = MemMgr->allocateDataSection(256, 0, 2, "", true);
+  std::string Error;
+  EXPECT_FALSE(MemMgr->finalizeMemory(&Error));
+
+  // The rest of the slabs is still writable, past the finalized pages.
+  uint8_t *code2 = MemMgr->allocateCodeSection(256, 0, 3, "");
+  uint8_t *data2 = MemMgr->allocateDataSection(256, 0, 4, "", true);
+  EXPECT_NE((uint8_t*)nullptr, code2);
+  EXPECT_NE((uint8_t*)nullptr, data2);
+  for (unsigned i = 0; i < 256; ++i) {
+    code2[i] = 1;
+    data2[i] = 2;
+  }
+  EXPECT_GT(code2, code1);
+  EXPECT_LT(code2 - code1, SectionMemoryManager::DefaultSlabSize);
+  EXPECT_GT(data2, data1);
+  EXPECT_LT(data2 - data1, SectionMemoryManager::DefaultSlabSize);
+  EXPECT_FALSE(MemMgr->finalizeMemory(&Error));
+}
+
+TEST(MCJITMemoryManagerTest, SlabReuse) {
+  // A slab size no other test uses, so that the slab is not taken by them.
+  const uintptr_t SlabSize = 3 * 256 * 1024;
+  std::unique_ptr<SectionMemoryManager> MemMgr(
+      new SectionMemoryManager(SlabSize));
+  uint8_t *code1 = MemMgr->allocateCodeSection(256, 0, 1, "");
+  std::string Error;
+  EXPECT_FALSE(MemMgr->finalizeMemory(&Error));
+
+  // The slab of a destroyed manager goes to the next one, writable again.
+  MemMgr.reset(new SectionMemoryManager(SlabSize));
+  uint8_t *code2 = MemMgr->allocateCodeSection(256, 0, 1, "");
+  EXPECT_EQ(code1, code2);
+  for (unsigned i = 0; i < 256; ++i)
+    code2[i] = 1;
+  EXPECT_FALSE(MemMgr->finalizeMemory(&Error));
+}
+
 } // Namespace
 
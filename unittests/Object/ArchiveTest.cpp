@@ -0,0 +1,183 @@
+//===- llvm/unittest/Object/ArchiveTest.cpp - Archive tests ---------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Object/Archive.h"
+#include "llvm/Object/Error.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+using namespace object;
+
+namespace {
+
+static void writeField(std::string &Out, StringRef Field, unsigned Size) {
+  Out += Field;
+  Out.append(Size - Field.size(), ' ');
+}
+
+static void writeHeader(std::string &Out, StringRef Name, unsigned Size) {
+  writeField(Out, Name, 16);
+  writeField(Out, "0", 12);
+  writeField(Out, "0", 6);
+  writeField(Out, "0", 6);
+  writeField(Out, "644", 8);
+  writeField(Out, std::to_string(Size), 10);
+  Out += "`\n";
+}
+
+static void writeBE32(std::string &Out, uint32_t Value) {
+  for (int I = 3; I >= 0; --I)
+    Out += char((Value >> (8 * I)) & 0xff);
+}
+
+/// Build a GNU archive with a symbol table. Member I is named "mI.o" and
+/// defines the symbols Symbols[I].
+static std::string
+buildArchive(const std::vector<std::vector<std::string>> &Symbols) {
+  std::string SymbolNames;
+  unsigned NumSymbols = 0;
+  for (const auto &MemberSymbols : Symbols) {
+    for (const std::string &Name : MemberSymbols) {
+      SymbolNames += Name;
+      SymbolNames += '\0';
+    }
+    NumSymbols += MemberSymbols.size();
+  }
+  unsigned SymbolTableSize = 4 + 4 * NumSymbols + SymbolNames.size();
+  SymbolTableSize += SymbolTableSize % 2;
+
+  const std::string Contents = "contents";
+  std::vector<uint32_t> Offsets;
+  uint32_t Offset = 8 + 60 + SymbolTableSize;
+  for (unsigned I = 0, E = Symbols.size(); I != E; ++I) {
+    Offsets.push_back(Offset);
+    Offset += 60 + Contents.size();
+  }
+
+  std::string Out = "!<arch>\n";
+  writeHeader(Out, "/", SymbolTableSize);
+  writeBE32(Out, NumSymbols);
+  for (unsigned I = 0, E = Symbols.size(); I != E; ++I)
+    for (unsigned J = 0, F = Symbols[I].size(); J != F; ++J)
+      writeBE32(Out, Offsets[I]);
+  Out += SymbolNames;
+  if (Out.size() % 2)
+    Out += '\0';
+  for (unsigned I = 0, E = Symbols.size(); I != E; ++I) {
+    writeHeader(Out, "m" + std::to_string(I) + ".o/", Contents.size());
+    Out += Contents;
+  }
+  return Out;
+}
+
+static std::unique_ptr<Archive> createArchive(StringRef Buffer) {
+  ErrorOr<std::unique_ptr<Archive>> ArchiveOrErr =
+      Archive::create(MemoryBufferRef(Buffer, "test.a"));
+  EXPECT_EQ(std::error_code(), ArchiveOrErr.getError());
+  return std::move(*ArchiveOrErr);
+}
+
+static std::string getMemberName(Archive::child_iterator I) {
+  ErrorOr<StringRef> NameOrErr = I->getName();
+  EXPECT_EQ(std::error_code(), NameOrErr.getError());
+  return *NameOrErr;
+}
+
+TEST(ArchiveTest, FindSym) {
+  std::string Buffer =
+      buildArchive({{"foo", "bar"}, {"baz", "dup"}, {"dup", "qux"}});
+  std::unique_ptr<Archive> A = createArchive(Buffer);
+
+  EXPECT_EQ("m0.o", getMemberName(A->findSym("foo")));
+  EXPECT_EQ("m0.o", getMemberName(A->findSym("bar")));
+  EXPECT_EQ("m2.o", getMemberName(A->findSym("qux")));
+  // The first member defining a symbol wins.
+  EXPECT_EQ("m1.o", getMemberName(A->findSym("dup")));
+  EXPECT_TRUE(A->findSym("missing") == A->child_end());
+  EXPECT_TRUE(A->findSym("") == A->child_end());
+}
+
+TEST(ArchiveTest, FindSymWithoutSymbolTable) {
+  std::string Buffer = "!<arch>\n";
+  writeHeader(Buffer, "m0.o/", 2);
+  Buffer += "xy";
+  std::unique_ptr<Archive> A = createArchive(Buffer);
+  EXPECT_FALSE(A->hasSymbolTable());
+  EXPECT_TRUE(A->findSym("foo") == A->child_end());
+}
+
+TEST(ArchiveTest, GetChildAtOffset) {
+  std::string Buffer = buildArchive({{"foo"}, {"bar"}, {"baz"}});
+  std::unique_ptr<Archive> A = createArchive(Buffer);
+
+  for (const Archive::Child &C : A->children()) {
+    ErrorOr<Archive::child_iterator> ChildOrErr =
+        A->getChildAtOffset(C.getChildOffset());
+    ASSERT_EQ(std::error_code(), ChildOrErr.getError());
+    EXPECT_TRUE(**ChildOrErr == C);
+  }
+
+  // Offsets that are not the start of a member header.
+  for (uint64_t Offset : {uint64_t(0), uint64_t(9), uint64_t(Buffer.size()),
+                          uint64_t(Buffer.size() - 10)})
+    EXPECT_EQ(object_error::parse_failed,
+              A->getChildAtOffset(Offset).getError());
+
+  // A member whose contents run past the end of the archive.
+  uint64_t LastOffset = Buffer.size() - 60 - 8;
+  ASSERT_EQ(std::error_code(), A->getChildAtOffset(LastOffset).getError());
+  StringRef Truncated = StringRef(Buffer).drop_back(2);
+  std::unique_ptr<Archive> T = createArchive(Truncated);
+  EXPECT_EQ(object_error::parse_failed,
+            T->getChildAtOffset(LastOffset).getError());
+}
+
+// Microbenchmark of symbol lookups in a large archive, not run by default.
+// Use --gtest_also_run_disabled_tests to get the numbers.
+TEST(ArchiveTest, DISABLED_FindSymLargeArchive) {
+  typedef std::chrono::steady_clock Clock;
+  const unsigned NumMembers = 50000;
+  std::vector<std::vector<std::string>> Symbols(NumMembers);
+  for (unsigned I = 0; I != NumMembers; ++I)
+    Symbols[I].push_back("symbol_" + std::to_string(I));
+  std::string Buffer = buildArchive(Symbols);
+
+  // Opening the archive builds the symbol index.
+  Clock::time_point Start = Clock::now();
+  std::unique_ptr<Archive> A = createArchive(Buffer);
+  double Open =
+      std::chrono::duration<double, std::milli>(Clock::now() - Start).count();
+
+  Start = Clock::now();
+  for (unsigned I = 0; I != NumMembers; ++I)
+    ASSERT_TRUE(A->findSym(Symbols[I][0]) != A->child_end());
+  double Lookup = std::chrono::duration<double, std::micro>(
+                      Clock::now() - Start).count() / NumMembers;
+
+  std::vector<uint64_t> Offsets;
+  for (const Archive::Child &C : A->children())
+    Offsets.push_back(C.getChildOffset());
+  Start = Clock::now();
+  for (uint64_t Offset : Offsets)
+    ASSERT_EQ(std::error_code(), A->getChildAtOffset(Offset).getError());
+  double ChildAtOffset = std::chrono::duration<double, std::micro>(
+                             Clock::now() - Start).count() / NumMembers;
+
+  outs() << "Archive(" << NumMembers << " members): "
+         << format("%.3f", Open) << " ms open, "
+         << format("%.3f", Lookup) << " us/lookup, "
+         << format("%.3f", ChildAtOffset) << " us/child at offset\n";
+}
+
+} // end anonymous namespace
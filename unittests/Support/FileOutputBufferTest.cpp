@@ -11,6 +11,7 @@
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/FileOutputBuffer.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/Path.h"
 #include "llvm/Support/raw_ostream.h"
 #include "gtest/gtest.h"
@@ -111,4 +112,73 @@ TEST(FileOutputBuffer, Test) {
   // Clean up.
   ASSERT_NO_ERROR(fs::remove(TestDirectory.str()));
 }
+
+static std::string readFile(StringRef Path) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> BufOrErr = MemoryBuffer::getFile(Path);
+  if (!BufOrErr)
+    return "<error>";
+  return BufOrErr.get()->getBuffer();
+}
+
+TEST(FileOutputBuffer, Stream) {
+  SmallString<128> TestDirectory;
+  ASSERT_NO_ERROR(
+      fs::createUniqueDirectory("FileOutputBuffer-test", TestDirectory));
+  SmallString<128> File(TestDirectory);
+  path::append(File, "file");
+
+  // Exact reservation, made after some data was written.
+  {
+    raw_output_buffer_ostream OS(File);
+    OS << "AABB";
+    OS.reserveExtraSpace(8);
+    OS << "CCDD" << "EEFF";
+    EXPECT_EQ(12U, OS.tell());
+    ASSERT_NO_ERROR(OS.commit());
+  }
+  EXPECT_EQ("AABBCCDDEEFF", readFile(File));
+
+  // Writing past the reservation.
+  {
+    raw_output_buffer_ostream OS(File);
+    OS.reserveExtraSpace(4);
+    OS << "AABBCCDD";
+    ASSERT_NO_ERROR(OS.commit());
+  }
+  EXPECT_EQ("AABBCCDD", readFile(File));
+
+  // Writing less than reserved.
+  {
+    raw_output_buffer_ostream OS(File);
+    OS.reserveExtraSpace(100);
+    OS << "AABB";
+    ASSERT_NO_ERROR(OS.commit());
+  }
+  EXPECT_EQ("AABB", readFile(File));
+
+  // No reservation at all.
+  {
+    raw_output_buffer_ostream OS(File);
+    OS << "AABBCC";
+    ASSERT_NO_ERROR(OS.commit());
+  }
+  EXPECT_EQ("AABBCC", readFile(File));
+
+  // Nothing written.
+  {
+    raw_output_buffer_ostream OS(File);
+    ASSERT_NO_ERROR(OS.commit());
+  }
+  EXPECT_EQ("", readFile(File));
+
+  // The file is left alone if the stream is not committed.
+  {
+    raw_output_buffer_ostream OS(File);
+    OS << "AABB";
+  }
+  EXPECT_EQ("", readFile(File));
+
+  ASSERT_NO_ERROR(fs::remove(File.str()));
+  ASSERT_NO_ERROR(fs::remove(TestDirectory.str()));
+}
 } // anonymous namespace
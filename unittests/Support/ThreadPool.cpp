@@ -0,0 +1,208 @@
+//========- unittests/Support/ThreadPool.cpp - ThreadPool.h tests ---========//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/raw_ostream.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <chrono>
+
+using namespace llvm;
+
+#if LLVM_ENABLE_THREADS
+
+namespace {
+
+// Fixture for the unittests, allowing to *temporarily* wait on a condition
+// before scheduling a task, so that the tests can check that nothing ran
+// before the main thread explicitly lets the work proceed.
+class ThreadPoolTest : public testing::Test {
+protected:
+  /// Make sure this thread does not progress faster than the main thread.
+  void waitForMainThread() {
+    std::unique_lock<std::mutex> LockGuard(WaitMainThreadMutex);
+    WaitMainThread.wait(LockGuard, [&] { return MainThreadReady; });
+  }
+
+  /// Set the readiness of the main thread.
+  void setMainThreadReady() {
+    {
+      std::unique_lock<std::mutex> LockGuard(WaitMainThreadMutex);
+      MainThreadReady = true;
+    }
+    WaitMainThread.notify_all();
+  }
+
+  void SetUp() override { MainThreadReady = false; }
+
+  std::condition_variable WaitMainThread;
+  std::mutex WaitMainThreadMutex;
+  bool MainThreadReady;
+};
+
+TEST_F(ThreadPoolTest, AsyncBarrier) {
+  // test that async & barrier work together properly.
+  std::atomic_int checked_in{0};
+
+  ThreadPool Pool;
+  for (size_t i = 0; i < 5; ++i) {
+    Pool.async([this, &checked_in] {
+      waitForMainThread();
+      ++checked_in;
+    });
+  }
+  ASSERT_EQ(0, checked_in);
+  setMainThreadReady();
+  Pool.wait();
+  ASSERT_EQ(5, checked_in);
+}
+
+static void TestFunc(std::atomic_int &checked_in, int i) { checked_in += i; }
+
+TEST_F(ThreadPoolTest, AsyncBarrierArgs) {
+  // Test that async works with a function requiring multiple parameters.
+  std::atomic_int checked_in{0};
+
+  ThreadPool Pool;
+  for (size_t i = 0; i < 5; ++i) {
+    Pool.async(TestFunc, std::ref(checked_in), i);
+  }
+  Pool.wait();
+  ASSERT_EQ(10, checked_in);
+}
+
+TEST_F(ThreadPoolTest, Async) {
+  ThreadPool Pool;
+  std::atomic_int i{0};
+  Pool.async([this, &i] {
+    waitForMainThread();
+    ++i;
+  });
+  Pool.async([&i] { ++i; });
+  ASSERT_NE(2, i.load());
+  setMainThreadReady();
+  Pool.wait();
+  ASSERT_EQ(2, i.load());
+}
+
+TEST_F(ThreadPoolTest, GetFuture) {
+  ThreadPool Pool(2);
+  std::atomic_int i{0};
+  Pool.async([this, &i] {
+    waitForMainThread();
+    ++i;
+  });
+  // Force the future using get()
+  std::shared_future<void> Future = Pool.async([&i] { ++i; });
+  ASSERT_NE(2, i.load());
+  setMainThreadReady();
+  Future.get();
+  ASSERT_NE(0, i.load());
+}
+
+TEST_F(ThreadPoolTest, GetResult) {
+  ThreadPool Pool;
+  std::shared_future<int> Future = Pool.async([](int A, int B) {
+    return A * B;
+  }, 6, 7);
+  ASSERT_EQ(42, Future.get());
+}
+
+TEST_F(ThreadPoolTest, PoolDestruction) {
+  // Test that we are waiting on destruction
+  std::atomic_int checked_in{0};
+  {
+    ThreadPool Pool;
+    for (size_t i = 0; i < 5; ++i) {
+      Pool.async([this, &checked_in] {
+        waitForMainThread();
+        ++checked_in;
+      });
+    }
+    ASSERT_EQ(0, checked_in);
+    setMainThreadReady();
+  }
+  ASSERT_EQ(5, checked_in);
+}
+
+TEST_F(ThreadPoolTest, ThreadCount) {
+  EXPECT_GE(heavyweight_hardware_concurrency(), 1u);
+  EXPECT_EQ(3u, ThreadPool(3).getThreadCount());
+  EXPECT_EQ(1u, ThreadPool(0).getThreadCount());
+}
+
+TEST_F(ThreadPoolTest, TaskGroupWait) {
+  // Test that a group only waits on its own tasks.
+  ThreadPool Pool(2);
+  std::atomic_int Blocked{0};
+  std::atomic_int Grouped{0};
+  Pool.async([this, &Blocked] {
+    waitForMainThread();
+    ++Blocked;
+  });
+  {
+    TaskGroup Group(Pool);
+    for (int i = 0; i < 10; ++i)
+      Group.spawn([&Grouped] { ++Grouped; });
+    Group.wait();
+    ASSERT_EQ(10, Grouped);
+    ASSERT_EQ(0, Blocked);
+  }
+  setMainThreadReady();
+  Pool.wait();
+  ASSERT_EQ(1, Blocked);
+}
+
+TEST_F(ThreadPoolTest, TaskGroupDestruction) {
+  // Test that the group destructor waits for the batch.
+  ThreadPool Pool;
+  std::atomic_int checked_in{0};
+  {
+    TaskGroup Group(Pool);
+    for (int i = 0; i < 5; ++i)
+      Group.spawn(TestFunc, std::ref(checked_in), i);
+  }
+  ASSERT_EQ(10, checked_in);
+}
+
+// Microbenchmark of the task dispatch latency, not run by default. Use
+// --gtest_also_run_disabled_tests to get the numbers.
+TEST_F(ThreadPoolTest, DISABLED_DispatchLatency) {
+  typedef std::chrono::steady_clock Clock;
+  const unsigned NumTasks = 100000;
+  ThreadPool Pool;
+
+  // Round trip: submit one empty task and block on its future.
+  Clock::time_point Start = Clock::now();
+  for (unsigned i = 0; i < NumTasks; ++i)
+    Pool.async([] {}).get();
+  double RoundTrip = std::chrono::duration<double, std::micro>(
+                         Clock::now() - Start).count() / NumTasks;
+
+  // Throughput: submit a batch of empty tasks and wait for all of them.
+  Start = Clock::now();
+  {
+    TaskGroup Group(Pool);
+    for (unsigned i = 0; i < NumTasks; ++i)
+      Group.spawn([] {});
+  }
+  double Batched = std::chrono::duration<double, std::micro>(
+                       Clock::now() - Start).count() / NumTasks;
+
+  outs() << "ThreadPool(" << Pool.getThreadCount() << " threads): "
+         << format("%.3f", RoundTrip) << " us/task round trip, "
+         << format("%.3f", Batched) << " us/task batched\n";
+}
+
+} // end anonymous namespace
+
+#endif
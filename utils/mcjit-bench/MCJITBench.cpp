@@ -0,0 +1,141 @@
+//===- MCJITBench - Benchmark the MCJIT memory management -----------------===//
+//
+//                     The LLVM Compiler Infrastructure
+//
+// This file is distributed under the University of Illinois Open Source
+// License. See LICENSE.TXT for details.
+//
+//===----------------------------------------------------------------------===//
+//
+// This program measures how JIT memory is reused across engines. It JITs many
+// small modules, each in its own engine, keeping a window of them alive and
+// destroying the oldest engine as each new one is created. It outputs the run
+// time, and how scattered the code of the live modules is.
+//
+// Memory is only handed back when an engine is destroyed: a module removed
+// with ExecutionEngine::removeModule keeps its sections, as RuntimeDyld
+// cannot unload an object.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ExecutionEngine/MCJIT.h"
+#include "llvm/ExecutionEngine/SectionMemoryManager.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ManagedStatic.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/raw_ostream.h"
+#include <algorithm>
+#include <deque>
+
+using namespace llvm;
+
+static cl::opt<unsigned>
+  NumModules("modules", cl::desc("Number of modules to JIT"),
+             cl::init(4000));
+
+static cl::opt<unsigned>
+  NumFunctions("functions", cl::desc("Number of functions in each module"),
+               cl::init(8));
+
+static cl::opt<unsigned>
+  NumLive("live", cl::desc("Number of modules kept alive at a time"),
+          cl::init(64));
+
+static cl::opt<unsigned>
+  SlabSizeKB("slab-size",
+             cl::desc("Size of the slabs of the memory managers, in "
+                      "kilobytes"),
+             cl::init(SectionMemoryManager::DefaultSlabSize / 1024));
+
+static cl::opt<bool>
+  HugePages("huge-pages", cl::desc("Back the code with huge pages"),
+            cl::init(false));
+
+/// Build a module of NumFunctions functions calling each other, the first one
+/// being named "entry".
+static std::unique_ptr<Module> createModule(LLVMContext &Context,
+                                            unsigned Index) {
+  std::unique_ptr<Module> M(new Module("bench" + Twine(Index).str(), Context));
+  IRBuilder<> Builder(Context);
+  Type *Int64Ty = Builder.getInt64Ty();
+  FunctionType *FTy = FunctionType::get(Int64Ty, Int64Ty, false);
+  Function *Next = nullptr;
+  for (unsigned I = NumFunctions; I != 0; --I) {
+    Function *F =
+        Function::Create(FTy, Function::ExternalLinkage,
+                         I == 1 ? "entry" : "f" + Twine(I).str(), M.get());
+    Builder.SetInsertPoint(BasicBlock::Create(Context, "", F));
+    Value *Arg = F->arg_begin();
+    Value *V = Builder.CreateMul(Arg, Builder.getInt64(Index + I));
+    V = Builder.CreateXor(V, Builder.CreateLShr(Arg, 3));
+    if (Next)
+      V = Builder.CreateAdd(V, Builder.CreateCall(Next, Arg));
+    Builder.CreateRet(V);
+    Next = F;
+  }
+  return M;
+}
+
+int main(int argc, char **argv) {
+  llvm_shutdown_obj Y;
+  cl::ParseCommandLineOptions(argc, argv,
+                              "MCJIT memory reuse across engines benchmark\n");
+
+  InitializeNativeTarget();
+  InitializeNativeTargetAsmPrinter();
+
+  LLVMContext Context;
+  std::deque<std::unique_ptr<ExecutionEngine>> Engines;
+  std::deque<uint64_t> Entries;
+  uint64_t Checksum = 0;
+
+  TimerGroup Group("MCJIT memory reuse across engines");
+  Timer JITTimer("JIT and run", Group);
+  Timer FreeTimer("Destroy engine", Group);
+  for (unsigned I = 0; I != NumModules; ++I) {
+    JITTimer.startTimer();
+    std::string Error;
+    std::unique_ptr<ExecutionEngine> EE(
+        EngineBuilder(createModule(Context, I))
+            .setEngineKind(EngineKind::JIT)
+            .setErrorStr(&Error)
+            .setMCJITMemoryManager(
+                std::unique_ptr<RTDyldMemoryManager>(new SectionMemoryManager(
+                    uintptr_t(SlabSizeKB) * 1024, HugePages)))
+            .create());
+    if (!EE) {
+      errs() << argv[0] << ": cannot create the engine: " << Error << "\n";
+      return 1;
+    }
+    uint64_t Entry = EE->getFunctionAddress("entry");
+    EE->finalizeObject();
+    Checksum += ((uint64_t (*)(uint64_t))Entry)(I);
+    Engines.push_back(std::move(EE));
+    Entries.push_back(Entry);
+    JITTimer.stopTimer();
+
+    if (Engines.size() > NumLive) {
+      FreeTimer.startTimer();
+      Engines.pop_front();
+      Entries.pop_front();
+      FreeTimer.stopTimer();
+    }
+  }
+
+  outs() << "Checksum: " << Checksum << "\n";
+  if (Entries.empty())
+    return 0;
+
+  // The smaller the range covering the code of the live modules, the fewer
+  // pages and TLB entries calling all of them needs.
+  uint64_t Lowest = *std::min_element(Entries.begin(), Entries.end());
+  uint64_t Highest = *std::max_element(Entries.begin(), Entries.end());
+  outs() << "Code of the last " << Entries.size() << " modules spans "
+         << (Highest - Lowest) / 1024 << " KB\n";
+  return 0;
+}